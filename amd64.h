@@ -0,0 +1,54 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_AMD64_H
+#define SMOLBASIC55_AMD64_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct reg_t {
+    int num;
+    int size;
+    bool rex8;
+};
+
+enum operand_kind_t {
+    OP_REG,
+    OP_IMM,
+    OP_MEM,
+    OP_LABEL
+};
+
+struct operand_t {
+    operand_kind_t kind;
+    reg_t reg{};
+    std::string sym{};
+    long value = 0;
+    int base = -1;
+    int index = -1;
+    int scale = 1;
+    bool rip = false;
+    bool indirect = false;
+};
+
+// one line of AT&T assembly as emitted by asm_amd64.cpp
+struct amd64_line_t {
+    long line;
+    std::string text;
+    std::vector<std::string> labels;
+    std::string mnemonic;
+    std::string args;
+    // operands of instructions, directives only have args
+    std::vector<operand_t> ops;
+};
+
+extern const std::map<std::string, int> amd64_condition_codes;
+
+std::vector<amd64_line_t> amd64_parse(const std::string &text);
+std::vector<std::string> amd64_split_operands(const std::string &s);
+bool amd64_parse_number(const std::string &s, long &v);
+void amd64_parse_expr(std::string s, std::string &sym, long &value);
+
+#endif //SMOLBASIC55_AMD64_H
@@ -4,18 +4,47 @@
 #include<stdio.h>
 #include<stdlib.h>
 
+// return the element index, the caller scales it by the element size
+
+// the failures are kept out of line in .text.unlikely
+
+__attribute__((cold, noreturn)) static void ARRAY__err_bound1(long x, long m) {
+    fprintf(stderr, "invalid array access: %li to array of dim (%li)\n", x, m);
+    exit(1);
+}
+
+__attribute__((cold, noreturn)) static void ARRAY__err_bound2(long y, long x, long my, long mx) {
+    fprintf(stderr, "invalid array access: (%li, %li) to array of dim (%li, %li)\n", y, x, my, mx);
+    exit(1);
+}
+
 long ARRAY__chk_bound1(long x, long m, long ob) {
     if(x < ob || x > m) {
-        fprintf(stderr, "invalid array access: %li to array of dim (%li)\n", x, m);
-        exit(1);
+        ARRAY__err_bound1(x, m);
     }
-    return (x - ob) * 8;
+    return x - ob;
 }
 
 long ARRAY__chk_bound2(long y, long x, long my, long mx, long ob) {
     if(x < ob || x > mx || y < ob || y > my) {
-        fprintf(stderr, "invalid array access: (%li, %li) to array of dim (%li, %li)\n", y, x, my, mx);
-        exit(1);
+        ARRAY__err_bound2(y, x, my, mx);
+    }
+    return (y - ob)  * (mx + (1 - ob)) + (x - ob);
+}
+
+// a FOR loop walks the elements from x0 to x1 (or the rectangle from (y0, x0) to (y1, x1)) by pointer if they are
+// all inside the array. The indices are already reduced by OPTION BASE. Returns the first element index or -1.
+
+long ARRAY__walk1(long x0, long x1, long m) {
+    if(x0 < 0 || x0 > m || x1 < 0 || x1 > m) {
+        return -1;
+    }
+    return x0;
+}
+
+long ARRAY__walk2(long y0, long x0, long y1, long x1, long my, long mx) {
+    if(ARRAY__walk1(y0, y1, my) < 0 || ARRAY__walk1(x0, x1, mx) < 0) {
+        return -1;
     }
-    return ((y - ob)  * (mx + (1 - ob)) + (x - ob)) * 8;
+    return y0 * (mx + 1) + x0;
 }
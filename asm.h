@@ -6,6 +6,9 @@
 
 #include <fstream>
 #include <map>
+#include <optional>
+#include <span>
+#include <string_view>
 #include<vector>
 #include<string>
 #include <variant>
@@ -25,9 +28,10 @@ void proc_start(bool reserve_gosub = true);
 void proc_main_start();
 void proc_sub_start();
 void proc_main_end(long r);
+void proc_main_close();
 void proc_end();
 
-void proc_sub_store_args(const std::vector<std::string> &arg_names);
+void proc_sub_store_args(std::span<const std::string> arg_names);
 
 void asm_call(const std::string& n);
 void asm_if_jump(long d);
@@ -47,14 +51,22 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference);
 void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step, long lv0, long lv1);
 void asm_for_cond(struct exp_t *var, long lv0, long lv1, const std::string& end);
 void asm_for_step(struct exp_t *exp, long step_var);
+// compute an expression hoisted out of a loop into its slot
+void asm_hoist(struct exp_t *exp, eval_ret type, long slot);
+long asm_unroll_factor();
+// run pairs of iterations of a vectorizable loop (lv0 is the limit of the loop)
+void asm_simd(const struct simd_loop_t &s, struct exp_t *var, long lv0);
+// point at the first element of an array walk (lv0 is the limit of the loop), and move to the next one
+void asm_walk_init(const struct licm_walk_t &w, long lv0);
+void asm_walk_step(const struct licm_walk_t &w);
 
-void asm_print(const std::vector<std::variant<char, exp_t*>> &items);
+void asm_print(std::span<const std::variant<char, exp_t*>> items);
 
-void asm_read(const std::vector<exp_t*> &items);
+void asm_read(std::span<exp_t* const> items);
 
-void asm_input(const std::vector<exp_t*> &items, const std::string& start);
+void asm_input(std::span<exp_t* const> items, const std::string& start);
 
-void asm_on_goto(exp_t *v, const std::vector<long>& l);
+void asm_on_goto(exp_t *v, std::span<const long> l);
 
 void asm_gosub(long d);
 void asm_return();
@@ -67,22 +79,45 @@ void asm_data(
         const std::map<long, std::string> &stringMap,
         const std::vector<std::pair<double, std::string>> &dataItems);
 
+void asm_debug_file(const std::string &path);
+void asm_debug_line(long source_line);
+void asm_function_start(const std::string &name);
+void asm_function_end(const std::string &name);
+
+// the following code goes to .text.unlikely (cold) or back to .text
+void asm_section(bool cold);
+
+void asm_profile_start();
+// RND__seed(seed) of math.c
+void asm_rnd_seed(unsigned long seed);
+void asm_profile_count(long line);
+void asm_profile_data(const std::vector<long> &lines, const std::string &file);
+
+// the MARCH_* extensions of a --march= name of this backend, nullopt for a name it does not know
+std::optional<unsigned> asm_march(std::string_view name);
+
+// registers for the variables of a regalloc region
+long asm_regs_available();
+void asm_regs_load();
+void asm_regs_store();
+
 void reset_tmp_count(long v = 0);
 long get_tmp_count();
 long get_max_tmp_count();
 long add_tmp(type_t type);
-long add_loop_vars();
 
 struct stack_layout_t {
     long sd;
     long tmp_count = 0;
     long max_tmp_count = 0;
+    long tmp_base = 0;
 };
 
-stack_layout_t pushStack();
+// a new frame whose temporaries start at stack offset base, returns the current one
+stack_layout_t pushStack(long base = 0);
 void popStack(stack_layout_t st);
 
-extern std::ofstream od;
+extern thread_local std::ostream od;
 extern long gosub_depth;
 
 #endif //SMOLBASIC55_ASM_H
@@ -7,18 +7,28 @@
 #include "asm.h"
 #include "features.h"
 #include "util.h"
+#include "options.h"
+#include "regalloc.h"
+#include "infer.h"
+#include "licm.h"
+#include "simd.h"
+#include "pgo.h"
+#include "slots.h"
 
-static long sd;
-static long tmp_count = 0;
-static long max_tmp_count = 0;
-static long loop_control_vars = 0;
-static long max_loop_control_vars = 0;
+static thread_local long sd;
+static thread_local long tmp_count = 0;
+static thread_local long max_tmp_count = 0;
+// stack offset of the first temporary of the frame
+static thread_local long tmp_base = 0;
+// the line being emitted is in .text.unlikely
+static thread_local bool unlikely = false;
 
 long gosub_depth = 16;
 
 eval_ret asm_promote_numeric(eval_ret ret);
 
 void cast(eval_ret from, eval_ret to);
+static void store_var(std::string_view vn, eval_ret to);
 
 std::vector<std::string_view> iregsL = {
         "%rdi",
@@ -61,20 +71,23 @@ void reset_tmp_count(long v) {
     tmp_count = v;
 }
 
-stack_layout_t pushStack() {
+stack_layout_t pushStack(long base) {
     stack_layout_t st = {
             .sd = sd,
             .tmp_count = tmp_count,
             .max_tmp_count = max_tmp_count,
+            .tmp_base = tmp_base,
     };
     tmp_count = 0;
     max_tmp_count = 0;
+    tmp_base = base;
     return st;
 }
 
 void popStack(stack_layout_t st) {
     tmp_count = st.tmp_count;
     max_tmp_count = st.max_tmp_count;
+    tmp_base = st.tmp_base;
     sd = st.sd;
 }
 
@@ -112,29 +125,55 @@ long add_tmp(type_t type) {
     r = tmp_count;
     tmp_count += s;
     max_tmp_count = std::max(max_tmp_count, tmp_count);
-    return r;
+    return tmp_base + r;
 }
 
-long add_loop_vars() {
-    long r = loop_control_vars;
-    loop_control_vars += 16;
-    max_loop_control_vars = std::max(max_loop_control_vars, loop_control_vars);
-    return r;
+// call frame information, only with --debug
+static void cfi(const std::string &directive) {
+    // the call frame information of main only covers .text
+    if (options.debug && !unlikely) od << "\t" << directive << std::endl;
+}
+
+// frame of proc_start after the prologue
+static void cfi_frame() {
+    cfi(".cfi_def_cfa %rbp, 32");
+    cfi(".cfi_offset %rbp, -16");
+    cfi(".cfi_offset %r12, -24");
+    cfi(".cfi_offset %r13, -32");
+    if (regalloc_used()) {
+        cfi(".cfi_offset %rbx, -40");
+        cfi(".cfi_offset %r14, -48");
+        cfi(".cfi_offset %r15, -56");
+    }
 }
 
 void proc_end() {
+    // STOP and END return from the middle of main
+    cfi(".cfi_remember_state");
     od << "\tmovq %rbp, %rsp" << std::endl;
+    cfi(".cfi_def_cfa_register %rsp");
     od << "\tpopq %r13" << std::endl;
+    cfi(".cfi_def_cfa_offset 24");
     od << "\tpopq %r12" << std::endl;
+    cfi(".cfi_def_cfa_offset 16");
     od << "\tpopq %rbp" << std::endl;
+    cfi(".cfi_def_cfa_offset 8");
     od << "\tretq" << std::endl;
+    cfi(".cfi_restore_state");
 }
 
 void proc_start(bool reserve_gosub) {
     od << "\tpushq %rbp" << std::endl;
+    cfi(".cfi_def_cfa_offset 16");
+    cfi(".cfi_offset %rbp, -16");
     od << "\tpushq %r12" << std::endl;
+    cfi(".cfi_def_cfa_offset 24");
+    cfi(".cfi_offset %r12, -24");
     od << "\tpushq %r13" << std::endl;
+    cfi(".cfi_def_cfa_offset 32");
+    cfi(".cfi_offset %r13, -32");
     od << "\tmovq %rsp, %rbp" << std::endl;
+    cfi(".cfi_def_cfa_register %rbp");
     od << "\tsubq $" << std::to_string(sd) << ", %rsp" << std::endl;
     od << "\tmovq %rsp, %r12" << std::endl;
     od << "\taddq $" << std::to_string(sd - 32 - (reserve_gosub ? gosub_depth * 8 : 0)) << ", %r12" << std::endl;
@@ -145,50 +184,73 @@ void proc_main_start() {
     od << ".section .text" << std::endl;
     od << "main:" << std::endl;
     od << ".global main" << std::endl;
-    sd = 8 + 4 * 8 + gosub_depth * 8 + max_tmp_count + max_loop_control_vars;
+    if (options.debug) od << ".type main, @function" << std::endl;
+    cfi(".cfi_startproc");
+    sd = 8 + 4 * 8 + gosub_depth * 8 + max_tmp_count + loop_slots_size();
     if (sd % 16) {
         sd += 16 - (sd % 16);
     }
     proc_start();
+    // the callee-saved registers of regalloc are kept in the unused top of the frame
+    if (regalloc_used()) {
+        od << "\tmovq %rbx, -8(%rbp)" << std::endl;
+        cfi(".cfi_offset %rbx, -40");
+        od << "\tmovq %r14, -16(%rbp)" << std::endl;
+        cfi(".cfi_offset %r14, -48");
+        od << "\tmovq %r15, -24(%rbp)" << std::endl;
+        cfi(".cfi_offset %r15, -56");
+    }
 }
 
 void proc_main_end(long r) {
     od << "\tmovq $0, %rax" << std::endl;
+    if (regalloc_used()) {
+        od << "\tmovq -8(%rbp), %rbx" << std::endl;
+        od << "\tmovq -16(%rbp), %r14" << std::endl;
+        od << "\tmovq -24(%rbp), %r15" << std::endl;
+    }
     proc_end();
 }
 
+void proc_main_close() {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".size main, .-main" << std::endl;
+}
+
+// DEF functions are emitted inside main, main's unwind info is split around them
+void asm_function_start(const std::string &name) {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".type " << name << ", @function" << std::endl;
+    asm_set_label(name);
+    cfi(".cfi_startproc");
+}
+
+void asm_function_end(const std::string &name) {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".size " << name << ", .-" << name << std::endl;
+    cfi(".cfi_startproc");
+    cfi_frame();
+}
+
+void asm_debug_file(const std::string &path) {
+    od << "\t.file 1 \"";
+    for (auto c: path) {
+        if (c == '"' || c == '\\') od << '\\';
+        od << c;
+    }
+    od << "\"" << std::endl;
+}
+
+void asm_debug_line(long source_line) {
+    od << "\t.loc 1 " << std::to_string(source_line) << std::endl;
+}
+
 void
 asm_data(const std::map<std::string, std::pair<long, long>> &varDims, const std::map<long, std::string> &stringMap,
          const std::vector<std::pair<double, std::string>> &dataItems) {
     od << ".section .data" << std::endl;
     for (auto &[n, d]: varDims) {
-        long s;
-        switch (eval_ret_from_suffix(n.back())) {
-            case NUMBERC:
-                s = 1;
-                break;
-            case NUMBERS:
-                s = 2;
-                break;
-            case NUMBERI:
-                s = 4;
-                break;
-            case NUMBERL:
-                s = 8;
-                break;
-            case NUMBERF:
-                s = 4;
-                break;
-            case NUMBERD:
-                s = 8;
-                break;
-            case STRING:
-                s = 8;
-                break;
-            case NUMBERP:
-                s = 8;
-                break;
-        }
+        long s = eval_ret_size(eval_ret_from_suffix(n.back()));
         od << ".balign " << std::to_string(s) << std::endl;
         od << tr(n) << ":" << std::endl;
         if (d.second && d.first) {
@@ -236,6 +298,70 @@ asm_data(const std::map<std::string, std::pair<long, long>> &varDims, const std:
     od << ".section .note.GNU-stack" << std::endl;
 }
 
+void asm_profile_data(const std::vector<long> &lines, const std::string &file) {
+    od << ".section .data" << std::endl;
+    od << ".balign 8" << std::endl;
+    od << "PROF__begin:" << std::endl;
+    for (auto l: lines) {
+        od << "PROF__" << std::to_string(l) << ":" << std::endl;
+        od << "\t.quad 0" << std::endl;
+    }
+    od << "PROF__end:" << std::endl;
+    od << "PROF__lines:" << std::endl;
+    for (auto l: lines) {
+        od << "\t.quad " << std::to_string(l) << std::endl;
+    }
+    od << "PROF__file:" << std::endl;
+    od << "\t.byte ";
+    for (auto &c: file) {
+        char buf[3];
+        snprintf(buf, 3, "%2x", (unsigned char) c);
+        od << "0x" << buf << ", ";
+    }
+    od << "0x0" << std::endl;
+}
+
+static const char *regalloc_regs[] = {"%rbx", "%r14", "%r15"};
+
+// the x86-64 microarchitecture levels of the psABI. AVX2 and AVX-512 registers are not used, v4 compiles like v3.
+std::optional<unsigned> asm_march(std::string_view name) {
+    if (name == "x86-64") return 0;
+    if (name == "x86-64-v2") return MARCH_SSE4_1;
+    if (name == "x86-64-v3") return MARCH_SSE4_1 | MARCH_AVX2 | MARCH_FMA | MARCH_BMI2;
+    if (name == "x86-64-v4") return MARCH_SSE4_1 | MARCH_AVX2 | MARCH_FMA | MARCH_BMI2 | MARCH_AVX512;
+    return std::nullopt;
+}
+
+long asm_regs_available() {
+    return 3;
+}
+
+void asm_regs_load() {
+    for (size_t i = 0; i < regalloc_current->vars.size(); ++i) {
+        od << "\tmovq " << tr(regalloc_current->vars[i]) << "(%rip), " << regalloc_regs[i] << std::endl;
+    }
+}
+
+void asm_regs_store() {
+    for (size_t i = 0; i < regalloc_current->vars.size(); ++i) {
+        od << "\tmovq " << regalloc_regs[i] << ", " << tr(regalloc_current->vars[i]) << "(%rip)" << std::endl;
+    }
+}
+
+// DEF and external functions read the variables from memory
+static void call_function(const std::string &name) {
+    if (regalloc_current) asm_regs_store();
+    od << "\tcall " << name << std::endl;
+}
+
+// register of a promoted FOR control variable
+static std::optional<long> promoted(struct exp_t *var) {
+    if (var->type != exp_t::V) return std::nullopt;
+    auto *v = reinterpret_cast<val_t *>(var->data);
+    if (v->type != val_t::N) return std::nullopt;
+    return regalloc_reg(v->ns);
+}
+
 void proc_sub_start() {
     sd = 8 + 4 * 8 + max_tmp_count;
     if (sd % 16) {
@@ -262,7 +388,7 @@ long asm_save(eval_ret ret, bool as_reference) {
                 return tmp;
             case NUMBERI:
                 tmp = add_tmp(INT);
-                if (pval) od << "\tmovd %edi, " << std::to_string(tmp) << "(%rsp)" << std::endl;
+                if (pval) od << "\tmovl %edi, " << std::to_string(tmp) << "(%rsp)" << std::endl;
                 return tmp;
             case STRING:
             case NUMBERL:
@@ -282,7 +408,7 @@ long asm_save(eval_ret ret, bool as_reference) {
     }
 }
 
-extern char comma_sig[9];
+extern thread_local char comma_sig[9];
 
 void asm_promote_signature() {
     int i = 0;
@@ -327,17 +453,34 @@ void asm_promote_signature() {
     }
 }
 
+// cvtsi2sd only writes the low half of the register and waits for the instruction that wrote it last, from
+// x86-64-v2 on the register is cleared first (the shorter code is kept for the baseline)
+static void int_to_double(const char *from, const char *to) {
+    if (options.march & MARCH_SSE4_1) od << "\txorpd " << to << ", " << to << std::endl;
+    od << "\tcvtsi2sd " << from << ", " << to << std::endl;
+}
+
 eval_ret asm_eval_cmp_exp(struct exp_t *left, struct exp_t *right, eval_cmp_op op) {
+    infer_literals_t literals(infer_safe(left) && infer_safe(right));
+    // the temporaries of both operands are free again once the left one is loaded
+    auto mark = get_tmp_count();
     if (!pval) {
-        asm_save(eval_val(right, false), false);
+        auto r0 = asm_promote_numeric(eval_val(right, false));
+        reset_tmp_count(mark);
+        asm_save(r0, false);
         eval_val(left, false);
+        reset_tmp_count(mark);
         return NUMBERL;
     }
     auto r0 = eval_val(right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
+    // comisd sets the flags like an unsigned compare
+    bool is_signed = false;
     if (r0 == STRING && r1 == STRING) {
         if (op != EQ && op != NE) throw std::runtime_error("string expressions can only be tested for equality");
         od << "\tmovq " << std::to_string(tmp) << "(%rsp), %rsi" << std::endl;
@@ -348,32 +491,31 @@ eval_ret asm_eval_cmp_exp(struct exp_t *left, struct exp_t *right, eval_cmp_op o
         throw std::runtime_error("string expression expected");
     } else if (r0 == NUMBERL && r1 == NUMBERL) {
         od << "\tmovq " << std::to_string(tmp) << "(%rsp), %rsi" << std::endl;
-        od << "\tsub %rsi, %rdi" << std::endl;
-        goto cmp;
+        od << "\tcmp %rsi, %rdi" << std::endl;
+        is_signed = true;
+        goto cmp0;
     } else if (r0 == NUMBERD && r1 == NUMBERD) {
         od << "\tmovq " << std::to_string(tmp) << "(%rsp), %xmm1" << std::endl;
         goto fcmp;
     } else {
         if (r1 == NUMBERL) {
-            od << "\tcvtsi2sd %rdi, %xmm1" << std::endl;
+            int_to_double("%rdi", "%xmm0");
+            od << "\tmovq " << std::to_string(tmp) << "(%rsp), %xmm1" << std::endl;
         } else {
             assert(r0 == NUMBERL);
             od << "\tmovq " << std::to_string(tmp) << "(%rsp), %rsi" << std::endl;
-            od << "\tcvtsi2sd %rsi, %xmm1" << std::endl;
+            int_to_double("%rsi", "%xmm1");
         }
         fcmp:
         od << "\tcomisd %xmm1, %xmm0" << std::endl;
-        goto cmp0;
-        cmp:
-        od << "\tcmp %rdi, %rsi" << std::endl;
         cmp0:
         od << "\tmovq $0, %rdi" << std::endl;
         switch (op) {
             case LT:
-                od << "\tsetb %dil" << std::endl;
+                od << (is_signed ? "\tsetl %dil" : "\tsetb %dil") << std::endl;
                 break;
             case LE:
-                od << "\tsetbe %dil" << std::endl;
+                od << (is_signed ? "\tsetle %dil" : "\tsetbe %dil") << std::endl;
                 break;
             case EQ:
                 od << "\tsete %dil" << std::endl;
@@ -382,15 +524,14 @@ eval_ret asm_eval_cmp_exp(struct exp_t *left, struct exp_t *right, eval_cmp_op o
                 od << "\tsetne %dil" << std::endl;
                 break;
             case GE:
-                od << "\tsetae %dil" << std::endl;
+                od << (is_signed ? "\tsetge %dil" : "\tsetae %dil") << std::endl;
                 break;
             case GT:
-                od << "\tseta %dil" << std::endl;
+                od << (is_signed ? "\tsetg %dil" : "\tseta %dil") << std::endl;
                 break;
         }
         return NUMBERL;
     }
-    goto cmp;
 }
 
 eval_ret asm_eval_cmp(struct op_t *o, struct op_t *o1, eval_cmp_op op) {
@@ -398,15 +539,25 @@ eval_ret asm_eval_cmp(struct op_t *o, struct op_t *o1, eval_cmp_op op) {
 }
 
 eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool check_fp) {
+    infer_literals_t literals(iop && infer_safe_op(o));
+    auto mark = get_tmp_count();
     if (!pval) {
-        asm_save(eval_val(o->right, false), false);
-        return eval_val(o->left, false);
+        // size the temporaries for the promoted types, like the emitting pass
+        auto r0 = asm_promote_numeric(eval_val(o->right, false));
+        reset_tmp_count(mark);
+        asm_save(r0, false);
+        auto r1 = asm_promote_numeric(eval_val(o->left, false));
+        reset_tmp_count(mark);
+        if (r0 == STRING || r1 == STRING) return r1;
+        return r0 == NUMBERL && r1 == NUMBERL && iop ? NUMBERL : NUMBERD;
     }
     auto r0 = eval_val(o->right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(o->left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
     if (r0 == STRING && r1 == STRING) {
         throw std::runtime_error("invalid OP on strings");
     } else if (r0 == STRING || r1 == STRING) {
@@ -419,12 +570,12 @@ eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool ch
         goto fm;
     } else {
         if (r1 == NUMBERL) {
-            od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
+            int_to_double("%rdi", "%xmm0");
             od << "\tmovq " << std::to_string(tmp) << "(%rsp), %xmm1" << std::endl;
         } else {
             assert(r0 == NUMBERL);
             od << "\tmovq " << std::to_string(tmp) << "(%rsp), %rsi" << std::endl;
-            od << "\tcvtsi2sd %rsi, %xmm1" << std::endl;
+            int_to_double("%rsi", "%xmm1");
         }
         fm:
         od << "\t" << fop << " %xmm1, %xmm0" << std::endl;
@@ -432,27 +583,34 @@ eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool ch
         return NUMBERD;
     }
     m:
-    if (iop) {
+    // integers of --infer-int are only combined as integers where the result is known to fit in 53 bits
+    if (iop && (infer_literals || !(infer_safe(o->left) || infer_safe(o->right)))) {
         od << "\t" << iop << " %rsi, %rdi" << std::endl;
         return NUMBERL;
     } else {
-        od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
-        od << "\tcvtsi2sd %rsi, %xmm1" << std::endl;
+        int_to_double("%rdi", "%xmm0");
+        int_to_double("%rsi", "%xmm1");
         goto fm;
     }
 }
 
 eval_ret asm_eval_power(struct op_t *o) {
+    auto mark = get_tmp_count();
     if (!pval) {
-        add_tmp(DOUBLE);
         eval_val(o->right, false);
-        return eval_val(o->left, false);
+        reset_tmp_count(mark);
+        add_tmp(DOUBLE);
+        eval_val(o->left, false);
+        reset_tmp_count(mark);
+        return NUMBERD;
     }
     auto r0 = eval_val(o->right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(o->left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
     if (r0 == STRING && r1 == STRING) {
         throw std::runtime_error("invalid OP on strings");
     } else if (r0 == STRING || r1 == STRING) {
@@ -478,7 +636,7 @@ eval_ret asm_eval_power(struct op_t *o) {
 }
 
 void asm_process_comma(struct op_t *o) {
-    auto tmp_start = get_tmp_count();
+    auto tmp_start = tmp_base + get_tmp_count();
     struct op_t *r = o;
     memset(comma_sig, 0, 9);
     while (o) {
@@ -488,6 +646,8 @@ void asm_process_comma(struct op_t *o) {
         o = (struct op_t *) o->right->data;
     }
     o = r;
+    // the arguments may leave temporaries of their own behind the head elements
+    auto heads_end = tmp_base + get_tmp_count();
     auto tmp_i = tmp_start;
     int i = 0;
     while (o) {
@@ -520,7 +680,7 @@ void asm_process_comma(struct op_t *o) {
                 break;
             case NUMBERI:
                 if (pval)
-                    od << "\tmovd %edi, " << std::to_string(tmp_i) << "(%rsp)" << std::endl;
+                    od << "\tmovl %edi, " << std::to_string(tmp_i) << "(%rsp)" << std::endl;
                 comma_sig[i++] = 'i';
                 break;
             case NUMBERP:
@@ -571,12 +731,12 @@ void asm_process_comma(struct op_t *o) {
     comma_sig[i] = 0;
     /*
      * a0: last element
-     * tmp_start ... tmp_count - 1: head elements
+     * tmp_start ... heads_end - 1: head elements
      */
     if (pval) {
         int j = 0;
         int k = 0;
-        for (i = 0; i < 1 + (get_tmp_count() - tmp_start) / 8; ++i) {
+        for (i = 0; i < 1 + (heads_end - tmp_start) / 8; ++i) {
             if (comma_sig[i] == 'd') ++j;
             else ++k;
         }
@@ -589,7 +749,7 @@ void asm_process_comma(struct op_t *o) {
         }
         j = 0;
         k = 0;
-        for (i = 0; i < (get_tmp_count() - tmp_start) / 8; ++i) {
+        for (i = 0; i < (heads_end - tmp_start) / 8; ++i) {
             switch (eval_ret_from_comma(comma_sig[i])) {
                 case NUMBERC:
                     od << "\tmovb " << std::to_string(tmp_start + i * 8) << "(%rsp), " << iregsC[k++] << std::endl;
@@ -688,6 +848,119 @@ eval_ret eval_read(eval_ret r, std::string_view loc) {
     return r;
 }
 
+// take the pointer of an array walk that stays inside the array, otherwise fall through to the bounds check.
+// Returns the label after the element address.
+static std::string walk_load(const licm_walk_t &w) {
+    auto slow = line_label();
+    auto done = line_label();
+    od << "\tmovq " << std::to_string(loop_slot(w.slot + 8)) << "(%rsp), %rdi" << std::endl;
+    od << "\tcmp $0, %rdi" << std::endl;
+    od << "\tjl " << slow << std::endl;
+    od << "\tmovq " << std::to_string(loop_slot(w.slot)) << "(%rsp), %rax" << std::endl;
+    od << "\tjmp " << done << std::endl;
+    od << slow << ":" << std::endl;
+    return done;
+}
+
+// RND of math.c: the next output of xoshiro256** on RND__state, its upper 53 bits scaled to [0, 1)
+static void inline_rnd() {
+    // rotate left by k, BMI2 rotates into any register without touching the flags
+    auto rotl = [](const char *r, int k) {
+        if (options.march & MARCH_BMI2) {
+            od << "\trorx $" << std::to_string(64 - k) << ", " << r << ", " << r << std::endl;
+            return;
+        }
+        od << "\tmovq " << r << ", %rdx" << std::endl;
+        od << "\tshlq $" << std::to_string(k) << ", " << r << std::endl;
+        od << "\tshrq $" << std::to_string(64 - k) << ", %rdx" << std::endl;
+        od << "\torq %rdx, " << r << std::endl;
+    };
+    od << "\tleaq RND__state(%rip), %rsi" << std::endl;
+    od << "\tmovq 0(%rsi), %r8" << std::endl;
+    od << "\tmovq 8(%rsi), %r9" << std::endl;
+    od << "\tmovq 16(%rsi), %r10" << std::endl;
+    od << "\tmovq 24(%rsi), %r11" << std::endl;
+    od << "\tleaq (%r9,%r9,4), %rax" << std::endl;
+    rotl("%rax", 7);
+    od << "\tleaq (%rax,%rax,8), %rax" << std::endl;
+    od << "\tmovq %r9, %rcx" << std::endl;
+    od << "\tshlq $17, %rcx" << std::endl;
+    od << "\txorq %r8, %r10" << std::endl;
+    od << "\txorq %r9, %r11" << std::endl;
+    od << "\txorq %r10, %r9" << std::endl;
+    od << "\txorq %r11, %r8" << std::endl;
+    od << "\txorq %rcx, %r10" << std::endl;
+    rotl("%r11", 45);
+    od << "\tmovq %r8, 0(%rsi)" << std::endl;
+    od << "\tmovq %r9, 8(%rsi)" << std::endl;
+    od << "\tmovq %r10, 16(%rsi)" << std::endl;
+    od << "\tmovq %r11, 24(%rsi)" << std::endl;
+    od << "\tshrq $11, %rax" << std::endl;
+    od << "\tcvtsi2sd %rax, %xmm0" << std::endl;
+    od << "\tmovq $0x3ca0000000000000, %rax" << std::endl;
+    od << "\tmovq %rax, %xmm1" << std::endl;
+    od << "\tmulsd %xmm1, %xmm0" << std::endl;
+}
+
+// ABS, INT, SGN and SQR of %xmm0 without calling math.c. SQR only calls SQR__d to report a negative argument.
+static bool inline_math(std::string_view f) {
+    // a call is shorter for lines that never ran
+    if (pgo_cold(line_no)) return false;
+    if (f == "ABS") {
+        od << "\tmovq $0x7fffffffffffffff, %rax" << std::endl;
+        od << "\tmovq %rax, %xmm1" << std::endl;
+        od << "\tandpd %xmm1, %xmm0" << std::endl;
+    } else if (f == "INT" && (options.march & MARCH_SSE4_1)) {
+        // round toward minus infinity without raising the inexact exception
+        od << "\troundsd $9, %xmm0, %xmm0" << std::endl;
+    } else if (f == "INT") {
+        // cvttsd2si truncates, a result above the argument is one too large. The indefinite integer (NaN, beyond
+        // 2^63) leaves the argument alone, as does an exact result (keeps -0).
+        auto done = line_label();
+        auto below = line_label();
+        od << "\tcvttsd2si %xmm0, %rax" << std::endl;
+        od << "\tcmpq $1, %rax" << std::endl;
+        od << "\tjo " << done << std::endl;
+        od << "\tcvtsi2sd %rax, %xmm1" << std::endl;
+        od << "\tucomisd %xmm0, %xmm1" << std::endl;
+        od << "\tje " << done << std::endl;
+        od << "\tjb " << below << std::endl;
+        od << "\tsubq $1, %rax" << std::endl;
+        od << "\tcvtsi2sd %rax, %xmm1" << std::endl;
+        od << below << ":" << std::endl;
+        od << "\tmovapd %xmm1, %xmm0" << std::endl;
+        od << done << ":" << std::endl;
+    } else if (f == "SGN") {
+        auto sign = line_label();
+        auto done = line_label();
+        od << "\txorpd %xmm1, %xmm1" << std::endl;
+        od << "\tucomisd %xmm1, %xmm0" << std::endl;
+        od << "\tjp " << sign << std::endl;
+        od << "\tjne " << sign << std::endl;
+        od << "\tmovapd %xmm1, %xmm0" << std::endl;
+        od << "\tjmp " << done << std::endl;
+        od << sign << ":" << std::endl;
+        od << "\tmovq $0x8000000000000000, %rax" << std::endl;
+        od << "\tmovq %rax, %xmm1" << std::endl;
+        od << "\tandpd %xmm1, %xmm0" << std::endl;
+        od << "\tmovq $0x3ff0000000000000, %rax" << std::endl;
+        od << "\tmovq %rax, %xmm1" << std::endl;
+        od << "\torpd %xmm1, %xmm0" << std::endl;
+        od << done << ":" << std::endl;
+    } else if (f == "SQR") {
+        auto ok = line_label();
+        od << "\txorpd %xmm1, %xmm1" << std::endl;
+        od << "\tucomisd %xmm0, %xmm1" << std::endl;
+        od << "\tjbe " << ok << std::endl;
+        od << "\tcall SQR__d" << std::endl;
+        od << ok << ":" << std::endl;
+        od << "\tsqrtsd %xmm0, %xmm0" << std::endl;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 eval_ret eval_val(struct exp_t *exp, bool as_reference) {
     if (pval) {
         od << "// ";
@@ -695,6 +968,15 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
         od << std::endl;
     }
     skip_val = false;
+    if (!as_reference) {
+        if (!pval) {
+            licm_visit(exp);
+        } else if (auto h = licm_hoisted(exp)) {
+            od << "\tmovq " << std::to_string(loop_slot(h->slot)) << "(%rsp), "
+               << (h->type == NUMBERD ? "%xmm0" : "%rdi") << std::endl;
+            return h->type;
+        }
+    }
     if (!exp) {
         throw std::runtime_error("syntax error");
     } else if (exp->type == exp_t::V) {
@@ -702,9 +984,10 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
         switch (v->type) {
             case val_t::L: {
                 ASSERT(!as_reference);
+                auto r = eval_ret_from_suffix(v->suffix);
+                if (infer_literals && r == NUMBERD) r = NUMBERL;
                 if (pval) {
                     od << "\tmovq $" << std::to_string(v->l) << ", %rdi" << std::endl;
-                    auto r = eval_ret_from_suffix(v->suffix);
                     switch (r) {
                         case NUMBERC:
                         case NUMBERS:
@@ -715,14 +998,14 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                             od << "\tcvtsi2ss %rdi, %xmm0" << std::endl;
                             break;
                         case NUMBERD:
-                            od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
+                            int_to_double("%rdi", "%xmm0");
                             break;
                         case STRING:
                         case NUMBERP:
                             break;
                     }
-                    return r;
-                } else return eval_ret_from_suffix(v->suffix);
+                }
+                return r;
             }
                 break;
             case val_t::F:
@@ -755,28 +1038,30 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     if (current_def && *current_def == v->ns) {
                         throw std::runtime_error("undefined function " + *current_def);
                     }
-                    if (strlen(defns[v->ns].data()) != 0) {
+                    if (strlen(defns.at(v->ns).data()) != 0) {
                         throw std::runtime_error("invalid number of arguments for function " + std::string(v->ns));
                     }
                     if (pval) {
-                        od << "\tcall " << tr(v->ns) << std::endl;
+                        call_function(tr(v->ns));
                     }
                     return to_sb55_abi(eval_ret_from_suffix(v->suffix));
                 } else if (known_funcs.contains(v->ns)) {
-                    if (pval) {
+                    if (pval && std::string_view(v->ns) == "RND" && !pgo_cold(line_no)) {
+                        inline_rnd();
+                    } else if (pval) {
                         od << "\tcall " << tr(v->ns) << std::endl;
-                        if (known_funcs[v->ns] == STRING) {
+                        if (known_funcs.at(v->ns) == STRING) {
                             od << "\tmovq %rax, %rdi" << std::endl;
                             // TODO if ever necessary
                         }
                     }
-                    return known_funcs[v->ns];
+                    return known_funcs.at(v->ns);
                 } else if (promoting_funcs.contains(v->ns)) {
                     throw std::runtime_error("syntax error");
                 } else if (!is_var_name(v->ns)) {
                     if (features.external) {
                         if (pval) {
-                            od << "\tcall " << tr(v->ns) << std::endl;
+                            call_function(tr(v->ns));
                         }
                         return to_sb55_abi(eval_ret_from_suffix(v->suffix));
                     } else {
@@ -787,12 +1072,25 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     auto p = var_dims.at(v->ns);
                     ASSERT(!p.first && !p.second);
                 }
-                var_dims[v->ns] = std::make_pair(0, 0);
+                if (!var_dims.contains(v->ns)) var_dims[v->ns] = std::make_pair(0, 0);
+                regalloc_use(v->ns, as_reference);
+                if (as_reference) {
+                    infer_ref(v->ns);
+                    licm_write(v->ns);
+                }
+                if (auto reg = regalloc_reg(v->ns)) {
+                    auto r = eval_ret_from_var(v->ns);
+                    if (pval) {
+                        ASSERT(!as_reference);
+                        od << "\tmovq " << regalloc_regs[*reg] << (r == NUMBERD ? ", %xmm0" : ", %rdi") << std::endl;
+                    }
+                    return r;
+                }
                 if (as_reference) {
                     if (pval) od << "\tleaq " << tr(v->ns) << "(%rip), %rdi" << std::endl;
-                    return eval_ret_from_suffix(v->suffix);
+                    return eval_ret_from_var(v->ns);
                 } else {
-                    auto r = eval_ret_from_suffix(v->suffix);
+                    auto r = eval_ret_from_var(v->ns);
                     return eval_read(r, tr(v->ns) + "(%rip)");
                 }
             case val_t::S:
@@ -807,7 +1105,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     string_buf[v->ns] = string_ix++;
                 }
                 if (pval)
-                    od << "\tleaq STR__" << std::to_string(string_buf[std::string(v->ns)]) << "(%rip), %rdi"
+                    od << "\tleaq STR__" << std::to_string(string_buf.at(v->ns)) << "(%rip), %rdi"
                        << std::endl;
                 return STRING;
         }
@@ -826,6 +1124,8 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                 long tmp;
                 std::pair<long, long> p;
                 op_t *op;
+                std::optional<licm_walk_t> w;
+                std::string done;
                 if (o->right->type != exp_t::V) {
                     tmp = add_tmp(LONG);
                 }
@@ -845,9 +1145,11 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         p = var_dims[vn] = std::make_pair(10, 0);
                     }
                     if (!pval) {
+                        licm_array(exp);
                         eval_val(o->right, false);
                         return eval_ret_from_suffix(vn.back());
                     }
+                    if ((w = licm_walking(exp))) done = walk_load(*w);
                     switch (eval_val(o->right, false)) {
                         case NUMBERD:
                             od << "cvtsd2si %xmm0, %rdi" << std::endl;
@@ -891,10 +1193,12 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         p = var_dims[vn] = std::make_pair(10, 10);
                     }
                     if (!pval) {
+                        licm_array(exp);
                         eval_val(op->left, false);
                         eval_val(op->right, false);
                         return eval_ret_from_suffix(vn.back());
                     }
+                    if ((w = licm_walking(exp))) done = walk_load(*w);
                     switch (eval_val(op->right, false)) {
                         case NUMBERD:
                             od << "cvtsd2si %xmm0, %rdi" << std::endl;
@@ -940,34 +1244,11 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     od << "\tcall ARRAY__chk_bound2" << std::endl;
                     array_dr:
                     od << "\tleaq " << tr(vn) << "(%rip), %rsi" << std::endl;
-                    od << "\tadd %rsi, %rax" << std::endl;
+                    od << "\tleaq (%rsi,%rax," << std::to_string(eval_ret_size(eval_ret_from_suffix(vn.back())))
+                       << "), %rax" << std::endl;
+                    if (w) od << done << ":" << std::endl;
                     if (!as_reference) {
-                        auto r = eval_ret_from_suffix(vn.back());
-                        switch (r) {
-                            case NUMBERC:
-                                od << "\tmovb 0(%rax), %dil" << std::endl;
-                                break;
-                            case NUMBERS:
-                                od << "\tmovw 0(%rax), %di" << std::endl;
-                                break;
-                            case NUMBERI:
-                                od << "\tmov 0(%rax), %edi" << std::endl;
-                                break;
-                            case NUMBERL:
-                                od << "\tmovq 0(%rax), %rdi" << std::endl;
-                                break;
-                            case NUMBERF:
-                                od << "\tmovd 0(%rax), %xmm0" << std::endl;
-                                break;
-                            case NUMBERD:
-                                od << "\tmovq 0(%rax), %xmm0" << std::endl;
-                                break;
-                            case STRING:
-                            case NUMBERP:
-                                od << "\tmovq 0(%rax), %rdi" << std::endl;
-                                break;
-                        }
-                        return r;
+                        return eval_read(eval_ret_from_suffix(vn.back()), "0(%rax)");
                     }
                     od << "\tmovq %rax, %rdi" << std::endl;
                     return eval_ret_from_suffix(vn.back());
@@ -994,7 +1275,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                             return NUMBERS;
                         case '|':
                             if (pval) {
-                                od << "\tmovd 0(%rdi), %edi" << std::endl;
+                                od << "\tmovl 0(%rdi), %edi" << std::endl;
                             }
                             return NUMBERI;
                         case '&':
@@ -1093,7 +1374,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                             }
                         }
                         asm_promote_signature();
-                        od << "\tcall " << tr(*v) << std::endl;
+                        call_function(tr(*v));
                         return to_sb55_abi(eval_ret_from_suffix(v->back()));
                     } else if (promoting_funcs.contains(*v)) {
                         if (strlen(comma_sig) != 1) {
@@ -1102,18 +1383,18 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         if (NUMBERD != asm_promote(eval_ret_from_comma(comma_sig[0]))) {
                             throw std::runtime_error("invalid cast");
                         }
-                        od << "\tcall " << tr(*v) << "__d" << std::endl;
+                        if (!inline_math(*v)) od << "\tcall " << tr(*v) << "__d" << std::endl;
                     } else if (v->size() == 3 && (*v)[0] == 'F' && (*v)[1] == 'N') {
                         if (features.external) {
                             asm_promote_signature();
-                            od << "\tcall " << tr(*v) << "__" << comma_sig << std::endl;
+                            call_function(tr(*v) + "__" + comma_sig);
                             return to_sb55_abi(eval_ret_from_suffix(v->back()));
                         } else {
                             throw std::runtime_error("undefined function " + std::string(*v));
                         }
                     } else {
-                        if (comma_sig[0]) od << "\tcall " << tr(*v) << "__" << comma_sig << std::endl;
-                        else od << "\tcall " << tr(*v) << std::endl;
+                        if (comma_sig[0]) call_function(tr(*v) + "__" + comma_sig);
+                        else call_function(tr(*v));
                     }
                 } else {
                     if (v->size() == 3 && (*v)[0] == 'F' && (*v)[1] == 'N') {
@@ -1123,7 +1404,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     }
                 }
                 if (known_funcs.contains(*v)) {
-                    return known_funcs[*v];
+                    return known_funcs.at(*v);
                 }
                 return to_sb55_abi(eval_ret_from_suffix(v->back()));
             }
@@ -1179,7 +1460,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     case NUMBERP:
                         throw std::runtime_error("invalid OP");
                     case NUMBERF:
-                        od << "\tmovd $0, %edi" << std::endl;
+                        od << "\tmovl $0, %edi" << std::endl;
                         od << "\tmovd %edi, %xmm1" << std::endl;
                         od << "\tsubss %xmm0, %xmm1" << std::endl;
                         od << "\tmovd %xmm1, %xmm0" << std::endl;
@@ -1196,7 +1477,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
     }
 }
 
-void proc_sub_store_args(const std::vector<std::string> &arg_names) {
+void proc_sub_store_args(std::span<const std::string> arg_names) {
     int ix = 0;
     int fx = 0;
     for (auto &f: arg_names) {
@@ -1261,7 +1542,7 @@ eval_ret asm_promote_numeric(eval_ret ret) {
             return ret;
             break;
         case NUMBERF:
-            od << "cvtss2sd %xmm0, %xmm0" << std::endl;
+            if (pval) od << "cvtss2sd %xmm0, %xmm0" << std::endl;
             return NUMBERD;
     }
 }
@@ -1272,14 +1553,14 @@ eval_ret asm_promote(eval_ret ret) {
         case NUMBERS:
         case NUMBERI:
         case NUMBERL:
-            od << "cvtsi2sd %rdi, %xmm0" << std::endl;
+            int_to_double("%rdi", "%xmm0");
         case NUMBERD:
             return NUMBERD;
         case NUMBERP:
         case STRING:
             return ret;
         case NUMBERF:
-            od << "cvtss2sd %xmm0, %xmm0" << std::endl;
+            if (pval) od << "cvtss2sd %xmm0, %xmm0" << std::endl;
             return NUMBERD;
     }
 }
@@ -1289,19 +1570,82 @@ void asm_jump_label(const std::string &label) {
 }
 
 void asm_set_label(const std::string &label) {
+    if (line_copy && label.starts_with(".L")) return;
     od << label << ":" << std::endl;
+    if (options.profile && label.starts_with(".L")) asm_profile_count(std::stol(label.substr(2)));
+}
+
+// copies of a loop body per limit test
+long asm_unroll_factor() {
+    return 4;
+}
+
+void asm_profile_start() {
+    od << "\tleaq PROF__begin(%rip), %rdi" << std::endl;
+    od << "\tleaq PROF__end(%rip), %rsi" << std::endl;
+    od << "\tleaq PROF__lines(%rip), %rdx" << std::endl;
+    od << "\tleaq PROF__file(%rip), %rcx" << std::endl;
+    od << "\tcall PROFILE__start" << std::endl;
+}
+
+void asm_rnd_seed(unsigned long seed) {
+    od << "\tmovq $" << std::to_string(static_cast<long>(seed)) << ", %rdi" << std::endl;
+    od << "\tcall RND__seed" << std::endl;
+}
+
+void asm_section(bool cold) {
+    od << (cold ? ".section .text.unlikely,\"ax\",@progbits" : ".section .text") << std::endl;
+    unlikely = cold;
+}
+
+// the call of a runtime error function (which does not return) is taken by branch and moved to .text.unlikely,
+// the other way falls through. In a cold line it stays in place.
+static void error_branch(const std::string &branch, const std::string &inverse, const std::string &f) {
+    auto tl = line_label();
+    if (unlikely) {
+        od << "\t" << inverse << tl << std::endl;
+        od << "\tcall " << f << std::endl;
+        od << tl << ":" << std::endl;
+        return;
+    }
+    od << "\t" << branch << tl << std::endl;
+    asm_section(true);
+    od << tl << ":" << std::endl;
+    od << "\tcall " << f << std::endl;
+    asm_section(false);
+}
+
+void asm_profile_count(long line) {
+    od << "\tincq PROF__" << std::to_string(line) << "(%rip)" << std::endl;
 }
 
 void asm_if_jump(long d) {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
+    auto tl = line_label();
     od << "movq $0, %rax" << std::endl;
     od << "cmp %rdi, %rax" << std::endl;
     od << "je " << tl << std::endl;
+    if (regalloc_leaves(d)) asm_regs_store();
     od << "jmp .L" << std::to_string(d) << std::endl;
     od << tl << ":" << std::endl;
 }
 
 void asm_for_step(struct exp_t *exp, long step_var) {
+    if (auto vn = is_simple_var(exp); vn && infer_int(*vn)) {
+        eval_val(exp, false);
+        od << "\tmovq " << std::to_string(loop_slot(step_var)) << "(%rsp), %rsi" << std::endl;
+        od << "\tadd %rsi, %rdi" << std::endl;
+        store_var(*vn, NUMBERL);
+        return;
+    }
+    if (auto reg = promoted(exp)) {
+        auto r = eval_val(exp, false);
+        cast(r, NUMBERD);
+        od << "\tmovq " << std::to_string(loop_slot(step_var)) << "(%rsp), %xmm1" << std::endl;
+        od << "\taddsd %xmm1, %xmm0" << std::endl;
+        cast(NUMBERD, r);
+        od << "\tmovq " << (r == NUMBERD ? "%xmm0, " : "%rdi, ") << regalloc_regs[*reg] << std::endl;
+        return;
+    }
     bool is_l = false;
     switch (eval_val(exp, true)) {
         case NUMBERC:
@@ -1324,7 +1668,7 @@ void asm_for_step(struct exp_t *exp, long step_var) {
     } else {
         od << "movq 0(%rdi), %xmm0" << std::endl;
     }
-    od << "\tmovq " << std::to_string(get_max_tmp_count() + step_var) << "(%rsp), %xmm1" << std::endl;
+    od << "\tmovq " << std::to_string(loop_slot(step_var)) << "(%rsp), %xmm1" << std::endl;
     od << "\taddsd %xmm1, %xmm0" << std::endl;
     if (is_l) {
         od << "cvtsd2si %xmm0, %rsi" << std::endl;
@@ -1350,7 +1694,7 @@ void cast(eval_ret from, eval_ret to) {
                     od << "\tcvtsi2ss %edi, %xmm0" << std::endl;
                     break;
                 case NUMBERD:
-                    od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
+                    int_to_double("%rdi", "%xmm0");
                     break;
                 case STRING:
                 case NUMBERP:
@@ -1411,11 +1755,11 @@ void cast(eval_ret from, eval_ret to) {
     }
 }
 
-void asm_assign_simple(struct exp_t *exp, std::string_view vn) {
-    auto r = eval_val(exp, false);
-    auto to = eval_ret_from_suffix(vn.back());
-    if (r != to) {
-        cast(r, to);
+// store %rdi/%xmm0 of type to in a scalar variable
+static void store_var(std::string_view vn, eval_ret to) {
+    if (auto reg = regalloc_reg(vn)) {
+        od << "\tmovq " << (to == NUMBERD ? "%xmm0, " : "%rdi, ") << regalloc_regs[*reg] << std::endl;
+        return;
     }
     switch (to) {
         case NUMBERC:
@@ -1443,6 +1787,16 @@ void asm_assign_simple(struct exp_t *exp, std::string_view vn) {
     }
 }
 
+void asm_assign_simple(struct exp_t *exp, std::string_view vn) {
+    infer_literals_t literals(infer_safe(exp));
+    auto r = eval_val(exp, false);
+    auto to = eval_ret_from_var(vn);
+    if (r != to) {
+        cast(r, to);
+    }
+    store_var(vn, to);
+}
+
 void asm_read_tmp(eval_ret t, long tmp) {
     switch (t) {
         case NUMBERC:
@@ -1452,7 +1806,7 @@ void asm_read_tmp(eval_ret t, long tmp) {
             od << "movw " << std::to_string(tmp) << "(%rsp), %di" << std::endl;
             break;
         case NUMBERI:
-            od << "movd " << std::to_string(tmp) << "(%rsp), %edi" << std::endl;
+            od << "movl " << std::to_string(tmp) << "(%rsp), %edi" << std::endl;
             break;
         case STRING:
         case NUMBERP:
@@ -1483,7 +1837,7 @@ eval_ret asm_assign_complex(struct exp_t *var, eval_ret val, long val_tmp) {
             od << "movw %di, 0(%rsi)" << std::endl;
             break;
         case NUMBERI:
-            od << "movd %edi, 0(%rsi)" << std::endl;
+            od << "movl %edi, 0(%rsi)" << std::endl;
             break;
         case STRING:
         case NUMBERP:
@@ -1500,7 +1854,7 @@ eval_ret asm_assign_complex(struct exp_t *var, eval_ret val, long val_tmp) {
     return to;
 }
 
-void asm_print(const std::vector<std::variant<char, exp_t *>> &items) {
+void asm_print(std::span<const std::variant<char, exp_t *>> items) {
     for (auto &i: items) {
         if (auto *c = std::get_if<char>(&i)) {
             if (*c == ',') {
@@ -1545,9 +1899,24 @@ void asm_print(const std::vector<std::variant<char, exp_t *>> &items) {
 }
 
 void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step, long lv0, long lv1) {
+    if (auto vn = is_simple_var(var); vn && infer_int(*vn)) {
+        // an inferred control variable has an integer limit and step
+        infer_literals_t literals(true);
+        cast(eval_val(limit, false), NUMBERL);
+        od << "\tmovq %rdi, " << std::to_string(loop_slot(lv0)) << "(%rsp)" << std::endl;
+        if (step) {
+            cast(eval_val(step, false), NUMBERL);
+        } else {
+            od << "\tmovq $1, %rdi" << std::endl;
+        }
+        od << "\tmovq %rdi, " << std::to_string(loop_slot(lv1)) << "(%rsp)" << std::endl;
+        cast(eval_val(init, false), NUMBERL);
+        store_var(*vn, NUMBERL);
+        return;
+    }
     // set limit var
     cast(eval_val(limit, false), NUMBERD);
-    od << "\tmovq %xmm0, " << std::to_string(get_max_tmp_count() + lv0) << "(%rsp)" << std::endl;
+    od << "\tmovq %xmm0, " << std::to_string(loop_slot(lv0)) << "(%rsp)" << std::endl;
     // set increment var
     if (step) {
         cast(eval_val(step, false), NUMBERD);
@@ -1555,12 +1924,16 @@ void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, st
         od << "movq $1, %rdi" << std::endl;
         od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
     }
-    od << "\tmovq %xmm0, " << std::to_string(get_max_tmp_count() + lv1) << "(%rsp)" << std::endl;
+    od << "\tmovq %xmm0, " << std::to_string(loop_slot(lv1)) << "(%rsp)" << std::endl;
     // set var to init
     pval = false;
     auto to = eval_val(var, true);
     pval = true;
     cast(eval_val(init, false), to);
+    if (auto reg = promoted(var)) {
+        od << "\tmovq " << (to == NUMBERD ? "%xmm0, " : "%rdi, ") << regalloc_regs[*reg] << std::endl;
+        return;
+    }
     auto tmp = asm_save(to, false);
     switch (asm_assign_complex(var, to, tmp)) {
         case NUMBERC:
@@ -1577,10 +1950,247 @@ void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, st
     }
 }
 
+void asm_hoist(struct exp_t *exp, eval_ret type, long slot) {
+    cast(eval_val(exp, false), type);
+    od << "\tmovq " << (type == NUMBERD ? "%xmm0, " : "%rdi, ") << std::to_string(loop_slot(slot))
+       << "(%rsp)" << std::endl;
+}
+
+void asm_walk_init(const licm_walk_t &w, long lv0) {
+    auto *o = reinterpret_cast<op_t *>(w.exp->data);
+    auto vn = std::string(*is_name(o->left));
+    auto [my, mx] = var_dims.at(vn);
+    auto t0 = add_tmp(LONG);
+    auto t1 = add_tmp(LONG);
+    // indices are counted from OPTION BASE
+    auto add = [](long c) {
+        if (c) od << "\tadd $" << std::to_string(c) << ", %rdi" << std::endl;
+    };
+    if (w.fixed) {
+        cast(eval_val(w.fixed, false), NUMBERL);
+        add(-option_base);
+        od << "\tmovq %rdi, " << std::to_string(t0) << "(%rsp)" << std::endl;
+    }
+    // the walk goes from the control variable to the limit
+    cast(eval_val(w.var, false), NUMBERL);
+    add(w.offset - option_base);
+    od << "\tmovq %rdi, " << std::to_string(t1) << "(%rsp)" << std::endl;
+    if (infer_int(*is_simple_var(w.var))) {
+        od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %rdi" << std::endl;
+    } else {
+        od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %xmm0" << std::endl;
+        cast(NUMBERD, NUMBERL);
+    }
+    add(w.offset - option_base);
+    if (!w.fixed) {
+        od << "\tmovq %rdi, %rsi" << std::endl;
+        od << "\tmovq " << std::to_string(t1) << "(%rsp), %rdi" << std::endl;
+        od << "\tmovq $" << std::to_string(my - option_base) << ", %rdx" << std::endl;
+        od << "\tcall ARRAY__walk1" << std::endl;
+    } else {
+        if (w.first) {
+            od << "\tmovq %rdi, %rdx" << std::endl;
+            od << "\tmovq " << std::to_string(t1) << "(%rsp), %rdi" << std::endl;
+            od << "\tmovq " << std::to_string(t0) << "(%rsp), %rsi" << std::endl;
+            od << "\tmovq " << std::to_string(t0) << "(%rsp), %rcx" << std::endl;
+        } else {
+            od << "\tmovq %rdi, %rcx" << std::endl;
+            od << "\tmovq " << std::to_string(t0) << "(%rsp), %rdi" << std::endl;
+            od << "\tmovq " << std::to_string(t1) << "(%rsp), %rsi" << std::endl;
+            od << "\tmovq " << std::to_string(t0) << "(%rsp), %rdx" << std::endl;
+        }
+        od << "\tmovq $" << std::to_string(my - option_base) << ", %r8" << std::endl;
+        od << "\tmovq $" << std::to_string(mx - option_base) << ", %r9" << std::endl;
+        od << "\tcall ARRAY__walk2" << std::endl;
+    }
+    od << "\tmovq %rax, " << std::to_string(loop_slot(w.slot + 8)) << "(%rsp)" << std::endl;
+    od << "\tleaq " << tr(vn) << "(%rip), %rsi" << std::endl;
+    od << "\tleaq (%rsi,%rax," << std::to_string(eval_ret_size(eval_ret_from_suffix(vn.back()))) << "), %rax"
+       << std::endl;
+    od << "\tmovq %rax, " << std::to_string(loop_slot(w.slot)) << "(%rsp)" << std::endl;
+}
+
+void asm_walk_step(const licm_walk_t &w) {
+    od << "\tmovq " << std::to_string(loop_slot(w.slot)) << "(%rsp), %rax" << std::endl;
+    od << "\tmovq $" << std::to_string(w.stride) << ", %rsi" << std::endl;
+    od << "\tadd %rsi, %rax" << std::endl;
+    od << "\tmovq %rax, " << std::to_string(loop_slot(w.slot)) << "(%rsp)" << std::endl;
+}
+
+static std::string xmm(long r) {
+    return "%xmm" + std::to_string(r);
+}
+
+// compute exp for the elements at %rsi and %rsi + 1 into %xmm<d>, the invariants are in the registers from %xmm15 down
+static void simd_eval(const simd_loop_t &s, struct exp_t *exp, long d, const std::map<std::string, const char *> &bases) {
+    if (auto it = std::find(s.invariants.cbegin(), s.invariants.cend(), exp); it != s.invariants.cend()) {
+        od << "\tmovapd " << xmm(15 - (it - s.invariants.cbegin())) << ", " << xmm(d) << std::endl;
+        return;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op == ':' && o->left) {
+        auto vn = std::string(*is_name(o->left));
+        od << "\tmovupd " << std::to_string(*licm_index(o->right, line_no) * 8) << "(" << bases.at(vn) << ",%rsi,8), "
+           << xmm(d) << std::endl;
+        return;
+    }
+    if (!o->left) {
+        simd_eval(s, o->right, d, bases);
+        if (o->op == '-') {
+            // 0 - x like the scalar code
+            od << "\txorpd " << xmm(d + 1) << ", " << xmm(d + 1) << std::endl;
+            od << "\tsubpd " << xmm(d) << ", " << xmm(d + 1) << std::endl;
+            od << "\tmovapd " << xmm(d + 1) << ", " << xmm(d) << std::endl;
+        }
+        return;
+    }
+    simd_eval(s, o->left, d, bases);
+    auto r = xmm(d + 1);
+    if (auto it = std::find(s.invariants.cbegin(), s.invariants.cend(), o->right); it != s.invariants.cend()) {
+        r = xmm(15 - (it - s.invariants.cbegin()));
+    } else {
+        simd_eval(s, o->right, d + 1, bases);
+    }
+    od << "\t" << (o->op == '+' ? "addpd " : o->op == '-' ? "subpd " : "mulpd ") << r << ", " << xmm(d) << std::endl;
+}
+
+void asm_simd(const simd_loop_t &s, struct exp_t *var, long lv0) {
+    static const char *regs[] = {"%rax", "%rcx", "%rdx", "%r8", "%r9", "%r10", "%r11"};
+    auto vn = *is_simple_var(var);
+    auto skip = line_label();
+    auto top = line_label();
+    auto out = line_label();
+    auto ts = add_tmp(LONG);
+    auto te = add_tmp(LONG);
+    auto tn = s.value && !s.func.empty() ? add_tmp(LONG) : 0;
+    std::vector<long> ti;
+    for (size_t i = 0; i < s.invariants.size(); ++i) {
+        ti.push_back(add_tmp(DOUBLE));
+    }
+    for (size_t i = 0; i < s.invariants.size(); ++i) {
+        cast(eval_val(s.invariants[i], false), NUMBERD);
+        od << "\tmovq %xmm0, " << std::to_string(ti[i]) << "(%rsp)" << std::endl;
+    }
+    // the control variable is an integer, the last iteration is at the limit rounded down
+    cast(eval_val(var, false), NUMBERL);
+    od << "\tmovq %rdi, " << std::to_string(ts) << "(%rsp)" << std::endl;
+    if (infer_int(vn)) {
+        od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %rdi" << std::endl;
+    } else {
+        auto l = line_label();
+        od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %xmm0" << std::endl;
+        od << "\tcvtsd2si %xmm0, %rdi" << std::endl;
+        od << "\tcvtsi2sd %rdi, %xmm1" << std::endl;
+        od << "\tcomisd %xmm0, %xmm1" << std::endl;
+        od << "\tjbe " << l << std::endl;
+        od << "\tsub $1, %rdi" << std::endl;
+        od << l << ":" << std::endl;
+    }
+    od << "\tmovq %rdi, " << std::to_string(te) << "(%rsp)" << std::endl;
+    // the loop runs on its own if it leaves an array
+    std::set<std::pair<std::string, long>> checked;
+    for (auto &e: s.elements) {
+        if (!checked.insert(e).second) continue;
+        od << "\tmovq " << std::to_string(ts) << "(%rsp), %rdi" << std::endl;
+        od << "\tadd $" << std::to_string(e.second - option_base) << ", %rdi" << std::endl;
+        od << "\tmovq " << std::to_string(te) << "(%rsp), %rsi" << std::endl;
+        od << "\tadd $" << std::to_string(e.second - option_base) << ", %rsi" << std::endl;
+        od << "\tmovq $" << std::to_string(var_dims.at(e.first).first - option_base) << ", %rdx" << std::endl;
+        od << "\tcall ARRAY__walk1" << std::endl;
+        od << "\tcmp $0, %rax" << std::endl;
+        od << "\tjl " << skip << std::endl;
+    }
+    auto *t = reinterpret_cast<op_t *>(s.target->data);
+    if (!s.value) {
+        // RND of every iteration at once, the loop ends at its first test
+        od << "\tmovq " << std::to_string(ts) << "(%rsp), %rax" << std::endl;
+        od << "\tmovq " << std::to_string(te) << "(%rsp), %rsi" << std::endl;
+        od << "\tsub %rax, %rsi" << std::endl;
+        od << "\tadd $1, %rsi" << std::endl;
+        od << "\tcmp $0, %rsi" << std::endl;
+        od << "\tjle " << skip << std::endl;
+        od << "\tadd $" << std::to_string(-option_base) << ", %rax" << std::endl;
+        od << "\tleaq " << tr(*is_name(t->left)) << "(%rip), %rdi" << std::endl;
+        od << "\tleaq " << std::to_string(s.elements.front().second * 8) << "(%rdi,%rax,8), %rdi" << std::endl;
+        od << "\tcall RND__fill" << std::endl;
+        od << "\tmovq " << std::to_string(te) << "(%rsp), %rdi" << std::endl;
+        od << "\tadd $1, %rdi" << std::endl;
+        if (infer_int(vn)) {
+            store_var(vn, NUMBERL);
+        } else {
+            od << "\tcvtsi2sd %rdi, %xmm0" << std::endl;
+            store_var(vn, NUMBERD);
+        }
+        od << skip << ":" << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < s.invariants.size(); ++i) {
+        od << "\tmovq " << std::to_string(ti[i]) << "(%rsp), " << xmm(15 - i) << std::endl;
+        od << "\tunpcklpd " << xmm(15 - i) << ", " << xmm(15 - i) << std::endl;
+    }
+    std::map<std::string, const char *> bases;
+    for (size_t i = 0; i < s.arrays.size(); ++i) {
+        bases[s.arrays[i]] = regs[i];
+        od << "\tleaq " << tr(s.arrays[i]) << "(%rip), " << regs[i] << std::endl;
+    }
+    // %rsi is the element of the control variable, %rdi the one of the last iteration
+    od << "\tmovq " << std::to_string(ts) << "(%rsp), %rsi" << std::endl;
+    od << "\tadd $" << std::to_string(-option_base) << ", %rsi" << std::endl;
+    od << "\tmovq " << std::to_string(te) << "(%rsp), %rdi" << std::endl;
+    od << "\tadd $" << std::to_string(-option_base) << ", %rdi" << std::endl;
+    od << top << ":" << std::endl;
+    od << "\tcmp %rdi, %rsi" << std::endl;
+    od << "\tjge " << out << std::endl;
+    simd_eval(s, s.value, 0, bases);
+    od << "\tmovupd %xmm0, " << std::to_string(s.elements.front().second * 8) << "("
+       << bases.at(std::string(*is_name(t->left))) << ",%rsi,8)" << std::endl;
+    od << "\tadd $2, %rsi" << std::endl;
+    od << "\tjmp " << top << std::endl;
+    od << out << ":" << std::endl;
+    if (s.value && !s.func.empty()) {
+        // the pairs stored the arguments, from the element of the control variable up to %rsi
+        od << "\tmovq %rsi, " << std::to_string(tn) << "(%rsp)" << std::endl;
+        od << "\tmovq " << std::to_string(ts) << "(%rsp), %rax" << std::endl;
+        od << "\tadd $" << std::to_string(-option_base) << ", %rax" << std::endl;
+        od << "\tmovq %rsi, %rdx" << std::endl;
+        od << "\tsub %rax, %rdx" << std::endl;
+        od << "\tleaq " << tr(*is_name(t->left)) << "(%rip), %rdi" << std::endl;
+        od << "\tleaq " << std::to_string(s.elements.front().second * 8) << "(%rdi,%rax,8), %rdi" << std::endl;
+        od << "\tmovq %rdi, %rsi" << std::endl;
+        // the FMA3 build of the FASTMATH kernels fuses the steps of their polynomials
+        auto kernels = !features.fastmath ? "__v" : options.march & MARCH_FMA ? "__vfma" : "__vfast";
+        od << "\tcall " << s.func << kernels << std::endl;
+        od << "\tmovq " << std::to_string(tn) << "(%rsp), %rsi" << std::endl;
+    }
+    // the loop goes on with the first iteration left
+    od << "\tadd $" << std::to_string(option_base) << ", %rsi" << std::endl;
+    if (infer_int(vn)) {
+        od << "\tmovq %rsi, %rdi" << std::endl;
+        store_var(vn, NUMBERL);
+    } else {
+        od << "\tcvtsi2sd %rsi, %xmm0" << std::endl;
+        store_var(vn, NUMBERD);
+    }
+    od << skip << ":" << std::endl;
+}
+
 void asm_for_cond(struct exp_t *var, long lv0, long lv1, const std::string &end) {
+    if (auto vn = is_simple_var(var); vn && infer_int(*vn)) {
+        eval_val(var, false);
+        od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %rsi" << std::endl;
+        od << "\tsub %rsi, %rdi" << std::endl;
+        // negate the distance to the limit if the step is negative
+        od << "\tmovq " << std::to_string(loop_slot(lv1)) << "(%rsp), %rax" << std::endl;
+        od << "\tsar $63, %rax" << std::endl;
+        od << "\txor %rax, %rdi" << std::endl;
+        od << "\tsub %rax, %rdi" << std::endl;
+        od << "\tcmp $0, %rdi" << std::endl;
+        od << "\tjg " << end << std::endl;
+        return;
+    }
     cast(eval_val(var, false), NUMBERD);
-    od << "\tmovq " << std::to_string(get_max_tmp_count() + lv0) << "(%rsp), %xmm1" << std::endl;
-    od << "\tmovq " << std::to_string(get_max_tmp_count() + lv1) << "(%rsp), %xmm2" << std::endl;
+    od << "\tmovq " << std::to_string(loop_slot(lv0)) << "(%rsp), %xmm1" << std::endl;
+    od << "\tmovq " << std::to_string(loop_slot(lv1)) << "(%rsp), %xmm2" << std::endl;
     od << "\tsubsd %xmm1, %xmm0" << std::endl;
 
     od << "\tmovq $1, %rdi" << std::endl;
@@ -1600,7 +2210,7 @@ void asm_for_cond(struct exp_t *var, long lv0, long lv1, const std::string &end)
     od << "\tja " << end << std::endl;
 }
 
-void asm_read(const std::vector<exp_t *> &items) {
+void asm_read(std::span<exp_t *const> items) {
     for (auto &i: items) {
         switch (eval_val(i, true)) {
             case NUMBERL:
@@ -1631,7 +2241,7 @@ void asm_read(const std::vector<exp_t *> &items) {
     }
 }
 
-void asm_input(const std::vector<exp_t *> &items, const std::string &start) {
+void asm_input(std::span<exp_t *const> items, const std::string &start) {
     od << "\tcall INPUT__start" << std::endl;
     std::vector<eval_ret> rt{};
     std::vector<std::pair<eval_ret, long>> tmps{};
@@ -1670,7 +2280,7 @@ void asm_input(const std::vector<exp_t *> &items, const std::string &start) {
             case NUMBERI:
                 tmps.emplace_back(r, add_tmp(INT));
                 od << "\tcall INPUT__numberi" << std::endl;
-                od << "\tmovd %eax, " << std::to_string(tmps[i].second) << "(%rsp)" << std::endl;
+                od << "\tmovl %eax, " << std::to_string(tmps[i].second) << "(%rsp)" << std::endl;
                 break;
             case NUMBERF:
                 tmps.emplace_back(r, add_tmp(FLOAT));
@@ -1694,8 +2304,9 @@ void asm_input(const std::vector<exp_t *> &items, const std::string &start) {
     od << "\tcall INPUT__end" << std::endl;
 }
 
-void asm_on_goto(exp_t *v, const std::vector<long> &items) {
+void asm_on_goto(exp_t *v, std::span<const long> items) {
     asm_demote(eval_val(v, false));
+    if (std::any_of(items.begin(), items.end(), regalloc_leaves)) asm_regs_store();
     int ix = 1;
     for (auto el: items) {
         if (auto o = line_in_for(el)) {
@@ -1707,19 +2318,24 @@ void asm_on_goto(exp_t *v, const std::vector<long> &items) {
         od << "\tcmp %rdi, %rsi" << std::endl;
         od << "\tje .L" << std::to_string(el) << std::endl;
     }
+    auto tl = line_label();
+    bool moved = !unlikely;
+    if (moved) {
+        od << "\tjmp " << tl << std::endl;
+        asm_section(true);
+    }
+    od << tl << ":" << std::endl;
     od << "\tmovq $" << std::to_string(items.size()) << ", %rsi" << std::endl;
     od << "\tmovq $" << std::to_string(line_no) << ", %rdx" << std::endl;
     od << "\tcall ONGOTO__err_notfound" << std::endl;
+    if (moved) asm_section(false);
 }
 
 void asm_gosub(long d) {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
-    auto tl1 = std::string(".T") + std::to_string(tmp_labels++);
+    auto tl1 = line_label();
     od << "\tmovq $" << std::to_string(gosub_depth) << ", %rdi" << std::endl;
     od << "\tcmp %r13, %rdi" << std::endl;
-    od << "\tjne " << tl << std::endl;
-    od << "\tcall GOSUB__err_overflow" << std::endl;
-    od << tl << ":" << std::endl;
+    error_branch("je ", "jne ", "GOSUB__err_overflow");
     od << "\tleaq " << tl1 << "(%rip), %rdi" << std::endl;
     od << "\tmovq %rdi, 0(%r12)" << std::endl;
     od << "\tadd $8, %r12" << std::endl;
@@ -1729,12 +2345,9 @@ void asm_gosub(long d) {
 }
 
 void asm_return() {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
     od << "\tmovq $0, %rdi" << std::endl;
     od << "\tcmp %r13, %rdi" << std::endl;
-    od << "\tjne " << tl << std::endl;
-    od << "\tcall GOSUB__err_underflow" << std::endl;
-    od << tl << ":" << std::endl;
+    error_branch("je ", "jne ", "GOSUB__err_underflow");
     od << "\tsub $8, %r12" << std::endl;
     od << "\tsub $1, %r13" << std::endl;
     od << "\tmovq 0(%r12), %rdi" << std::endl;
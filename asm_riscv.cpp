@@ -4,38 +4,52 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <bit>
 #include "asm.h"
 #include "features.h"
 #include "util.h"
+#include "options.h"
+#include "regalloc.h"
+#include "infer.h"
+#include "licm.h"
+#include "simd.h"
+#include "pgo.h"
+#include "slots.h"
 
-static long sd;
-static long tmp_count = 0;
-static long max_tmp_count = 0;
-static long loop_control_vars = 0;
-static long max_loop_control_vars = 0;
+static thread_local long sd;
+static thread_local long tmp_count = 0;
+static thread_local long max_tmp_count = 0;
+// stack offset of the first temporary of the frame
+static thread_local long tmp_base = 0;
+// the line being emitted is in .text.unlikely
+static thread_local bool unlikely = false;
 
 long gosub_depth = 16;
 
 void cast(eval_ret from, eval_ret to);
+static void store_var(std::string_view vn, eval_ret to);
 
 void reset_tmp_count(long v) {
     tmp_count = v;
 }
 
-stack_layout_t pushStack() {
+stack_layout_t pushStack(long base) {
     stack_layout_t st = {
             .sd = sd,
             .tmp_count = tmp_count,
             .max_tmp_count = max_tmp_count,
+            .tmp_base = tmp_base,
     };
     tmp_count = 0;
     max_tmp_count = 0;
+    tmp_base = base;
     return st;
 }
 
 void popStack(stack_layout_t st) {
     tmp_count = st.tmp_count;
     max_tmp_count = st.max_tmp_count;
+    tmp_base = st.tmp_base;
     sd = st.sd;
 }
 
@@ -73,23 +87,52 @@ long add_tmp(type_t type) {
     r = tmp_count;
     tmp_count += s;
     max_tmp_count = std::max(max_tmp_count, tmp_count);
-    return r;
+    return tmp_base + r;
 }
 
-long add_loop_vars() {
-    long r = loop_control_vars;
-    loop_control_vars += 16;
-    max_loop_control_vars = std::max(max_loop_control_vars, loop_control_vars);
-    return r;
+// call frame information, only with --debug
+static void cfi(const std::string &directive) {
+    // the call frame information of main only covers .text
+    if (options.debug && !unlikely) od << "\t" << directive << std::endl;
+}
+
+static const char *regalloc_regs[] = {"s3", "s4", "s5"};
+
+// main keeps the callee-saved registers of regalloc below the GOSUB stack, at this offset from fp
+static long regs_slot(long i) {
+    return -32 - gosub_depth * 8 - 8 * (i + 1);
+}
+
+static void regs_cfi() {
+    for (long i = 0; i < 3; ++i) {
+        cfi(".cfi_offset " + std::string(regalloc_regs[i]) + ", " + std::to_string(regs_slot(i)));
+    }
+}
+
+// frame of proc_start after the prologue, fp points at its top
+static void cfi_frame() {
+    cfi(".cfi_def_cfa fp, 0");
+    cfi(".cfi_offset ra, -8");
+    cfi(".cfi_offset fp, -16");
+    cfi(".cfi_offset s1, -24");
+    cfi(".cfi_offset s2, -32");
+    if (regalloc_used()) regs_cfi();
 }
 
 void proc_end() {
-    od << "\tld ra, " << std::to_string(sd - 8) << "(sp)" << std::endl;
-    od << "\tld fp, " << std::to_string(sd - 16) << "(sp)" << std::endl;
-    od << "\tld s1, " << std::to_string(sd - 24) << "(sp)" << std::endl;
-    od << "\tld s2, " << std::to_string(sd - 32) << "(sp)" << std::endl;
-    od << "\taddi sp, sp, " << std::to_string(sd) << std::endl;
+    // STOP and END return from the middle of main
+    // the code of main is emitted before its frame size is known, so this only addresses the frame through fp
+    cfi(".cfi_remember_state");
+    od << "\tld ra, -8(fp)" << std::endl;
+    od << "\tld s1, -24(fp)" << std::endl;
+    od << "\tld s2, -32(fp)" << std::endl;
+    od << "\taddi sp, fp, -16" << std::endl;
+    cfi(".cfi_def_cfa sp, 16");
+    od << "\tld fp, 0(sp)" << std::endl;
+    od << "\taddi sp, sp, 16" << std::endl;
+    cfi(".cfi_def_cfa_offset 0");
     od << "\tret" << std::endl;
+    cfi(".cfi_restore_state");
 }
 
 void proc_start(bool reserve_gosub) {
@@ -98,6 +141,8 @@ void proc_start(bool reserve_gosub) {
     od << "\tsd fp, " << std::to_string(sd - 16) << "(sp)" << std::endl;
     od << "\tsd s1, " << std::to_string(sd - 24) << "(sp)" << std::endl;
     od << "\tsd s2, " << std::to_string(sd - 32) << "(sp)" << std::endl;
+    od << "\taddi fp, sp, " << std::to_string(sd) << std::endl;
+    cfi_frame();
     od << "\taddi s1, sp, " << std::to_string(sd - 32 - (reserve_gosub ? gosub_depth * 8 : 0)) << std::endl;
     od << "\tli s2, 0" << std::endl;
 }
@@ -106,46 +151,70 @@ void proc_main_start() {
     od << ".section .text" << std::endl;
     od << "main:" << std::endl;
     od << ".global main" << std::endl;
-    sd = 8 + 4 * 8 + gosub_depth * 8 + max_tmp_count + max_loop_control_vars;
+    if (options.debug) od << ".type main, @function" << std::endl;
+    cfi(".cfi_startproc");
+    sd = 8 + 4 * 8 + gosub_depth * 8 + max_tmp_count + loop_slots_size() + (regalloc_used() ? 3 * 8 : 0);
     if (sd % 16) {
         sd += 8;
     }
     proc_start();
+    if (regalloc_used()) {
+        for (long i = 0; i < 3; ++i) {
+            od << "\tsd " << regalloc_regs[i] << ", " << std::to_string(regs_slot(i)) << "(fp)" << std::endl;
+        }
+        regs_cfi();
+    }
 }
 
 void proc_main_end(long r) {
     od << "\tli a0, " << std::to_string(r) << std::endl;
+    if (regalloc_used()) {
+        for (long i = 0; i < 3; ++i) {
+            od << "\tld " << regalloc_regs[i] << ", " << std::to_string(regs_slot(i)) << "(fp)" << std::endl;
+        }
+    }
     proc_end();
 }
 
+void proc_main_close() {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".size main, .-main" << std::endl;
+}
+
+// DEF functions are emitted inside main, main's unwind info is split around them
+void asm_function_start(const std::string &name) {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".type " << name << ", @function" << std::endl;
+    asm_set_label(name);
+    cfi(".cfi_startproc");
+}
+
+void asm_function_end(const std::string &name) {
+    cfi(".cfi_endproc");
+    if (options.debug) od << ".size " << name << ", .-" << name << std::endl;
+    cfi(".cfi_startproc");
+    cfi_frame();
+}
+
+void asm_debug_file(const std::string &path) {
+    od << "\t.file 1 \"";
+    for (auto c: path) {
+        if (c == '"' || c == '\\') od << '\\';
+        od << c;
+    }
+    od << "\"" << std::endl;
+}
+
+void asm_debug_line(long source_line) {
+    od << "\t.loc 1 " << std::to_string(source_line) << std::endl;
+}
+
 void
 asm_data(const std::map<std::string, std::pair<long, long>> &varDims, const std::map<long, std::string> &stringMap,
          const std::vector<std::pair<double, std::string>> &dataItems) {
     od << ".section .data" << std::endl;
     for (auto &[n, d]: varDims) {
-        long s;
-        switch (eval_ret_from_suffix(n.back())) {
-            case NUMBERC:
-                s = 1;
-                break;
-            case NUMBERS:
-                s = 2;
-                break;
-            case NUMBERI:
-                s = 4;
-                break;
-            case NUMBERL:
-                s = 8;
-                break;
-            case NUMBERF:
-                s = 4;
-                break;
-            case NUMBERD:
-            case STRING:
-            case NUMBERP:
-                s = 8;
-                break;
-        }
+        long s = eval_ret_size(eval_ret_from_suffix(n.back()));
         od << ".balign " << std::to_string(s) << std::endl;
         od << tr(n) << ":" << std::endl;
         if (d.second && d.first) {
@@ -192,6 +261,81 @@ asm_data(const std::map<std::string, std::pair<long, long>> &varDims, const std:
     }
 }
 
+void asm_profile_data(const std::vector<long> &lines, const std::string &file) {
+    od << ".section .data" << std::endl;
+    od << ".balign 8" << std::endl;
+    od << "PROF__begin:" << std::endl;
+    for (auto l: lines) {
+        od << "PROF__" << std::to_string(l) << ":" << std::endl;
+        od << "\t.quad 0" << std::endl;
+    }
+    od << "PROF__end:" << std::endl;
+    od << "PROF__lines:" << std::endl;
+    for (auto l: lines) {
+        od << "\t.quad " << std::to_string(l) << std::endl;
+    }
+    od << "PROF__file:" << std::endl;
+    od << "\t.byte ";
+    for (auto &c: file) {
+        char buf[3];
+        snprintf(buf, 3, "%2x", (unsigned char) c);
+        od << "0x" << buf << ", ";
+    }
+    od << "0x0" << std::endl;
+}
+
+// rv64gc with the extensions v, zba and zbb, like the -march of gcc (rv64gcv_zba_zbb)
+std::optional<unsigned> asm_march(std::string_view name) {
+    if (!name.starts_with("rv64gc")) return std::nullopt;
+    name.remove_prefix(6);
+    unsigned m = 0;
+    if (name.starts_with("v")) {
+        m |= MARCH_RVV;
+        name.remove_prefix(1);
+    }
+    while (!name.empty()) {
+        if (name.starts_with("_zba")) {
+            m |= MARCH_ZBA;
+        } else if (name.starts_with("_zbb")) {
+            m |= MARCH_ZBB;
+        } else {
+            return std::nullopt;
+        }
+        name.remove_prefix(4);
+    }
+    return m;
+}
+
+long asm_regs_available() {
+    return 3;
+}
+
+void asm_regs_load() {
+    for (size_t i = 0; i < regalloc_current->vars.size(); ++i) {
+        od << "\tld " << regalloc_regs[i] << ", " << tr(regalloc_current->vars[i]) << std::endl;
+    }
+}
+
+void asm_regs_store() {
+    for (size_t i = 0; i < regalloc_current->vars.size(); ++i) {
+        od << "\tsd " << regalloc_regs[i] << ", " << tr(regalloc_current->vars[i]) << ", t0" << std::endl;
+    }
+}
+
+// DEF and external functions read the variables from memory
+static void call_function(const std::string &name) {
+    if (regalloc_current) asm_regs_store();
+    od << "\tcall " << name << std::endl;
+}
+
+// register of a promoted FOR control variable
+static std::optional<long> promoted(struct exp_t *var) {
+    if (var->type != exp_t::V) return std::nullopt;
+    auto *v = reinterpret_cast<val_t *>(var->data);
+    if (v->type != val_t::N) return std::nullopt;
+    return regalloc_reg(v->ns);
+}
+
 void proc_sub_start() {
     sd = 8 + 4 * 8 + max_tmp_count;
     if (sd % 16) {
@@ -235,7 +379,7 @@ long asm_save(eval_ret ret, bool as_reference) {
     }
 }
 
-extern char comma_sig[9];
+extern thread_local char comma_sig[9];
 
 void asm_promote_signature() {
     int i = 0;
@@ -293,22 +437,30 @@ eval_ret asm_promote_numeric(eval_ret ret) {
             return ret;
             break;
         case NUMBERF:
-            od << "\tfcvt.d.s fa0, fa0" << std::endl;
+            if (pval) od << "\tfcvt.d.s fa0, fa0" << std::endl;
             return NUMBERD;
     }
 }
 
 eval_ret asm_eval_cmp_exp(struct exp_t *left, struct exp_t *right, eval_cmp_op op) {
+    infer_literals_t literals(infer_safe(left) && infer_safe(right));
+    // the temporaries of both operands are free again once the left one is loaded
+    auto mark = get_tmp_count();
     if (!pval) {
-        asm_save(eval_val(right, false), false);
+        auto r0 = asm_promote_numeric(eval_val(right, false));
+        reset_tmp_count(mark);
+        asm_save(r0, false);
         eval_val(left, false);
+        reset_tmp_count(mark);
         return NUMBERL;
     }
     auto r0 = eval_val(right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
     if (r0 == STRING && r1 == STRING) {
         if (op != EQ && op != NE) throw std::runtime_error("string expressions can only be tested for equality");
         od << "\tld a1, " << std::to_string(tmp) << "(sp)" << std::endl;
@@ -325,7 +477,8 @@ eval_ret asm_eval_cmp_exp(struct exp_t *left, struct exp_t *right, eval_cmp_op o
         goto fcmp;
     } else {
         if (r1 == NUMBERL) {
-            od << "\tfcvt.d.l fa1, a0" << std::endl;
+            od << "\tfcvt.d.l fa0, a0" << std::endl;
+            od << "\tfld fa1, " << std::to_string(tmp) << "(sp)" << std::endl;
         } else {
             assert(r0 == NUMBERL);
             od << "\tld a1, " << std::to_string(tmp) << "(sp)" << std::endl;
@@ -388,15 +541,25 @@ eval_ret asm_eval_cmp(struct op_t *o, struct op_t *o1, eval_cmp_op op) {
 }
 
 eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool check_fp) {
+    infer_literals_t literals(iop && infer_safe_op(o));
+    auto mark = get_tmp_count();
     if (!pval) {
-        asm_save(eval_val(o->right, false), false);
-        return eval_val(o->left, false);
+        // size the temporaries for the promoted types, like the emitting pass
+        auto r0 = asm_promote_numeric(eval_val(o->right, false));
+        reset_tmp_count(mark);
+        asm_save(r0, false);
+        auto r1 = asm_promote_numeric(eval_val(o->left, false));
+        reset_tmp_count(mark);
+        if (r0 == STRING || r1 == STRING) return r1;
+        return r0 == NUMBERL && r1 == NUMBERL && iop ? NUMBERL : NUMBERD;
     }
     auto r0 = eval_val(o->right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(o->left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
     if (r0 == STRING && r1 == STRING) {
         throw std::runtime_error("invalid OP on strings");
     } else if (r0 == STRING || r1 == STRING) {
@@ -422,7 +585,8 @@ eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool ch
         return NUMBERD;
     }
     m:
-    if (iop) {
+    // integers of --infer-int are only combined as integers where the result is known to fit in 53 bits
+    if (iop && (infer_literals || !(infer_safe(o->left) || infer_safe(o->right)))) {
         od << "\t" << iop << " a0, a0, a1" << std::endl;
         return NUMBERL;
     } else {
@@ -433,16 +597,22 @@ eval_ret asm_eval_math(struct op_t *o, const char *iop, const char *fop, bool ch
 }
 
 eval_ret asm_eval_power(struct op_t *o) {
+    auto mark = get_tmp_count();
     if (!pval) {
-        add_tmp(DOUBLE);
         eval_val(o->right, false);
-        return eval_val(o->left, false);
+        reset_tmp_count(mark);
+        add_tmp(DOUBLE);
+        eval_val(o->left, false);
+        reset_tmp_count(mark);
+        return NUMBERD;
     }
     auto r0 = eval_val(o->right, false);
     r0 = asm_promote_numeric(r0);
+    reset_tmp_count(mark);
     auto tmp = asm_save(r0, false);
     auto r1 = eval_val(o->left, false);
     r1 = asm_promote_numeric(r1);
+    reset_tmp_count(mark);
     if (r0 == STRING && r1 == STRING) {
         throw std::runtime_error("invalid OP on strings");
     } else if (r0 == STRING || r1 == STRING) {
@@ -468,7 +638,7 @@ eval_ret asm_eval_power(struct op_t *o) {
 }
 
 void asm_process_comma(struct op_t *o) {
-    auto tmp_start = get_tmp_count();
+    auto tmp_start = tmp_base + get_tmp_count();
     struct op_t *r = o;
     memset(comma_sig, 0, 9);
     while (o) {
@@ -478,6 +648,8 @@ void asm_process_comma(struct op_t *o) {
         o = (struct op_t *) o->right->data;
     }
     o = r;
+    // the arguments may leave temporaries of their own behind the head elements
+    auto heads_end = tmp_base + get_tmp_count();
     auto tmp_i = tmp_start;
     int i = 0;
     while (o) {
@@ -561,12 +733,12 @@ void asm_process_comma(struct op_t *o) {
     comma_sig[i] = 0;
     /*
      * a0: last element
-     * tmp_start ... tmp_count - 1: head elements
+     * tmp_start ... heads_end - 1: head elements
      */
     if (pval) {
         int j = 0;
         int k = 0;
-        for (i = 0; i < 1 + (get_tmp_count() - tmp_start) / 8; ++i) {
+        for (i = 0; i < 1 + (heads_end - tmp_start) / 8; ++i) {
             if (comma_sig[i] == 'd') ++j;
             else ++k;
         }
@@ -579,7 +751,7 @@ void asm_process_comma(struct op_t *o) {
         }
         j = 0;
         k = 0;
-        for (i = 0; i < (get_tmp_count() - tmp_start) / 8; ++i) {
+        for (i = 0; i < (heads_end - tmp_start) / 8; ++i) {
             switch (eval_ret_from_comma(comma_sig[i])) {
                 case NUMBERC:
                     od << "\tlb a" << std::to_string(k++) << ", " << std::to_string(tmp_start + i * 8) << "(sp)"
@@ -612,6 +784,155 @@ void asm_process_comma(struct op_t *o) {
     }
 }
 
+// take the pointer of an array walk that stays inside the array, otherwise fall through to the bounds check.
+// Returns the label after the element address.
+static std::string walk_load(const licm_walk_t &w) {
+    auto slow = line_label();
+    auto done = line_label();
+    od << "\tld a1, " << std::to_string(loop_slot(w.slot + 8)) << "(sp)" << std::endl;
+    od << "\tbltz a1, " << slow << std::endl;
+    od << "\tld a0, " << std::to_string(loop_slot(w.slot)) << "(sp)" << std::endl;
+    od << "\tj " << done << std::endl;
+    od << slow << ":" << std::endl;
+    return done;
+}
+
+// a0: element index returned by ARRAY__chk_bound1/2 (or the element address at done)
+static eval_ret array_element(const std::string &vn, bool as_reference, const std::string &done = {}) {
+    auto r = eval_ret_from_suffix(vn.back());
+    auto shift = std::countr_zero((unsigned long) eval_ret_size(r));
+    if (shift && (options.march & MARCH_ZBA)) {
+        // Zba shifts the index and adds the base in one instruction
+        od << "\tla a1, " << tr(vn) << std::endl;
+        od << "\tsh" << std::to_string(shift) << "add a0, a0, a1" << std::endl;
+    } else {
+        if (shift) {
+            od << "\tslli a0, a0, " << std::to_string(shift) << std::endl;
+        }
+        od << "\tla a1, " << tr(vn) << std::endl;
+        od << "\tadd a0, a0, a1" << std::endl;
+    }
+    if (!done.empty()) od << done << ":" << std::endl;
+    if (!as_reference) {
+        switch (r) {
+            case NUMBERC:
+                od << "\tlb a0, 0(a0)" << std::endl;
+                break;
+            case NUMBERS:
+                od << "\tlh a0, 0(a0)" << std::endl;
+                break;
+            case NUMBERI:
+                od << "\tlw a0, 0(a0)" << std::endl;
+                break;
+            case NUMBERL:
+            case NUMBERP:
+            case STRING:
+                od << "\tld a0, 0(a0)" << std::endl;
+                break;
+            case NUMBERF:
+                od << "\tflw fa0, 0(a0)" << std::endl;
+                break;
+            case NUMBERD:
+                od << "\tfld fa0, 0(a0)" << std::endl;
+                break;
+        }
+    }
+    return r;
+}
+
+// RND of math.c: the next output of xoshiro256** on RND__state, its upper 53 bits scaled to [0, 1)
+static void inline_rnd() {
+    // rotate left by k
+    auto rotl = [](const char *r, int k) {
+        if (options.march & MARCH_ZBB) {
+            od << "\trori " << r << ", " << r << ", " << std::to_string(64 - k) << std::endl;
+            return;
+        }
+        od << "\tslli a1, " << r << ", " << std::to_string(k) << std::endl;
+        od << "\tsrli " << r << ", " << r << ", " << std::to_string(64 - k) << std::endl;
+        od << "\tor " << r << ", " << r << ", a1" << std::endl;
+    };
+    od << "\tla t0, RND__state" << std::endl;
+    od << "\tld t1, 0(t0)" << std::endl;
+    od << "\tld t2, 8(t0)" << std::endl;
+    od << "\tld t3, 16(t0)" << std::endl;
+    od << "\tld t4, 24(t0)" << std::endl;
+    // s[1] * 5, rotated, * 9
+    if (options.march & MARCH_ZBA) {
+        od << "\tsh2add a0, t2, t2" << std::endl;
+    } else {
+        od << "\tslli a0, t2, 2" << std::endl;
+        od << "\tadd a0, a0, t2" << std::endl;
+    }
+    rotl("a0", 7);
+    if (options.march & MARCH_ZBA) {
+        od << "\tsh3add a0, a0, a0" << std::endl;
+    } else {
+        od << "\tslli a1, a0, 3" << std::endl;
+        od << "\tadd a0, a0, a1" << std::endl;
+    }
+    od << "\tslli t5, t2, 17" << std::endl;
+    od << "\txor t3, t3, t1" << std::endl;
+    od << "\txor t4, t4, t2" << std::endl;
+    od << "\txor t2, t2, t3" << std::endl;
+    od << "\txor t1, t1, t4" << std::endl;
+    od << "\txor t3, t3, t5" << std::endl;
+    rotl("t4", 45);
+    od << "\tsd t1, 0(t0)" << std::endl;
+    od << "\tsd t2, 8(t0)" << std::endl;
+    od << "\tsd t3, 16(t0)" << std::endl;
+    od << "\tsd t4, 24(t0)" << std::endl;
+    od << "\tsrli a0, a0, 11" << std::endl;
+    od << "\tfcvt.d.lu fa0, a0" << std::endl;
+    od << "\tli a1, 0x3ca0000000000000" << std::endl;
+    od << "\tfmv.d.x fa1, a1" << std::endl;
+    od << "\tfmul.d fa0, fa0, fa1" << std::endl;
+}
+
+// ABS, INT, SGN and SQR of fa0 without calling math.c. SQR only calls SQR__d to report a negative argument.
+static bool inline_math(std::string_view f) {
+    // a call is shorter for lines that never ran
+    if (pgo_cold(line_no)) return false;
+    if (f == "ABS") {
+        od << "\tfabs.d fa0, fa0" << std::endl;
+    } else if (f == "INT") {
+        // at 2^52 and above (and for NaN) every double is already an integer. The sign of the argument is kept, so
+        // INT(-0) stays -0.
+        auto done = line_label();
+        od << "\tfabs.d ft0, fa0" << std::endl;
+        od << "\tli t0, 0x4330000000000000" << std::endl;
+        od << "\tfmv.d.x ft1, t0" << std::endl;
+        od << "\tflt.d t0, ft0, ft1" << std::endl;
+        od << "\tbeqz t0, " << done << std::endl;
+        od << "\tfcvt.l.d t0, fa0, rdn" << std::endl;
+        od << "\tfcvt.d.l ft0, t0" << std::endl;
+        od << "\tfsgnj.d fa0, ft0, fa0" << std::endl;
+        od << done << ":" << std::endl;
+    } else if (f == "SGN") {
+        // ±1, masked to 0 if the argument equals 0
+        od << "\tfmv.d.x ft0, zero" << std::endl;
+        od << "\tfeq.d t0, fa0, ft0" << std::endl;
+        od << "\taddi t0, t0, -1" << std::endl;
+        od << "\tli t1, 0x3ff0000000000000" << std::endl;
+        od << "\tfmv.d.x ft1, t1" << std::endl;
+        od << "\tfsgnj.d ft1, ft1, fa0" << std::endl;
+        od << "\tfmv.x.d t1, ft1" << std::endl;
+        od << "\tand t1, t1, t0" << std::endl;
+        od << "\tfmv.d.x fa0, t1" << std::endl;
+    } else if (f == "SQR") {
+        auto ok = line_label();
+        od << "\tfmv.d.x ft0, zero" << std::endl;
+        od << "\tflt.d t0, fa0, ft0" << std::endl;
+        od << "\tbeqz t0, " << ok << std::endl;
+        od << "\tcall SQR__d" << std::endl;
+        od << ok << ":" << std::endl;
+        od << "\tfsqrt.d fa0, fa0" << std::endl;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 eval_ret eval_val(struct exp_t *exp, bool as_reference) {
     if (pval) {
         od << "// ";
@@ -619,16 +940,26 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
         od << std::endl;
     }
     skip_val = false;
+    if (!as_reference) {
+        if (!pval) {
+            licm_visit(exp);
+        } else if (auto h = licm_hoisted(exp)) {
+            od << (h->type == NUMBERD ? "\tfld fa0, " : "\tld a0, ") << std::to_string(loop_slot(h->slot))
+               << "(sp)" << std::endl;
+            return h->type;
+        }
+    }
     if (!exp) {
         throw std::runtime_error("syntax error");
     } else if (exp->type == exp_t::V) {
         auto *v = reinterpret_cast<val_t *>(exp->data);
         switch (v->type) {
-            case val_t::L:
+            case val_t::L: {
                 ASSERT(!as_reference);
+                auto r = eval_ret_from_suffix(v->suffix);
+                if (infer_literals && r == NUMBERD) r = NUMBERL;
                 if (pval) {
                     od << "\tli a0, " << std::to_string(v->l) << std::endl;
-                    auto r = eval_ret_from_suffix(v->suffix);
                     switch (r) {
                         case NUMBERC:
                         case NUMBERS:
@@ -645,8 +976,9 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         case NUMBERP:
                             break;
                     }
-                    return r;
-                } else return eval_ret_from_suffix(v->suffix);
+                }
+                return r;
+            }
             case val_t::F:
                 ASSERT(!as_reference);
                 if (!pval) return NUMBERD;
@@ -698,24 +1030,26 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     if (current_def && *current_def == v->ns) {
                         throw std::runtime_error("undefined function " + *current_def);
                     }
-                    if (strlen(defns[v->ns].data()) != 0) {
+                    if (strlen(defns.at(v->ns).data()) != 0) {
                         throw std::runtime_error("invalid number of arguments for function " + std::string(v->ns));
                     }
                     if (pval) {
-                        od << "\tcall " << v->ns << std::endl;
+                        call_function(v->ns);
                     }
                     return eval_ret_from_suffix(v->suffix);
                 } else if (known_funcs.contains(v->ns)) {
-                    if (pval) {
+                    if (pval && std::string_view(v->ns) == "RND" && !pgo_cold(line_no)) {
+                        inline_rnd();
+                    } else if (pval) {
                         od << "\tcall " << v->ns << std::endl;
                     }
-                    return known_funcs[v->ns];
+                    return known_funcs.at(v->ns);
                 } else if (promoting_funcs.contains(v->ns)) {
                     throw std::runtime_error("syntax error");
                 } else if (!is_var_name(v->ns)) {
                     if (features.external) {
                         if (pval) {
-                            od << "\tcall " << v->ns << std::endl;
+                            call_function(v->ns);
                         }
                         return eval_ret_from_suffix(v->suffix);
                     } else {
@@ -726,12 +1060,26 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     auto p = var_dims.at(v->ns);
                     ASSERT(!p.first && !p.second);
                 }
-                var_dims[v->ns] = std::make_pair(0, 0);
+                if (!var_dims.contains(v->ns)) var_dims[v->ns] = std::make_pair(0, 0);
+                regalloc_use(v->ns, as_reference);
                 if (as_reference) {
-                    if (pval) od << "\tla a0, " << v->ns << std::endl;
-                    return eval_ret_from_suffix(v->suffix);
+                    infer_ref(v->ns);
+                    licm_write(v->ns);
+                }
+                if (auto reg = regalloc_reg(v->ns)) {
+                    auto r = eval_ret_from_var(v->ns);
+                    if (pval) {
+                        ASSERT(!as_reference);
+                        if (r == NUMBERD) od << "\tfmv.d.x fa0, " << regalloc_regs[*reg] << std::endl;
+                        else od << "\tmv a0, " << regalloc_regs[*reg] << std::endl;
+                    }
+                    return r;
+                }
+                if (as_reference) {
+                    if (pval) od << "\tla a0, " << tr(v->ns) << std::endl;
+                    return eval_ret_from_var(v->ns);
                 } else {
-                    auto r = eval_ret_from_suffix(v->suffix);
+                    auto r = eval_ret_from_var(v->ns);
                     if (pval) {
                         switch (r) {
                             case NUMBERC:
@@ -769,7 +1117,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     string_map[string_ix] = v->ns;
                     string_buf[v->ns] = string_ix++;
                 }
-                if (pval) od << "\tla a0, STR__" << std::to_string(string_buf[std::string(v->ns)]) << std::endl;
+                if (pval) od << "\tla a0, STR__" << std::to_string(string_buf.at(v->ns)) << std::endl;
                 return STRING;
         }
     } else {
@@ -801,9 +1149,12 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         p = var_dims[vn] = std::make_pair(10, 0);
                     }
                     if (!pval) {
+                        licm_array(exp);
                         eval_val(o->right, false);
                         return eval_ret_from_suffix(vn.back());
                     }
+                    std::string done;
+                    if (auto w = licm_walking(exp)) done = walk_load(*w);
                     switch (eval_val(o->right, false)) {
                         case NUMBERD:
                             od << "\tfcvt.l.d a0, fa0" << std::endl;
@@ -825,13 +1176,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     od << "\tli a1, " << std::to_string(p.first) << std::endl;
                     od << "\tli a2, " << std::to_string(option_base) << std::endl;
                     od << "\tcall ARRAY__chk_bound1" << std::endl;
-                    od << "\tla a1, " << vn << std::endl;
-                    od << "\tadd a0, a0, a1" << std::endl;
-                    if (!as_reference) {
-                        if (vn.back() == '$') od << "\tld a0, 0(a0)" << std::endl;
-                        else od << "\tfld fa0, 0(a0)" << std::endl;
-                    }
-                    return eval_ret_from_suffix(vn.back());
+                    return array_element(vn, as_reference, done);
                 } else {
                     auto *op = reinterpret_cast<op_t *>(o->right->data);
                     if (op->op != ',') {
@@ -854,10 +1199,13 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     }
                     auto tmp = add_tmp(LONG);
                     if (!pval) {
+                        licm_array(exp);
                         eval_val(op->left, false);
                         eval_val(op->right, false);
                         return eval_ret_from_suffix(vn.back());
                     }
+                    std::string done;
+                    if (auto w = licm_walking(exp)) done = walk_load(*w);
                     switch (eval_val(op->right, false)) {
                         case NUMBERD:
                             od << "\tfcvt.l.d a0, fa0" << std::endl;
@@ -900,34 +1248,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     od << "\tli a3, " << std::to_string(p.second) << std::endl;
                     od << "\tli a4, " << std::to_string(option_base) << std::endl;
                     od << "\tcall ARRAY__chk_bound2" << std::endl;
-                    od << "\tla a1, " << vn << std::endl;
-                    od << "\tadd a0, a0, a1" << std::endl;
-                    auto r = eval_ret_from_suffix(vn.back());
-                    if (!as_reference) {
-                        switch (r) {
-                            case NUMBERC:
-                                od << "\tlb a0, 0(a0)" << std::endl;
-                                break;
-                            case NUMBERS:
-                                od << "\tlh a0, 0(a0)" << std::endl;
-                                break;
-                            case NUMBERI:
-                                od << "\tlw a0, 0(a0)" << std::endl;
-                                break;
-                            case NUMBERL:
-                            case NUMBERP:
-                            case STRING:
-                                od << "\tld a0, 0(a0)" << std::endl;
-                                break;
-                            case NUMBERF:
-                                od << "\tflw fa0, 0(a0)" << std::endl;
-                                break;
-                            case NUMBERD:
-                                od << "\tfld fa0, 0(a0)" << std::endl;
-                                break;
-                        }
-                    }
-                    return r;
+                    return array_element(vn, as_reference, done);
                 }
             } else {
                 if (v->starts_with("DEREF")) {
@@ -1050,7 +1371,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                             }
                         }
                         asm_promote_signature();
-                        od << "\tcall " << *v << std::endl;
+                        call_function(std::string(*v));
                         return eval_ret_from_suffix(v->back());
                     } else if (promoting_funcs.contains(*v)) {
                         if (strcmp(comma_sig, "l") == 0) {
@@ -1058,18 +1379,18 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                         } else if (strcmp(comma_sig, "d") != 0) {
                             throw std::runtime_error("syntax error");
                         }
-                        od << "\tcall " << *v << "__d" << std::endl;
+                        if (!inline_math(*v)) od << "\tcall " << *v << "__d" << std::endl;
                     } else if (v->size() == 3 && (*v)[0] == 'F' && (*v)[1] == 'N') {
                         if (features.external) {
                             asm_promote_signature();
-                            od << "\tcall " << *v << "__" << comma_sig << std::endl;
+                            call_function(std::string(*v) + "__" + comma_sig);
                             return eval_ret_from_suffix(v->back());
                         } else {
                             throw std::runtime_error("undefined function " + std::string(*v));
                         }
                     } else {
-                        if (comma_sig[0]) od << "\tcall " << *v << "__" << comma_sig << std::endl;
-                        else od << "\tcall " << *v << std::endl;
+                        if (comma_sig[0]) call_function(std::string(*v) + "__" + comma_sig);
+                        else call_function(std::string(*v));
                     }
                 } else {
                     if (v->size() == 3 && (*v)[0] == 'F' && (*v)[1] == 'N') {
@@ -1079,7 +1400,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
                     }
                 }
                 if (known_funcs.contains(*v)) {
-                    return known_funcs[*v];
+                    return known_funcs.at(*v);
                 }
                 return eval_ret_from_suffix(v->back());
             }
@@ -1148,7 +1469,7 @@ eval_ret eval_val(struct exp_t *exp, bool as_reference) {
     }
 }
 
-void proc_sub_store_args(const std::vector<std::string> &arg_names) {
+void proc_sub_store_args(std::span<const std::string> arg_names) {
     int ix = 0;
     int fx = 0;
     for (auto &f: arg_names) {
@@ -1223,17 +1544,84 @@ void asm_jump_label(const std::string &label) {
 }
 
 void asm_set_label(const std::string &label) {
+    if (line_copy && label.starts_with(".L")) return;
     od << label << ":" << std::endl;
+    if (options.profile && label.starts_with(".L")) asm_profile_count(std::stol(label.substr(2)));
+}
+
+// copies of a loop body per limit test, fewer for the smaller instruction caches of RISC-V cores
+long asm_unroll_factor() {
+    return 2;
+}
+
+void asm_profile_start() {
+    od << "\tla a0, PROF__begin" << std::endl;
+    od << "\tla a1, PROF__end" << std::endl;
+    od << "\tla a2, PROF__lines" << std::endl;
+    od << "\tla a3, PROF__file" << std::endl;
+    od << "\tcall PROFILE__start" << std::endl;
+}
+
+void asm_rnd_seed(unsigned long seed) {
+    od << "\tli a0, " << std::to_string(static_cast<long>(seed)) << std::endl;
+    od << "\tcall RND__seed" << std::endl;
+}
+
+void asm_section(bool cold) {
+    od << (cold ? ".section .text.unlikely,\"ax\",@progbits" : ".section .text") << std::endl;
+    unlikely = cold;
+}
+
+// the call of a runtime error function (which does not return) is taken by branch and moved to .text.unlikely,
+// the other way falls through. In a cold line it stays in place.
+static void error_branch(const std::string &branch, const std::string &inverse, const std::string &f) {
+    auto tl = line_label();
+    if (unlikely) {
+        od << "\t" << inverse << tl << std::endl;
+        od << "\tcall " << f << std::endl;
+        od << tl << ":" << std::endl;
+        return;
+    }
+    od << "\t" << branch << tl << std::endl;
+    asm_section(true);
+    od << tl << ":" << std::endl;
+    od << "\tcall " << f << std::endl;
+    asm_section(false);
+}
+
+void asm_profile_count(long line) {
+    od << "\tla t0, PROF__" << std::to_string(line) << std::endl;
+    od << "\tld t1, 0(t0)" << std::endl;
+    od << "\taddi t1, t1, 1" << std::endl;
+    od << "\tsd t1, 0(t0)" << std::endl;
 }
 
 void asm_if_jump(long d) {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
+    auto tl = line_label();
     od << "beqz a0, " << tl << std::endl;
+    if (regalloc_leaves(d)) asm_regs_store();
     od << "j .L" << std::to_string(d) << std::endl;
     od << tl << ":" << std::endl;
 }
 
 void asm_for_step(struct exp_t *exp, long step_var) {
+    if (auto vn = is_simple_var(exp); vn && infer_int(*vn)) {
+        eval_val(exp, false);
+        od << "\tld a1, " << std::to_string(loop_slot(step_var)) << "(sp)" << std::endl;
+        od << "\tadd a0, a0, a1" << std::endl;
+        store_var(*vn, NUMBERL);
+        return;
+    }
+    if (auto reg = promoted(exp)) {
+        auto r = eval_val(exp, false);
+        cast(r, NUMBERD);
+        od << "\tfld fa1, " << std::to_string(loop_slot(step_var)) << "(sp)" << std::endl;
+        od << "\tfadd.d fa0, fa0, fa1" << std::endl;
+        cast(NUMBERD, r);
+        if (r == NUMBERD) od << "\tfmv.x.d " << regalloc_regs[*reg] << ", fa0" << std::endl;
+        else od << "\tmv " << regalloc_regs[*reg] << ", a0" << std::endl;
+        return;
+    }
     bool is_l = false;
     switch (eval_val(exp, true)) {
         case NUMBERC:
@@ -1256,7 +1644,7 @@ void asm_for_step(struct exp_t *exp, long step_var) {
     } else {
         od << "\tfld fa0, 0(a0)" << std::endl;
     }
-    od << "\tfld fa1, " << std::to_string(get_max_tmp_count() + step_var) << "(sp)" << std::endl;
+    od << "\tfld fa1, " << std::to_string(loop_slot(step_var)) << "(sp)" << std::endl;
     od << "\tfadd.d fa0, fa0, fa1" << std::endl;
     if (is_l) {
         od << "\tfcvt.l.d a1, fa0" << std::endl;
@@ -1343,38 +1731,49 @@ void cast(eval_ret from, eval_ret to) {
     }
 }
 
-void asm_assign_simple(struct exp_t *exp, std::string_view vn) {
-    auto r = eval_val(exp, false);
-    auto to = eval_ret_from_suffix(vn.back());
-    if (r != to) {
-        cast(r, to);
+// store a0/fa0 of type to in a scalar variable
+static void store_var(std::string_view vn, eval_ret to) {
+    if (auto reg = regalloc_reg(vn)) {
+        if (to == NUMBERD) od << "\tfmv.x.d " << regalloc_regs[*reg] << ", fa0" << std::endl;
+        else od << "\tmv " << regalloc_regs[*reg] << ", a0" << std::endl;
+        return;
     }
     switch (to) {
         case NUMBERC:
-            od << "\tsb a0, " << vn << ", a1" << std::endl;
+            od << "\tsb a0, " << tr(vn) << ", a1" << std::endl;
             break;
         case NUMBERS:
-            od << "\tsh a0, " << vn << ", a1" << std::endl;
+            od << "\tsh a0, " << tr(vn) << ", a1" << std::endl;
             break;
         case NUMBERI:
-            od << "\tsw a0, " << vn << ", a1" << std::endl;
+            od << "\tsw a0, " << tr(vn) << ", a1" << std::endl;
             break;
         case NUMBERL:
-            od << "\tsd a0, " << vn << ", a1" << std::endl;
+            od << "\tsd a0, " << tr(vn) << ", a1" << std::endl;
             break;
         case NUMBERF:
-            od << "\tfsw fa0, " << vn << ", a1" << std::endl;
+            od << "\tfsw fa0, " << tr(vn) << ", a1" << std::endl;
             break;
         case NUMBERD:
-            od << "\tfsd fa0, " << vn << ", a1" << std::endl;
+            od << "\tfsd fa0, " << tr(vn) << ", a1" << std::endl;
             break;
         case STRING:
         case NUMBERP:
-            od << "\tsd a0, " << vn << ", a1" << std::endl;
+            od << "\tsd a0, " << tr(vn) << ", a1" << std::endl;
             break;
     }
 }
 
+void asm_assign_simple(struct exp_t *exp, std::string_view vn) {
+    infer_literals_t literals(infer_safe(exp));
+    auto r = eval_val(exp, false);
+    auto to = eval_ret_from_var(vn);
+    if (r != to) {
+        cast(r, to);
+    }
+    store_var(vn, to);
+}
+
 void asm_read_tmp(eval_ret t, long tmp) {
     switch (t) {
         case NUMBERC:
@@ -1435,7 +1834,7 @@ eval_ret asm_assign_complex(struct exp_t *var, eval_ret val, long val_tmp) {
     return to;
 }
 
-void asm_print(const std::vector<std::variant<char, exp_t *>> &items) {
+void asm_print(std::span<const std::variant<char, exp_t *>> items) {
     for (auto &i: items) {
         if (auto *c = std::get_if<char>(&i)) {
             if (*c == ',') {
@@ -1480,9 +1879,24 @@ void asm_print(const std::vector<std::variant<char, exp_t *>> &items) {
 }
 
 void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step, long lv0, long lv1) {
+    if (auto vn = is_simple_var(var); vn && infer_int(*vn)) {
+        // an inferred control variable has an integer limit and step
+        infer_literals_t literals(true);
+        cast(eval_val(limit, false), NUMBERL);
+        od << "\tsd a0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+        if (step) {
+            cast(eval_val(step, false), NUMBERL);
+        } else {
+            od << "\tli a0, 1" << std::endl;
+        }
+        od << "\tsd a0, " << std::to_string(loop_slot(lv1)) << "(sp)" << std::endl;
+        cast(eval_val(init, false), NUMBERL);
+        store_var(*vn, NUMBERL);
+        return;
+    }
     // set limit var
     cast(eval_val(limit, false), NUMBERD);
-    od << "\tfsd fa0, " << std::to_string(get_max_tmp_count() + lv0) << "(sp)" << std::endl;
+    od << "\tfsd fa0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
     // set increment var
     if (step) {
         cast(eval_val(step, false), NUMBERD);
@@ -1490,12 +1904,17 @@ void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, st
         od << "\tli a0, 1" << std::endl;
         od << "\tfcvt.d.l fa0, a0" << std::endl;
     }
-    od << "\tfsd fa0, " << std::to_string(get_max_tmp_count() + lv1) << "(sp)" << std::endl;
+    od << "\tfsd fa0, " << std::to_string(loop_slot(lv1)) << "(sp)" << std::endl;
     // set var to init
     pval = false;
     auto to = eval_val(var, true);
     pval = true;
     cast(eval_val(init, false), to);
+    if (auto reg = promoted(var)) {
+        if (to == NUMBERD) od << "\tfmv.x.d " << regalloc_regs[*reg] << ", fa0" << std::endl;
+        else od << "\tmv " << regalloc_regs[*reg] << ", a0" << std::endl;
+        return;
+    }
     auto tmp = asm_save(to, false);
     switch (asm_assign_complex(var, to, tmp)) {
         case NUMBERC:
@@ -1512,10 +1931,283 @@ void asm_for_init(struct exp_t *var, struct exp_t *init, struct exp_t *limit, st
     }
 }
 
+void asm_hoist(struct exp_t *exp, eval_ret type, long slot) {
+    cast(eval_val(exp, false), type);
+    od << (type == NUMBERD ? "\tfsd fa0, " : "\tsd a0, ") << std::to_string(loop_slot(slot)) << "(sp)"
+       << std::endl;
+}
+
+void asm_walk_init(const licm_walk_t &w, long lv0) {
+    auto *o = reinterpret_cast<op_t *>(w.exp->data);
+    auto vn = std::string(*is_name(o->left));
+    auto [my, mx] = var_dims.at(vn);
+    auto t0 = add_tmp(LONG);
+    auto t1 = add_tmp(LONG);
+    // indices are counted from OPTION BASE
+    auto add = [](long c) {
+        if (!c) return;
+        od << "\tli a1, " << std::to_string(c) << std::endl;
+        od << "\tadd a0, a0, a1" << std::endl;
+    };
+    if (w.fixed) {
+        cast(eval_val(w.fixed, false), NUMBERL);
+        add(-option_base);
+        od << "\tsd a0, " << std::to_string(t0) << "(sp)" << std::endl;
+    }
+    // the walk goes from the control variable to the limit
+    cast(eval_val(w.var, false), NUMBERL);
+    add(w.offset - option_base);
+    od << "\tsd a0, " << std::to_string(t1) << "(sp)" << std::endl;
+    if (infer_int(*is_simple_var(w.var))) {
+        od << "\tld a0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+    } else {
+        od << "\tfld fa0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+        cast(NUMBERD, NUMBERL);
+    }
+    add(w.offset - option_base);
+    if (!w.fixed) {
+        od << "\tmv a1, a0" << std::endl;
+        od << "\tld a0, " << std::to_string(t1) << "(sp)" << std::endl;
+        od << "\tli a2, " << std::to_string(my - option_base) << std::endl;
+        od << "\tcall ARRAY__walk1" << std::endl;
+    } else {
+        if (w.first) {
+            od << "\tmv a2, a0" << std::endl;
+            od << "\tld a0, " << std::to_string(t1) << "(sp)" << std::endl;
+            od << "\tld a1, " << std::to_string(t0) << "(sp)" << std::endl;
+            od << "\tld a3, " << std::to_string(t0) << "(sp)" << std::endl;
+        } else {
+            od << "\tmv a3, a0" << std::endl;
+            od << "\tld a0, " << std::to_string(t0) << "(sp)" << std::endl;
+            od << "\tld a1, " << std::to_string(t1) << "(sp)" << std::endl;
+            od << "\tld a2, " << std::to_string(t0) << "(sp)" << std::endl;
+        }
+        od << "\tli a4, " << std::to_string(my - option_base) << std::endl;
+        od << "\tli a5, " << std::to_string(mx - option_base) << std::endl;
+        od << "\tcall ARRAY__walk2" << std::endl;
+    }
+    od << "\tsd a0, " << std::to_string(loop_slot(w.slot + 8)) << "(sp)" << std::endl;
+    array_element(vn, true);
+    od << "\tsd a0, " << std::to_string(loop_slot(w.slot)) << "(sp)" << std::endl;
+}
+
+void asm_walk_step(const licm_walk_t &w) {
+    od << "\tld a0, " << std::to_string(loop_slot(w.slot)) << "(sp)" << std::endl;
+    od << "\tli a1, " << std::to_string(w.stride) << std::endl;
+    od << "\tadd a0, a0, a1" << std::endl;
+    od << "\tsd a0, " << std::to_string(loop_slot(w.slot)) << "(sp)" << std::endl;
+}
+
+// RISC-V targets are not required to have the vector extension, the loop runs on its own. Only a function of a
+// single element is applied by one call to all iterations.
+static std::string vreg(long r) {
+    return "v" + std::to_string(r);
+}
+
+// dst = src + c for any constant
+static void add_imm(const char *dst, const char *src, long c) {
+    if (!c && std::string_view(dst) == src) return;
+    if (c >= -2048 && c < 2048) {
+        od << "\taddi " << dst << ", " << src << ", " << std::to_string(c) << std::endl;
+    } else {
+        od << "\tli t3, " << std::to_string(c) << std::endl;
+        od << "\tadd " << dst << ", " << src << ", t3" << std::endl;
+    }
+}
+
+// register pointing at the element at distance from the one of the control variable
+static const char *vector_at(const char *base, long distance) {
+    if (!distance) return base;
+    add_imm("t2", base, distance * 8);
+    return "t2";
+}
+
+// compute exp for the vl elements at the array pointers into v<d> (RVV), the invariants are in the registers from
+// v31 down and ft0 holds 0
+static void rvv_eval(const simd_loop_t &s, struct exp_t *exp, long d, const std::map<std::string, const char *> &bases) {
+    if (auto it = std::find(s.invariants.cbegin(), s.invariants.cend(), exp); it != s.invariants.cend()) {
+        od << "\tvmv.v.v " << vreg(d) << ", " << vreg(31 - (it - s.invariants.cbegin())) << std::endl;
+        return;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op == ':' && o->left) {
+        auto vn = std::string(*is_name(o->left));
+        auto *p = vector_at(bases.at(vn), *licm_index(o->right, line_no));
+        od << "\tvle64.v " << vreg(d) << ", (" << p << ")" << std::endl;
+        return;
+    }
+    if (!o->left) {
+        rvv_eval(s, o->right, d, bases);
+        // 0 - x like the scalar code
+        if (o->op == '-') od << "\tvfrsub.vf " << vreg(d) << ", " << vreg(d) << ", ft0" << std::endl;
+        return;
+    }
+    rvv_eval(s, o->left, d, bases);
+    auto r = vreg(d + 1);
+    if (auto it = std::find(s.invariants.cbegin(), s.invariants.cend(), o->right); it != s.invariants.cend()) {
+        r = vreg(31 - (it - s.invariants.cbegin()));
+    } else {
+        rvv_eval(s, o->right, d + 1, bases);
+    }
+    od << "\t" << (o->op == '+' ? "vfadd.vv " : o->op == '-' ? "vfsub.vv " : "vfmul.vv ") << vreg(d) << ", "
+       << vreg(d) << ", " << r << std::endl;
+}
+
+// every iteration of the loop at once, as many elements as the vector registers hold at a time
+static void rvv_loop(const simd_loop_t &s, long ts, long te, const std::vector<long> &ti) {
+    static const char *regs[] = {"a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+    auto top = line_label();
+    od << "\tvsetvli t0, zero, e64, m1, ta, ma" << std::endl;
+    for (size_t i = 0; i < ti.size(); ++i) {
+        od << "\tfld ft1, " << std::to_string(ti[i]) << "(sp)" << std::endl;
+        od << "\tvfmv.v.f " << vreg(31 - (long) i) << ", ft1" << std::endl;
+    }
+    od << "\tfmv.d.x ft0, zero" << std::endl;
+    // a0 counts the elements left, the array pointers are at the element of the control variable
+    od << "\tld a0, " << std::to_string(te) << "(sp)" << std::endl;
+    od << "\tld t2, " << std::to_string(ts) << "(sp)" << std::endl;
+    od << "\tsub a0, a0, t2" << std::endl;
+    od << "\taddi a0, a0, 1" << std::endl;
+    add_imm("t2", "t2", -option_base);
+    if (!(options.march & MARCH_ZBA)) od << "\tslli t1, t2, 3" << std::endl;
+    std::map<std::string, const char *> bases;
+    for (size_t i = 0; i < s.arrays.size(); ++i) {
+        bases[s.arrays[i]] = regs[i];
+        od << "\tla " << regs[i] << ", " << tr(s.arrays[i]) << std::endl;
+        if (options.march & MARCH_ZBA) {
+            od << "\tsh3add " << regs[i] << ", t2, " << regs[i] << std::endl;
+        } else {
+            od << "\tadd " << regs[i] << ", " << regs[i] << ", t1" << std::endl;
+        }
+    }
+    auto *t = reinterpret_cast<op_t *>(s.target->data);
+    od << top << ":" << std::endl;
+    od << "\tvsetvli t0, a0, e64, m1, ta, ma" << std::endl;
+    rvv_eval(s, s.value, 1, bases);
+    auto *p = vector_at(bases.at(std::string(*is_name(t->left))), s.elements.front().second);
+    od << "\tvse64.v v1, (" << p << ")" << std::endl;
+    od << "\tsub a0, a0, t0" << std::endl;
+    od << "\tslli t1, t0, 3" << std::endl;
+    for (size_t i = 0; i < s.arrays.size(); ++i) {
+        od << "\tadd " << regs[i] << ", " << regs[i] << ", t1" << std::endl;
+    }
+    od << "\tbnez a0, " << top << std::endl;
+}
+
+void asm_simd(const simd_loop_t &s, struct exp_t *var, long lv0) {
+    // math.c applies the function to a single element, RVV computes anything else
+    bool single = !s.func.empty() && s.elements.size() == (s.value ? 2 : 1) && s.invariants.empty();
+    bool vector = !single && s.value && (options.march & MARCH_RVV);
+    if (!single && !vector) return;
+    auto vn = *is_simple_var(var);
+    auto skip = line_label();
+    auto ts = add_tmp(LONG);
+    auto te = add_tmp(LONG);
+    std::vector<long> ti;
+    for (size_t i = 0; i < s.invariants.size(); ++i) {
+        ti.push_back(add_tmp(DOUBLE));
+    }
+    for (size_t i = 0; i < s.invariants.size(); ++i) {
+        cast(eval_val(s.invariants[i], false), NUMBERD);
+        od << "\tfsd fa0, " << std::to_string(ti[i]) << "(sp)" << std::endl;
+    }
+    // indices are counted from OPTION BASE
+    auto add = [](long c) {
+        if (!c) return;
+        od << "\tli a1, " << std::to_string(c) << std::endl;
+        od << "\tadd a0, a0, a1" << std::endl;
+    };
+    // the control variable is an integer, the last iteration is at the limit rounded down
+    cast(eval_val(var, false), NUMBERL);
+    od << "\tsd a0, " << std::to_string(ts) << "(sp)" << std::endl;
+    if (infer_int(vn)) {
+        od << "\tld a0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+    } else {
+        od << "\tfld fa0, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+        od << "\tfcvt.l.d a0, fa0, rdn" << std::endl;
+    }
+    od << "\tsd a0, " << std::to_string(te) << "(sp)" << std::endl;
+    od << "\tld a1, " << std::to_string(ts) << "(sp)" << std::endl;
+    od << "\tblt a0, a1, " << skip << std::endl;
+    // the loop runs on its own if it leaves an array
+    for (auto &e: s.elements) {
+        od << "\tld a0, " << std::to_string(te) << "(sp)" << std::endl;
+        add(e.second - option_base);
+        od << "\tmv a3, a0" << std::endl;
+        od << "\tld a0, " << std::to_string(ts) << "(sp)" << std::endl;
+        add(e.second - option_base);
+        od << "\tmv a1, a3" << std::endl;
+        od << "\tli a2, " << std::to_string(var_dims.at(e.first).first - option_base) << std::endl;
+        od << "\tcall ARRAY__walk1" << std::endl;
+        od << "\tblt a0, zero, " << skip << std::endl;
+    }
+    if (vector) {
+        rvv_loop(s, ts, te, ti);
+        // the elements hold the argument of the function
+        if (!s.func.empty()) {
+            od << "\tld a0, " << std::to_string(ts) << "(sp)" << std::endl;
+            add(s.elements.front().second - option_base);
+            array_element(s.elements.front().first, true);
+            od << "\tmv a1, a0" << std::endl;
+            od << "\tld a2, " << std::to_string(te) << "(sp)" << std::endl;
+            od << "\tld a3, " << std::to_string(ts) << "(sp)" << std::endl;
+            od << "\tsub a2, a2, a3" << std::endl;
+            od << "\taddi a2, a2, 1" << std::endl;
+            od << "\tcall " << s.func << (features.fastmath ? "__vfast" : "__v") << std::endl;
+        }
+    } else if (s.value) {
+        od << "\tld a0, " << std::to_string(ts) << "(sp)" << std::endl;
+        add(s.elements.back().second - option_base);
+        array_element(s.elements.back().first, true);
+        od << "\tmv a3, a0" << std::endl;
+    }
+    if (!vector) {
+        od << "\tld a0, " << std::to_string(ts) << "(sp)" << std::endl;
+        add(s.elements.front().second - option_base);
+        array_element(s.elements.front().first, true);
+        if (s.value) {
+            od << "\tmv a1, a3" << std::endl;
+            od << "\tld a2, " << std::to_string(te) << "(sp)" << std::endl;
+            od << "\tld a3, " << std::to_string(ts) << "(sp)" << std::endl;
+            od << "\tsub a2, a2, a3" << std::endl;
+            od << "\taddi a2, a2, 1" << std::endl;
+            od << "\tcall " << s.func << (features.fastmath ? "__vfast" : "__v") << std::endl;
+        } else {
+            od << "\tld a1, " << std::to_string(te) << "(sp)" << std::endl;
+            od << "\tld a3, " << std::to_string(ts) << "(sp)" << std::endl;
+            od << "\tsub a1, a1, a3" << std::endl;
+            od << "\taddi a1, a1, 1" << std::endl;
+            od << "\tcall RND__fill" << std::endl;
+        }
+    }
+    // every iteration is done, the loop ends at its first test
+    od << "\tld a0, " << std::to_string(te) << "(sp)" << std::endl;
+    od << "\taddi a0, a0, 1" << std::endl;
+    if (infer_int(vn)) {
+        store_var(vn, NUMBERL);
+    } else {
+        od << "\tfcvt.d.l fa0, a0" << std::endl;
+        store_var(vn, NUMBERD);
+    }
+    od << skip << ":" << std::endl;
+}
+
 void asm_for_cond(struct exp_t *var, long lv0, long lv1, const std::string &end) {
+    if (auto vn = is_simple_var(var); vn && infer_int(*vn)) {
+        eval_val(var, false);
+        od << "\tld a1, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+        od << "\tsub a0, a0, a1" << std::endl;
+        // negate the distance to the limit if the step is negative
+        od << "\tld a2, " << std::to_string(loop_slot(lv1)) << "(sp)" << std::endl;
+        od << "\tsrai a2, a2, 63" << std::endl;
+        od << "\txor a0, a0, a2" << std::endl;
+        od << "\tsub a0, a0, a2" << std::endl;
+        od << "\tbgtz a0, " << end << std::endl;
+        return;
+    }
     cast(eval_val(var, false), NUMBERD);
-    od << "\tfld fa1, " << std::to_string(get_max_tmp_count() + lv0) << "(sp)" << std::endl;
-    od << "\tfld fa2, " << std::to_string(get_max_tmp_count() + lv1) << "(sp)" << std::endl;
+    od << "\tfld fa1, " << std::to_string(loop_slot(lv0)) << "(sp)" << std::endl;
+    od << "\tfld fa2, " << std::to_string(loop_slot(lv1)) << "(sp)" << std::endl;
     od << "\tfsub.d fa0, fa0, fa1" << std::endl;
     od << "\tli a0, 1" << std::endl;
     od << "\tfcvt.d.l fa3, a0" << std::endl;
@@ -1526,7 +2218,7 @@ void asm_for_cond(struct exp_t *var, long lv0, long lv1, const std::string &end)
     od << "\tbnez a0, " << end << std::endl;
 }
 
-void asm_read(const std::vector<exp_t *> &items) {
+void asm_read(std::span<exp_t *const> items) {
     for (auto &i: items) {
         switch (eval_val(i, true)) {
             case NUMBERL:
@@ -1557,7 +2249,7 @@ void asm_read(const std::vector<exp_t *> &items) {
     }
 }
 
-void asm_input(const std::vector<exp_t *> &items, const std::string &start) {
+void asm_input(std::span<exp_t *const> items, const std::string &start) {
     od << "\tcall INPUT__start" << std::endl;
     std::vector<eval_ret> rt{};
     std::vector<std::pair<eval_ret, long>> tmps{};
@@ -1619,8 +2311,9 @@ void asm_input(const std::vector<exp_t *> &items, const std::string &start) {
     od << "\tcall INPUT__end" << std::endl;
 }
 
-void asm_on_goto(exp_t *v, const std::vector<long> &items) {
+void asm_on_goto(exp_t *v, std::span<const long> items) {
     asm_demote(eval_val(v, false));
+    if (std::any_of(items.begin(), items.end(), regalloc_leaves)) asm_regs_store();
     int ix = 1;
     for (auto el: items) {
         if (auto o = line_in_for(el)) {
@@ -1631,18 +2324,23 @@ void asm_on_goto(exp_t *v, const std::vector<long> &items) {
         od << "\tli a1, " << std::to_string(ix++) << std::endl;
         od << "\tbeq a0, a1, .L" << std::to_string(el) << std::endl;
     }
+    auto tl = line_label();
+    bool moved = !unlikely;
+    if (moved) {
+        od << "\tj " << tl << std::endl;
+        asm_section(true);
+    }
+    od << tl << ":" << std::endl;
     od << "\tli a1, " << std::to_string(items.size()) << std::endl;
     od << "\tli a2, " << std::to_string(line_no) << std::endl;
     od << "\tcall ONGOTO__err_notfound" << std::endl;
+    if (moved) asm_section(false);
 }
 
 void asm_gosub(long d) {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
-    auto tl1 = std::string(".T") + std::to_string(tmp_labels++);
+    auto tl1 = line_label();
     od << "\tli a0, " << std::to_string(gosub_depth) << std::endl;
-    od << "\tbne a0, s2, " << tl << std::endl;
-    od << "\tcall GOSUB__err_overflow" << std::endl;
-    od << tl << ":" << std::endl;
+    error_branch("beq a0, s2, ", "bne a0, s2, ", "GOSUB__err_overflow");
     od << "\tlla a0, " << tl1 << std::endl;
     od << "\tsd a0, 0(s1)" << std::endl;
     od << "\taddi s1, s1, 8" << std::endl;
@@ -1652,10 +2350,7 @@ void asm_gosub(long d) {
 }
 
 void asm_return() {
-    auto tl = std::string(".T") + std::to_string(tmp_labels++);
-    od << "\tbnez s2, " << tl << std::endl;
-    od << "\tcall GOSUB__err_underflow" << std::endl;
-    od << tl << ":" << std::endl;
+    error_branch("beqz s2, ", "bnez s2, ", "GOSUB__err_underflow");
     od << "\taddi s1, s1, -8" << std::endl;
     od << "\taddi s2, s2, -1" << std::endl;
     od << "\tld a0, 0(s1)" << std::endl;
@@ -0,0 +1,1046 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+#include <fenv.h>
+#include <immintrin.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include "amd64.h"
+#include "data.h"
+#include "obj.h"
+
+// Bytecode for --interp: the instructions emitted by asm_amd64.cpp lowered to a register machine with the
+// same 16 integer and 16 xmm registers. Each instruction becomes one bytecode op with its operand forms
+// resolved at translation time: labels become bytecode addresses, RIP-relative operands absolute
+// addresses, external calls function pointers. The interpreter is direct threaded (computed goto).
+
+#define BYTECODE_OPS(X) \
+    X(NOP) X(JMP) X(JCC) X(JMP_R) X(CALL) X(CALL_EXT) X(RET) X(PUSH) X(POP) \
+    X(MOV_RR) X(MOV32_RR) X(MOVP_RR) X(MOV_RI) X(MOVP_RI) \
+    X(LD64) X(LD32) X(LD16) X(LD8) X(ST64) X(ST32) X(ST16) X(ST8) X(STI64) X(STI32) X(STI16) X(STI8) \
+    X(MOVSX8) X(MOVSX16) X(MOVSX32) X(MOVSX8_M) X(MOVSX16_M) X(MOVSX32_M) X(LEA) \
+    X(ADD_RR) X(ADD_RI) X(ADD_RM) X(ADD_MR) X(ADD_MI) \
+    X(SUB_RR) X(SUB_RI) X(SUB_RM) X(SUB_MR) X(SUB_MI) \
+    X(AND_RR) X(AND_RI) X(OR_RR) X(OR_RI) X(XOR_RR) X(XOR_RI) \
+    X(CMP_RR) X(CMP_RI) X(CMP_RM) X(CMP_MR) X(CMP_MI) X(TEST_RR) X(TEST_RI) \
+    X(IMUL_RR) X(IMUL_RM) X(NEG) X(NOT) X(SHL) X(SHR) X(SAR) X(SETCC) \
+    X(MOVQ_XX) X(MOVQ_XM) X(MOVQ_MX) X(MOVQ_XR) X(MOVQ_RX) \
+    X(MOVD_XM) X(MOVD_MX) X(MOVD_XR) X(MOVD_RX) X(MOVSD_XX) X(MOVSS_XX) \
+    X(MOVAPD_XX) X(MOVAPD_XM) X(MOVAPD_MX) \
+    X(ADDSD) X(SUBSD) X(MULSD) X(DIVSD) X(SQRTSD) X(MINSD) X(MAXSD) \
+    X(ADDSS) X(SUBSS) X(MULSS) X(DIVSS) \
+    X(ANDPD) X(ANDNPD) X(ORPD) X(XORPD) X(ADDPD) X(SUBPD) X(MULPD) X(DIVPD) X(UNPCKLPD) X(UNPCKHPD) \
+    X(COMISD) X(UCOMISD) X(COMISS) X(UCOMISS) \
+    X(CVTSI2SD) X(CVTSI2SS) X(CVTSD2SI) X(CVTTSD2SI) X(CVTSS2SI) X(CVTTSS2SI) X(CVTSS2SD) X(CVTSD2SS) \
+    X(ROUNDSD) X(RORX)
+
+#define BYTECODE_ENUM(n) BC_##n,
+enum bc_op_t {
+    BYTECODE_OPS(BYTECODE_ENUM)
+};
+
+struct bc_t {
+    const void *handler;
+    unsigned short op;
+    // register operands (destination first), condition code for JCC/SETCC
+    unsigned char a, b;
+    // memory operand: r[base] + (r[index] << shift) + disp, unused registers are ZERO
+    unsigned char base, index, shift;
+    // access width of memory operands of xmm instructions, m is set for memory operands
+    unsigned char w;
+    bool m;
+    long disp;
+    long imm;
+};
+
+union xmm_t {
+    double d[2];
+    float f[4];
+    long q[2];
+    int i[4];
+};
+
+struct ext_ret_t {
+    long rax;
+    double xmm0;
+};
+
+typedef ext_ret_t (*ext_fn_t)(long, long, long, long, long, long,
+                              double, double, double, double, double, double, double, double);
+
+enum {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSP = 4,
+    RSI = 6,
+    RDI = 7,
+    R8 = 8,
+    R9 = 9,
+    ZERO = 16
+};
+
+enum flags_kind_t {
+    F_SUB,
+    F_ADD,
+    F_LOGIC,
+    F_FP
+};
+
+static bool condition(int cc, int kind, long a, long b, double fa, double fb) {
+    bool zf, cf, sf, of, pf;
+    unsigned long r;
+    switch (kind) {
+        case F_SUB:
+            r = (unsigned long) a - (unsigned long) b;
+            cf = (unsigned long) a < (unsigned long) b;
+            of = ((a ^ b) & (a ^ (long) r)) < 0;
+            break;
+        case F_ADD:
+            r = (unsigned long) a + (unsigned long) b;
+            cf = r < (unsigned long) a;
+            of = (~(a ^ b) & (a ^ (long) r)) < 0;
+            break;
+        case F_LOGIC:
+            r = a;
+            cf = of = false;
+            break;
+        default: {
+            bool un = std::isunordered(fa, fb);
+            zf = un || fa == fb;
+            pf = un;
+            cf = un || std::isless(fa, fb);
+            sf = of = false;
+            goto eval;
+        }
+    }
+    zf = r == 0;
+    sf = (long) r < 0;
+    pf = !__builtin_parity(r & 0xff);
+    eval:
+    switch (cc) {
+        case 0x0:
+            return of;
+        case 0x1:
+            return !of;
+        case 0x2:
+            return cf;
+        case 0x3:
+            return !cf;
+        case 0x4:
+            return zf;
+        case 0x5:
+            return !zf;
+        case 0x6:
+            return cf || zf;
+        case 0x7:
+            return !cf && !zf;
+        case 0x8:
+            return sf;
+        case 0x9:
+            return !sf;
+        case 0xa:
+            return pf;
+        case 0xb:
+            return !pf;
+        case 0xc:
+            return sf != of;
+        case 0xd:
+            return sf == of;
+        case 0xe:
+            return zf || sf != of;
+        default:
+            return !zf && sf == of;
+    }
+}
+
+static std::vector<bc_t> code;
+static std::map<std::string, long> code_labels;
+static obj_t *data_obj;
+static std::vector<unsigned char *> data_base;
+
+static long symbol_address(const std::string &sym) {
+    if (code_labels.contains(sym)) return (long) &code[code_labels[sym]];
+    auto it = data_obj->symbols.find(sym);
+    if (it != data_obj->symbols.end() && it->second.absolute) return it->second.value;
+    if (it != data_obj->symbols.end() && it->second.section >= 0) {
+        if (!data_base[it->second.section]) throw std::runtime_error("cannot address " + sym);
+        return (long) (data_base[it->second.section] + it->second.value);
+    }
+    void *p = dlsym(RTLD_DEFAULT, sym.c_str());
+    if (!p) throw std::runtime_error("undefined reference to " + sym);
+    return (long) p;
+}
+
+static void set_mem(bc_t &bc, const operand_t &o) {
+    bc.m = true;
+    if (o.rip) {
+        bc.base = ZERO;
+        bc.index = ZERO;
+        bc.disp = symbol_address(o.sym) + o.value;
+        return;
+    }
+    bc.base = o.base >= 0 ? o.base : ZERO;
+    bc.index = o.index >= 0 ? o.index : ZERO;
+    bc.shift = o.scale == 8 ? 3 : o.scale == 4 ? 2 : o.scale == 2 ? 1 : 0;
+    bc.disp = o.value;
+}
+
+static long code_target(const operand_t &o) {
+    if (o.kind != OP_LABEL || !code_labels.contains(o.sym) || o.value) {
+        throw std::runtime_error("unsupported branch target");
+    }
+    return (long) &code[code_labels[o.sym]];
+}
+
+static int gpr_size(const std::string &m, const operand_t &s, const operand_t &d, const std::string &base) {
+    if (s.kind == OP_REG && s.reg.size != 16) return s.reg.size;
+    if (d.kind == OP_REG && d.reg.size != 16) return d.reg.size;
+    if (m == base + "b") return 1;
+    if (m == base + "w") return 2;
+    if (m == base + "l" || m == "movd") return 4;
+    if (m == base + "q") return 8;
+    throw std::runtime_error("ambiguous operand size");
+}
+
+static const std::map<std::string, bc_op_t> sse_ops = {
+        {"addsd",    BC_ADDSD},
+        {"subsd",    BC_SUBSD},
+        {"mulsd",    BC_MULSD},
+        {"divsd",    BC_DIVSD},
+        {"sqrtsd",   BC_SQRTSD},
+        {"minsd",    BC_MINSD},
+        {"maxsd",    BC_MAXSD},
+        {"addss",    BC_ADDSS},
+        {"subss",    BC_SUBSS},
+        {"mulss",    BC_MULSS},
+        {"divss",    BC_DIVSS},
+        {"andpd",    BC_ANDPD},
+        {"andnpd",   BC_ANDNPD},
+        {"orpd",     BC_ORPD},
+        {"xorpd",    BC_XORPD},
+        {"addpd",    BC_ADDPD},
+        {"subpd",    BC_SUBPD},
+        {"mulpd",    BC_MULPD},
+        {"divpd",    BC_DIVPD},
+        {"unpcklpd", BC_UNPCKLPD},
+        {"unpckhpd", BC_UNPCKHPD},
+        {"comisd",   BC_COMISD},
+        {"ucomisd",  BC_UCOMISD},
+        {"comiss",   BC_COMISS},
+        {"ucomiss",  BC_UCOMISS},
+        {"cvtss2sd", BC_CVTSS2SD},
+        {"cvtsd2ss", BC_CVTSD2SS},
+};
+
+struct alu_forms_t {
+    bc_op_t rr, ri, rm, mr, mi;
+};
+
+// NOP marks forms that are never emitted
+static const std::map<std::string, alu_forms_t> alu_ops = {
+        {"add",  {BC_ADD_RR,  BC_ADD_RI,  BC_ADD_RM, BC_ADD_MR, BC_ADD_MI}},
+        {"sub",  {BC_SUB_RR,  BC_SUB_RI,  BC_SUB_RM, BC_SUB_MR, BC_SUB_MI}},
+        {"and",  {BC_AND_RR,  BC_AND_RI,  BC_NOP,    BC_NOP,    BC_NOP}},
+        {"or",   {BC_OR_RR,   BC_OR_RI,   BC_NOP,    BC_NOP,    BC_NOP}},
+        {"xor",  {BC_XOR_RR,  BC_XOR_RI,  BC_NOP,    BC_NOP,    BC_NOP}},
+        {"cmp",  {BC_CMP_RR,  BC_CMP_RI,  BC_CMP_RM, BC_CMP_MR, BC_CMP_MI}},
+        {"test", {BC_TEST_RR, BC_TEST_RI, BC_NOP,    BC_NOP,    BC_NOP}},
+        {"imul", {BC_IMUL_RR, BC_NOP,     BC_IMUL_RM, BC_NOP,   BC_NOP}},
+};
+
+static bc_t lower(const std::string &m, const std::vector<operand_t> &ops) {
+    bc_t bc{};
+    bc.base = bc.index = ZERO;
+    auto expect = [&](size_t n) {
+        if (ops.size() != n) throw std::runtime_error("wrong number of operands for " + m);
+    };
+    auto is_xmm = [](const operand_t &o) { return o.kind == OP_REG && o.reg.size == 16; };
+    auto op = [&](bc_op_t o) {
+        if (o == BC_NOP) throw std::runtime_error("unsupported operands for " + m);
+        bc.op = o;
+        return bc;
+    };
+    if (m == "ret" || m == "retq") return op(BC_RET);
+    if (m == "nop") return op(BC_NOP);
+    if (m == "call" || m == "callq") {
+        expect(1);
+        if (ops[0].kind != OP_LABEL || ops[0].indirect) throw std::runtime_error("unsupported call");
+        if (code_labels.contains(ops[0].sym)) {
+            bc.imm = code_target(ops[0]);
+            return op(BC_CALL);
+        }
+        bc.imm = symbol_address(ops[0].sym);
+        return op(BC_CALL_EXT);
+    }
+    if (m == "jmp" || m == "jmpq") {
+        expect(1);
+        if (ops[0].indirect) {
+            if (ops[0].kind != OP_REG) throw std::runtime_error("unsupported jump");
+            bc.a = ops[0].reg.num;
+            return op(BC_JMP_R);
+        }
+        bc.imm = code_target(ops[0]);
+        return op(BC_JMP);
+    }
+    if (m[0] == 'j' && amd64_condition_codes.contains(m.substr(1))) {
+        expect(1);
+        bc.b = amd64_condition_codes.at(m.substr(1));
+        bc.imm = code_target(ops[0]);
+        return op(BC_JCC);
+    }
+    if (m.starts_with("set") && amd64_condition_codes.contains(m.substr(3))) {
+        expect(1);
+        if (ops[0].kind != OP_REG || ops[0].reg.size != 1) throw std::runtime_error("unsupported operand for " + m);
+        bc.a = ops[0].reg.num;
+        bc.b = amd64_condition_codes.at(m.substr(3));
+        return op(BC_SETCC);
+    }
+    if (m == "push" || m == "pushq" || m == "pop" || m == "popq") {
+        expect(1);
+        if (ops[0].kind != OP_REG || ops[0].reg.size != 8) throw std::runtime_error("unsupported operand for " + m);
+        bc.a = ops[0].reg.num;
+        return op(m[1] == 'u' ? BC_PUSH : BC_POP);
+    }
+    if (sse_ops.contains(m)) {
+        expect(2);
+        if (!is_xmm(ops[1])) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[1].reg.num;
+        if (ops[0].kind == OP_MEM) set_mem(bc, ops[0]);
+        else if (is_xmm(ops[0])) bc.b = ops[0].reg.num;
+        else throw std::runtime_error("unsupported operands for " + m);
+        bc.w = m.ends_with("pd") ? 16 : (m.ends_with("ss") || m == "cvtss2sd") ? 4 : 8;
+        return op(sse_ops.at(m));
+    }
+    if (m == "roundsd") {
+        expect(3);
+        if (ops[0].kind != OP_IMM || !is_xmm(ops[2])) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[2].reg.num;
+        bc.w = 8;
+        if (ops[1].kind == OP_MEM) set_mem(bc, ops[1]);
+        else if (is_xmm(ops[1])) bc.b = ops[1].reg.num;
+        else throw std::runtime_error("unsupported operands for " + m);
+        bc.imm = ops[0].value;
+        return op(BC_ROUNDSD);
+    }
+    if (m == "rorx" || m == "rorxq") {
+        expect(3);
+        if (ops[0].kind != OP_IMM || ops[1].kind != OP_REG || ops[2].kind != OP_REG || ops[1].reg.size != 8 ||
+            ops[2].reg.size != 8) {
+            throw std::runtime_error("unsupported operands for " + m);
+        }
+        bc.a = ops[2].reg.num;
+        bc.b = ops[1].reg.num;
+        bc.imm = ops[0].value & 63;
+        return op(BC_RORX);
+    }
+    if (m.starts_with("cvtsi2s")) {
+        expect(2);
+        if (!is_xmm(ops[1])) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[1].reg.num;
+        if (ops[0].kind == OP_MEM) {
+            set_mem(bc, ops[0]);
+            bc.w = m.back() == 'l' ? 4 : 8;
+        } else {
+            bc.b = ops[0].reg.num;
+            bc.w = ops[0].reg.size;
+        }
+        return op(m[7] == 'd' ? BC_CVTSI2SD : BC_CVTSI2SS);
+    }
+    if (m == "cvtsd2si" || m == "cvttsd2si" || m == "cvtss2si" || m == "cvttss2si") {
+        expect(2);
+        if (ops[1].kind != OP_REG || is_xmm(ops[1])) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[1].reg.num;
+        bc.w = ops[1].reg.size;
+        if (ops[0].kind == OP_MEM) set_mem(bc, ops[0]);
+        else bc.b = ops[0].reg.num;
+        if (m == "cvtsd2si") return op(BC_CVTSD2SI);
+        if (m == "cvttsd2si") return op(BC_CVTTSD2SI);
+        if (m == "cvtss2si") return op(BC_CVTSS2SI);
+        return op(BC_CVTTSS2SI);
+    }
+    if (m == "movq" || m == "movd" || m == "movsd" || m == "movss" || m == "movapd" || m == "movupd") {
+        expect(2);
+        auto &s = ops[0];
+        auto &d = ops[1];
+        if (is_xmm(s) || is_xmm(d)) {
+            bool q = m == "movq" || m == "movsd";
+            bool packed = m == "movapd" || m == "movupd";
+            if (is_xmm(s)) bc.b = s.reg.num;
+            if (is_xmm(d)) bc.a = d.reg.num;
+            if (is_xmm(s) && is_xmm(d)) {
+                if (packed) return op(BC_MOVAPD_XX);
+                if (m == "movq") return op(BC_MOVQ_XX);
+                if (m == "movsd") return op(BC_MOVSD_XX);
+                if (m == "movss") return op(BC_MOVSS_XX);
+                throw std::runtime_error("unsupported operands for " + m);
+            }
+            if (s.kind == OP_MEM) {
+                set_mem(bc, s);
+                return op(packed ? BC_MOVAPD_XM : q ? BC_MOVQ_XM : BC_MOVD_XM);
+            }
+            if (d.kind == OP_MEM) {
+                set_mem(bc, d);
+                return op(packed ? BC_MOVAPD_MX : q ? BC_MOVQ_MX : BC_MOVD_MX);
+            }
+            if (packed || m == "movsd" || m == "movss") throw std::runtime_error("unsupported operands for " + m);
+            if (is_xmm(d) && s.kind == OP_REG) {
+                bc.b = s.reg.num;
+                return op(s.reg.size == 8 ? BC_MOVQ_XR : BC_MOVD_XR);
+            }
+            if (is_xmm(s) && d.kind == OP_REG) {
+                bc.a = d.reg.num;
+                return op(d.reg.size == 8 ? BC_MOVQ_RX : BC_MOVD_RX);
+            }
+            throw std::runtime_error("unsupported operands for " + m);
+        }
+        if (m != "movq" && m != "movd") throw std::runtime_error("unsupported operands for " + m);
+    }
+    if (m == "mov" || m == "movq" || m == "movl" || m == "movw" || m == "movb" || m == "movd") {
+        expect(2);
+        auto &s = ops[0];
+        auto &d = ops[1];
+        int size = gpr_size(m, s, d, "mov");
+        long mask = size == 8 ? -1 : (1l << (8 * size)) - 1;
+        if (s.kind == OP_IMM) {
+            if (!s.sym.empty()) throw std::runtime_error("unsupported symbolic immediate");
+            bc.imm = s.value;
+            if (d.kind == OP_REG) {
+                bc.a = d.reg.num;
+                if (size >= 4) {
+                    bc.imm &= mask;
+                    return op(BC_MOV_RI);
+                }
+                bc.imm &= mask;
+                bc.disp = mask;
+                return op(BC_MOVP_RI);
+            }
+            set_mem(bc, d);
+            return op(size == 8 ? BC_STI64 : size == 4 ? BC_STI32 : size == 2 ? BC_STI16 : BC_STI8);
+        }
+        if (s.kind == OP_REG && d.kind == OP_REG) {
+            bc.a = d.reg.num;
+            bc.b = s.reg.num;
+            if (size == 8) return op(BC_MOV_RR);
+            if (size == 4) return op(BC_MOV32_RR);
+            bc.disp = mask;
+            return op(BC_MOVP_RR);
+        }
+        if (s.kind == OP_MEM && d.kind == OP_REG) {
+            bc.a = d.reg.num;
+            set_mem(bc, s);
+            return op(size == 8 ? BC_LD64 : size == 4 ? BC_LD32 : size == 2 ? BC_LD16 : BC_LD8);
+        }
+        if (s.kind == OP_REG && d.kind == OP_MEM) {
+            bc.b = s.reg.num;
+            set_mem(bc, d);
+            return op(size == 8 ? BC_ST64 : size == 4 ? BC_ST32 : size == 2 ? BC_ST16 : BC_ST8);
+        }
+        throw std::runtime_error("unsupported operands for " + m);
+    }
+    if (m == "movsx" || m == "movsbq" || m == "movswq" || m == "movsxd" || m == "movslq") {
+        expect(2);
+        if (ops[1].kind != OP_REG || ops[1].reg.size != 8) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[1].reg.num;
+        int ss = ops[0].kind == OP_REG ? ops[0].reg.size : (m == "movsbq" ? 1 : m == "movswq" ? 2 : 4);
+        if (ops[0].kind == OP_MEM) {
+            set_mem(bc, ops[0]);
+            return op(ss == 1 ? BC_MOVSX8_M : ss == 2 ? BC_MOVSX16_M : BC_MOVSX32_M);
+        }
+        bc.b = ops[0].reg.num;
+        return op(ss == 1 ? BC_MOVSX8 : ss == 2 ? BC_MOVSX16 : BC_MOVSX32);
+    }
+    if (m == "lea" || m == "leaq") {
+        expect(2);
+        if (ops[0].kind != OP_MEM || ops[1].kind != OP_REG || ops[1].reg.size != 8) {
+            throw std::runtime_error("unsupported operands for " + m);
+        }
+        bc.a = ops[1].reg.num;
+        set_mem(bc, ops[0]);
+        if (ops[0].rip) {
+            bc.imm = bc.disp;
+            bc.m = false;
+            return op(BC_MOV_RI);
+        }
+        return op(BC_LEA);
+    }
+    std::string base = m;
+    if (!alu_ops.contains(base) && base.size() > 1 && base.back() == 'q') base.pop_back();
+    if (base == "neg" || base == "not") {
+        expect(1);
+        if (ops[0].kind != OP_REG || ops[0].reg.size != 8) throw std::runtime_error("unsupported operands for " + m);
+        bc.a = ops[0].reg.num;
+        return op(base == "neg" ? BC_NEG : BC_NOT);
+    }
+    // inc/dec keep CF on real hardware, the generated code never reads it afterwards
+    if (base == "inc" || base == "dec") {
+        expect(1);
+        bc.imm = base == "inc" ? 1 : -1;
+        if (ops[0].kind == OP_REG && ops[0].reg.size == 8) {
+            bc.a = ops[0].reg.num;
+            return op(BC_ADD_RI);
+        }
+        if (ops[0].kind == OP_MEM && m.back() == 'q') {
+            set_mem(bc, ops[0]);
+            return op(BC_ADD_MI);
+        }
+        throw std::runtime_error("unsupported operands for " + m);
+    }
+    if (base == "shl" || base == "sal" || base == "shr" || base == "sar") {
+        expect(2);
+        if (ops[0].kind != OP_IMM || ops[1].kind != OP_REG || ops[1].reg.size != 8) {
+            throw std::runtime_error("unsupported operands for " + m);
+        }
+        bc.a = ops[1].reg.num;
+        bc.imm = ops[0].value & 63;
+        return op(base == "shr" ? BC_SHR : base == "sar" ? BC_SAR : BC_SHL);
+    }
+    if (alu_ops.contains(base)) {
+        expect(2);
+        auto &forms = alu_ops.at(base);
+        auto &s = ops[0];
+        auto &d = ops[1];
+        if ((s.kind == OP_REG && s.reg.size != 8) || (d.kind == OP_REG && d.reg.size != 8) ||
+            (s.kind != OP_REG && d.kind != OP_REG && m.back() != 'q')) {
+            throw std::runtime_error("unsupported operand size for " + m);
+        }
+        if (s.kind == OP_IMM && !s.sym.empty()) throw std::runtime_error("unsupported symbolic immediate");
+        if (s.kind == OP_REG && d.kind == OP_REG) {
+            bc.a = d.reg.num;
+            bc.b = s.reg.num;
+            return op(forms.rr);
+        }
+        if (s.kind == OP_IMM && d.kind == OP_REG) {
+            bc.a = d.reg.num;
+            bc.imm = s.value;
+            return op(forms.ri);
+        }
+        if (s.kind == OP_MEM && d.kind == OP_REG) {
+            bc.a = d.reg.num;
+            set_mem(bc, s);
+            return op(forms.rm);
+        }
+        if (s.kind == OP_REG && d.kind == OP_MEM) {
+            bc.b = s.reg.num;
+            set_mem(bc, d);
+            return op(forms.mr);
+        }
+        if (s.kind == OP_IMM && d.kind == OP_MEM) {
+            bc.imm = s.value;
+            set_mem(bc, d);
+            return op(forms.mi);
+        }
+    }
+    throw std::runtime_error("unsupported instruction: " + m);
+}
+
+static int interpret(bc_t *pc, long *stack_top) {
+#define BYTECODE_LABEL(n) &&L_##n,
+    static const void *handlers[] = {BYTECODE_OPS(BYTECODE_LABEL)};
+    for (auto &bc: code) bc.handler = handlers[bc.op];
+
+    long r[17] = {};
+    xmm_t x[16] = {};
+    int fk = F_LOGIC;
+    long fa = 0, fb = 0;
+    double fda = 0, fdb = 0;
+    r[RSP] = (long) stack_top;
+    // main returns to a null address
+    r[RSP] -= 8;
+    *(long *) r[RSP] = 0;
+
+#define NEXT goto *(++pc)->handler
+#define ADDR ((char *) (r[pc->base] + (r[pc->index] << pc->shift) + pc->disp))
+#define LOAD(T) ({ T v_; memcpy(&v_, ADDR, sizeof(T)); v_; })
+#define STORE(T, v) do { T v_ = (T) (v); memcpy(ADDR, &v_, sizeof(T)); } while (0)
+#define FLAGS(k, a, b) do { fk = (k); fa = (a); fb = (b); } while (0)
+#define SRC ({ xmm_t s_; if (pc->m) { s_ = {}; memcpy(&s_, ADDR, pc->w); } else s_ = x[pc->b]; s_; })
+#define GSRC ({ long g_; if (pc->m) { g_ = 0; memcpy(&g_, ADDR, pc->w); } else g_ = r[pc->b]; g_; })
+#define UADD(a, b) ((long) ((unsigned long) (a) + (unsigned long) (b)))
+#define USUB(a, b) ((long) ((unsigned long) (a) - (unsigned long) (b)))
+
+    goto *pc->handler;
+
+    L_NOP:
+    NEXT;
+    L_JMP:
+    pc = (bc_t *) pc->imm;
+    goto *pc->handler;
+    L_JCC:
+    if (condition(pc->b, fk, fa, fb, fda, fdb)) {
+        pc = (bc_t *) pc->imm;
+        goto *pc->handler;
+    }
+    NEXT;
+    L_JMP_R:
+    pc = (bc_t *) r[pc->a];
+    goto *pc->handler;
+    L_CALL:
+    r[RSP] -= 8;
+    *(bc_t **) r[RSP] = pc + 1;
+    pc = (bc_t *) pc->imm;
+    goto *pc->handler;
+    L_CALL_EXT: {
+        auto ret = ((ext_fn_t) pc->imm)(r[RDI], r[RSI], r[RDX], r[RCX], r[R8], r[R9],
+                                        x[0].d[0], x[1].d[0], x[2].d[0], x[3].d[0],
+                                        x[4].d[0], x[5].d[0], x[6].d[0], x[7].d[0]);
+        r[RAX] = ret.rax;
+        x[0].d[0] = ret.xmm0;
+        x[0].q[1] = 0;
+        NEXT;
+    }
+    L_RET:
+    pc = *(bc_t **) r[RSP];
+    r[RSP] += 8;
+    if (!pc) return (int) r[RAX];
+    goto *pc->handler;
+    L_PUSH:
+    r[RSP] -= 8;
+    *(long *) r[RSP] = r[pc->a];
+    NEXT;
+    L_POP:
+    r[pc->a] = *(long *) r[RSP];
+    r[RSP] += 8;
+    NEXT;
+
+    L_MOV_RR:
+    r[pc->a] = r[pc->b];
+    NEXT;
+    L_MOV32_RR:
+    r[pc->a] = (unsigned) r[pc->b];
+    NEXT;
+    L_MOVP_RR:
+    r[pc->a] = (r[pc->a] & ~pc->disp) | (r[pc->b] & pc->disp);
+    NEXT;
+    L_MOV_RI:
+    r[pc->a] = pc->imm;
+    NEXT;
+    L_MOVP_RI:
+    r[pc->a] = (r[pc->a] & ~pc->disp) | pc->imm;
+    NEXT;
+    L_LD64:
+    r[pc->a] = LOAD(long);
+    NEXT;
+    L_LD32:
+    r[pc->a] = LOAD(unsigned);
+    NEXT;
+    L_LD16:
+    r[pc->a] = (r[pc->a] & ~0xffffl) | LOAD(unsigned short);
+    NEXT;
+    L_LD8:
+    r[pc->a] = (r[pc->a] & ~0xffl) | LOAD(unsigned char);
+    NEXT;
+    L_ST64:
+    STORE(long, r[pc->b]);
+    NEXT;
+    L_ST32:
+    STORE(unsigned, r[pc->b]);
+    NEXT;
+    L_ST16:
+    STORE(unsigned short, r[pc->b]);
+    NEXT;
+    L_ST8:
+    STORE(unsigned char, r[pc->b]);
+    NEXT;
+    L_STI64:
+    STORE(long, pc->imm);
+    NEXT;
+    L_STI32:
+    STORE(unsigned, pc->imm);
+    NEXT;
+    L_STI16:
+    STORE(unsigned short, pc->imm);
+    NEXT;
+    L_STI8:
+    STORE(unsigned char, pc->imm);
+    NEXT;
+    L_MOVSX8:
+    r[pc->a] = (signed char) r[pc->b];
+    NEXT;
+    L_MOVSX16:
+    r[pc->a] = (short) r[pc->b];
+    NEXT;
+    L_MOVSX32:
+    r[pc->a] = (int) r[pc->b];
+    NEXT;
+    L_MOVSX8_M:
+    r[pc->a] = LOAD(signed char);
+    NEXT;
+    L_MOVSX16_M:
+    r[pc->a] = LOAD(short);
+    NEXT;
+    L_MOVSX32_M:
+    r[pc->a] = LOAD(int);
+    NEXT;
+    L_LEA:
+    r[pc->a] = (long) ADDR;
+    NEXT;
+
+#define ALU_ADD(k, OP, A, B, STORE_R) { long a_ = A, b_ = B; FLAGS(k, a_, b_); STORE_R(OP(a_, b_)); NEXT; }
+#define TO_REG(v) r[pc->a] = (v)
+#define TO_MEM(v) STORE(long, v)
+    L_ADD_RR:
+    ALU_ADD(F_ADD, UADD, r[pc->a], r[pc->b], TO_REG)
+    L_ADD_RI:
+    ALU_ADD(F_ADD, UADD, r[pc->a], pc->imm, TO_REG)
+    L_ADD_RM:
+    ALU_ADD(F_ADD, UADD, r[pc->a], LOAD(long), TO_REG)
+    L_ADD_MR:
+    ALU_ADD(F_ADD, UADD, LOAD(long), r[pc->b], TO_MEM)
+    L_ADD_MI:
+    ALU_ADD(F_ADD, UADD, LOAD(long), pc->imm, TO_MEM)
+    L_SUB_RR:
+    ALU_ADD(F_SUB, USUB, r[pc->a], r[pc->b], TO_REG)
+    L_SUB_RI:
+    ALU_ADD(F_SUB, USUB, r[pc->a], pc->imm, TO_REG)
+    L_SUB_RM:
+    ALU_ADD(F_SUB, USUB, r[pc->a], LOAD(long), TO_REG)
+    L_SUB_MR:
+    ALU_ADD(F_SUB, USUB, LOAD(long), r[pc->b], TO_MEM)
+    L_SUB_MI:
+    ALU_ADD(F_SUB, USUB, LOAD(long), pc->imm, TO_MEM)
+    L_AND_RR:
+    r[pc->a] &= r[pc->b];
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_AND_RI:
+    r[pc->a] &= pc->imm;
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_OR_RR:
+    r[pc->a] |= r[pc->b];
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_OR_RI:
+    r[pc->a] |= pc->imm;
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_XOR_RR:
+    r[pc->a] ^= r[pc->b];
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_XOR_RI:
+    r[pc->a] ^= pc->imm;
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_CMP_RR:
+    FLAGS(F_SUB, r[pc->a], r[pc->b]);
+    NEXT;
+    L_CMP_RI:
+    FLAGS(F_SUB, r[pc->a], pc->imm);
+    NEXT;
+    L_CMP_RM:
+    FLAGS(F_SUB, r[pc->a], LOAD(long));
+    NEXT;
+    L_CMP_MR:
+    FLAGS(F_SUB, LOAD(long), r[pc->b]);
+    NEXT;
+    L_CMP_MI:
+    FLAGS(F_SUB, LOAD(long), pc->imm);
+    NEXT;
+    L_TEST_RR:
+    FLAGS(F_LOGIC, r[pc->a] & r[pc->b], 0);
+    NEXT;
+    L_TEST_RI:
+    FLAGS(F_LOGIC, r[pc->a] & pc->imm, 0);
+    NEXT;
+    L_IMUL_RR:
+    r[pc->a] = (long) ((unsigned long) r[pc->a] * (unsigned long) r[pc->b]);
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_IMUL_RM:
+    r[pc->a] = (long) ((unsigned long) r[pc->a] * (unsigned long) LOAD(long));
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_NEG:
+    FLAGS(F_SUB, 0, r[pc->a]);
+    r[pc->a] = USUB(0, r[pc->a]);
+    NEXT;
+    L_NOT:
+    r[pc->a] = ~r[pc->a];
+    NEXT;
+    L_SHL:
+    r[pc->a] = (long) ((unsigned long) r[pc->a] << pc->imm);
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_SHR:
+    r[pc->a] = (long) ((unsigned long) r[pc->a] >> pc->imm);
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_SAR:
+    r[pc->a] >>= pc->imm;
+    FLAGS(F_LOGIC, r[pc->a], 0);
+    NEXT;
+    L_SETCC:
+    r[pc->a] = (r[pc->a] & ~0xffl) | condition(pc->b, fk, fa, fb, fda, fdb);
+    NEXT;
+
+    L_MOVQ_XX:
+    x[pc->a].q[0] = x[pc->b].q[0];
+    x[pc->a].q[1] = 0;
+    NEXT;
+    L_MOVQ_XM:
+    x[pc->a].q[0] = LOAD(long);
+    x[pc->a].q[1] = 0;
+    NEXT;
+    L_MOVQ_MX:
+    STORE(long, x[pc->b].q[0]);
+    NEXT;
+    L_MOVQ_XR:
+    x[pc->a].q[0] = r[pc->b];
+    x[pc->a].q[1] = 0;
+    NEXT;
+    L_MOVQ_RX:
+    r[pc->a] = x[pc->b].q[0];
+    NEXT;
+    L_MOVD_XM:
+    x[pc->a] = {};
+    x[pc->a].i[0] = LOAD(int);
+    NEXT;
+    L_MOVD_MX:
+    STORE(int, x[pc->b].i[0]);
+    NEXT;
+    L_MOVD_XR:
+    x[pc->a] = {};
+    x[pc->a].i[0] = (int) r[pc->b];
+    NEXT;
+    L_MOVD_RX:
+    r[pc->a] = (unsigned) x[pc->b].i[0];
+    NEXT;
+    L_MOVSD_XX:
+    x[pc->a].q[0] = x[pc->b].q[0];
+    NEXT;
+    L_MOVSS_XX:
+    x[pc->a].i[0] = x[pc->b].i[0];
+    NEXT;
+    L_MOVAPD_XX:
+    x[pc->a] = x[pc->b];
+    NEXT;
+    L_MOVAPD_XM:
+    x[pc->a] = LOAD(xmm_t);
+    NEXT;
+    L_MOVAPD_MX:
+    STORE(xmm_t, x[pc->b]);
+    NEXT;
+
+#define SSE_SD(EXPR) { double a = x[pc->a].d[0], b = SRC.d[0]; x[pc->a].d[0] = (EXPR); NEXT; }
+#define SSE_SS(EXPR) { float a = x[pc->a].f[0], b = SRC.f[0]; x[pc->a].f[0] = (EXPR); NEXT; }
+#define SSE_PD(EXPR) { xmm_t s = SRC; for (int i = 0; i < 2; ++i) { double a = x[pc->a].d[i], b = s.d[i]; x[pc->a].d[i] = (EXPR); } NEXT; }
+#define SSE_PQ(EXPR) { xmm_t s = SRC; for (int i = 0; i < 2; ++i) { long a = x[pc->a].q[i], b = s.q[i]; x[pc->a].q[i] = (EXPR); } NEXT; }
+    L_ADDSD:
+    SSE_SD(a + b)
+    L_SUBSD:
+    SSE_SD(a - b)
+    L_MULSD:
+    SSE_SD(a * b)
+    L_DIVSD:
+    SSE_SD(a / b)
+    L_SQRTSD:
+    SSE_SD(((void) a, _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(b)))))
+    L_MINSD:
+    SSE_SD(_mm_cvtsd_f64(_mm_min_sd(_mm_set_sd(a), _mm_set_sd(b))))
+    L_MAXSD:
+    SSE_SD(_mm_cvtsd_f64(_mm_max_sd(_mm_set_sd(a), _mm_set_sd(b))))
+    L_ADDSS:
+    SSE_SS(a + b)
+    L_SUBSS:
+    SSE_SS(a - b)
+    L_MULSS:
+    SSE_SS(a * b)
+    L_DIVSS:
+    SSE_SS(a / b)
+    L_ANDPD:
+    SSE_PQ(a & b)
+    L_ANDNPD:
+    SSE_PQ(~a & b)
+    L_ORPD:
+    SSE_PQ(a | b)
+    L_XORPD:
+    SSE_PQ(a ^ b)
+    L_ADDPD:
+    SSE_PD(a + b)
+    L_SUBPD:
+    SSE_PD(a - b)
+    L_MULPD:
+    SSE_PD(a * b)
+    L_DIVPD:
+    SSE_PD(a / b)
+    L_UNPCKLPD: {
+        xmm_t s = SRC;
+        x[pc->a].d[1] = s.d[0];
+        NEXT;
+    }
+    L_UNPCKHPD: {
+        xmm_t s = SRC;
+        x[pc->a].d[0] = x[pc->a].d[1];
+        x[pc->a].d[1] = s.d[1];
+        NEXT;
+    }
+    L_COMISD:
+    fda = x[pc->a].d[0];
+    fdb = SRC.d[0];
+    // comisd signals invalid for any NaN, the quiet comparisons in condition() do not
+    if (std::isunordered(fda, fdb)) feraiseexcept(FE_INVALID);
+    fk = F_FP;
+    NEXT;
+    L_UCOMISD:
+    fda = x[pc->a].d[0];
+    fdb = SRC.d[0];
+    fk = F_FP;
+    NEXT;
+    L_COMISS:
+    fda = x[pc->a].f[0];
+    fdb = SRC.f[0];
+    if (std::isunordered(fda, fdb)) feraiseexcept(FE_INVALID);
+    fk = F_FP;
+    NEXT;
+    L_UCOMISS:
+    fda = x[pc->a].f[0];
+    fdb = SRC.f[0];
+    fk = F_FP;
+    NEXT;
+    L_CVTSI2SD: {
+        long v = GSRC;
+        x[pc->a].d[0] = pc->w == 8 ? (double) v : (double) (int) v;
+        NEXT;
+    }
+    L_CVTSI2SS: {
+        long v = GSRC;
+        x[pc->a].f[0] = pc->w == 8 ? (float) v : (float) (int) v;
+        NEXT;
+    }
+    L_CVTSD2SI: {
+        __m128d v = _mm_set_sd(pc->m ? LOAD(double) : x[pc->b].d[0]);
+        r[pc->a] = pc->w == 8 ? _mm_cvtsd_si64(v) : (unsigned) _mm_cvtsd_si32(v);
+        NEXT;
+    }
+    L_CVTTSD2SI: {
+        __m128d v = _mm_set_sd(pc->m ? LOAD(double) : x[pc->b].d[0]);
+        r[pc->a] = pc->w == 8 ? _mm_cvttsd_si64(v) : (unsigned) _mm_cvttsd_si32(v);
+        NEXT;
+    }
+    L_CVTSS2SI: {
+        __m128 v = _mm_set_ss(pc->m ? LOAD(float) : x[pc->b].f[0]);
+        r[pc->a] = pc->w == 8 ? _mm_cvtss_si64(v) : (unsigned) _mm_cvtss_si32(v);
+        NEXT;
+    }
+    L_CVTTSS2SI: {
+        __m128 v = _mm_set_ss(pc->m ? LOAD(float) : x[pc->b].f[0]);
+        r[pc->a] = pc->w == 8 ? _mm_cvttss_si64(v) : (unsigned) _mm_cvttss_si32(v);
+        NEXT;
+    }
+    L_CVTSS2SD:
+    x[pc->a].d[0] = SRC.f[0];
+    NEXT;
+    L_CVTSD2SS:
+    x[pc->a].f[0] = (float) SRC.d[0];
+    NEXT;
+    L_ROUNDSD: {
+        double v = SRC.d[0];
+        switch (pc->imm & 4 ? -1 : pc->imm & 3) {
+            case 1:
+                v = std::floor(v);
+                break;
+            case 2:
+                v = std::ceil(v);
+                break;
+            case 3:
+                v = std::trunc(v);
+                break;
+            default:
+                v = std::nearbyint(v);
+                break;
+        }
+        x[pc->a].d[0] = v;
+        NEXT;
+    }
+    L_RORX:
+    r[pc->a] = (long) std::rotr((unsigned long) r[pc->b], (int) pc->imm);
+    NEXT;
+}
+
+int obj_interpret(const std::string &text) {
+    auto lines = amd64_parse(text);
+    // data sections are laid out by the object assembler
+    auto o = obj_assemble(text);
+    data_obj = &o;
+    data_base.assign(o.sections.size(), nullptr);
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        auto &s = o.sections[i];
+        if (!(s.flags & SHF_ALLOC) || (s.flags & SHF_EXECINSTR)) continue;
+        long a = std::max<long>(16, s.align);
+        auto p = (unsigned char *) aligned_alloc(a, (s.bytes.size() + a) / a * a);
+        memcpy(p, s.bytes.data(), s.bytes.size());
+        data_base[i] = p;
+    }
+
+    // every instruction in an executable section becomes one bytecode op, the sections follow each other like in
+    // the object (.text.unlikely after .text)
+    std::vector<std::string> names{".text"};
+    std::map<std::string, std::vector<const amd64_line_t *>> sections;
+    std::string name = ".text";
+    for (auto &l: lines) {
+        if (l.mnemonic == ".section" || l.mnemonic == ".text" || l.mnemonic == ".data") {
+            name = l.mnemonic == ".section" ? amd64_split_operands(l.args).front() : l.mnemonic;
+            if (name.starts_with(".text") && std::find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
+            }
+        }
+        if (name.starts_with(".text")) sections[name].push_back(&l);
+    }
+    std::vector<const amd64_line_t *> code_lines;
+    for (auto &s: names) {
+        code_lines.insert(code_lines.end(), sections[s].begin(), sections[s].end());
+    }
+    long n = 0;
+    for (auto *l: code_lines) {
+        for (auto &label: l->labels) code_labels[label] = n;
+        if (!l->mnemonic.empty() && l->mnemonic[0] != '.') ++n;
+    }
+    code.assign(n + 1, bc_t{});
+    code[n].op = BC_RET;
+
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        if (!data_base[i]) continue;
+        for (auto &r: o.sections[i].relocs) {
+            long v;
+            if (r.section >= 0) {
+                if (!data_base[r.section]) throw std::runtime_error("unsupported relocation for --interp");
+                v = (long) data_base[r.section] + r.addend;
+            } else {
+                v = symbol_address(r.symbol) + r.addend;
+            }
+            if (r.type == RELOC_ABS64) memcpy(data_base[i] + r.offset, &v, 8);
+            else if (r.type == RELOC_ABS32) memcpy(data_base[i] + r.offset, &v, 4);
+            else throw std::runtime_error("unsupported relocation for --interp");
+        }
+    }
+
+    n = 0;
+    for (auto *l: code_lines) {
+        if (l->mnemonic.empty() || l->mnemonic[0] == '.') continue;
+        try {
+            code[n++] = lower(l->mnemonic, l->ops);
+        } catch (const std::runtime_error &e) {
+            throw std::runtime_error("assembly line " + std::to_string(l->line) + ": " + e.what() + " (" + l->text + ")");
+        }
+    }
+
+    if (o.symbols.contains("DATA__begin")) {
+        DATA__jit_begin = (struct dt **) symbol_address("DATA__begin");
+        DATA__jit_end = (struct dt **) symbol_address("DATA__end");
+    }
+    if (!code_labels.contains("main")) throw std::runtime_error("undefined reference to main");
+    const long stack_size = 8l << 20;
+    auto stack = (char *) mmap(nullptr, stack_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) throw std::runtime_error("cannot map stack for --interp");
+    fesetenv(FE_DFL_ENV);
+    return interpret(&code[code_labels["main"]], (long *) (stack + stack_size));
+}
@@ -10,8 +10,20 @@ struct dt {
     char s[];
 };
 
+#ifdef SMOLBASIC55_JIT
+#include "data.h"
+
+// set by the JIT loader, the generated code is not linked against the compiler
+struct dt **DATA__jit_begin;
+struct dt **DATA__jit_end;
+#define DATA_BEGIN DATA__jit_begin
+#define DATA_END DATA__jit_end
+#else
 extern struct dt *DATA__begin;
 extern struct dt *DATA__end;
+#define DATA_BEGIN (&DATA__begin)
+#define DATA_END (&DATA__end)
+#endif
 
 static long ix = 0;
 
@@ -20,12 +32,12 @@ void RESTORE() {
 }
 
 void READ__numberd(double* f) {
-    long count = &DATA__end - &DATA__begin;
+    long count = DATA_END - DATA_BEGIN;
     if(ix < 0 || ix >= count) {
         fprintf(stderr, "error: insufficient data for READ\n");
         exit(1);
     }
-    struct dt *d = *(&DATA__begin + (ix++));
+    struct dt *d = *(DATA_BEGIN + (ix++));
     double v = d->n;
     if(isnan(v)) {
         // fprintf(stderr, "error: reading string into numeric variable (%s)\n", d->s);
@@ -36,10 +48,10 @@ void READ__numberd(double* f) {
 }
 
 void READ__string(char** c) {
-    long count = &DATA__end - &DATA__begin;
+    long count = DATA_END - DATA_BEGIN;
     if(ix < 0 || ix >= count) {
         fprintf(stderr, "OUT OF NUMBER DATA\n");
         exit(1);
     }
-    *c = (&DATA__begin)[ix++]->s;
+    *c = DATA_BEGIN[ix++]->s;
 }
@@ -0,0 +1,21 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_DATA_H
+#define SMOLBASIC55_DATA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct dt;
+
+// the DATA__begin and DATA__end symbols of the loaded program, set by --run and --interp before it starts
+extern struct dt **DATA__jit_begin;
+extern struct dt **DATA__jit_end;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SMOLBASIC55_DATA_H
@@ -2,6 +2,7 @@
 // Licensed under the EUPL-1.2
 
 #include <cassert>
+#include <cstring>
 #include <optional>
 #include <set>
 #include <array>
@@ -10,18 +11,22 @@
 #include "eval.h"
 #include "asm.h"
 #include "features.h"
+#include "infer.h"
+#include "licm.h"
+#include "regalloc.h"
 
-bool pval = false;
-bool skip_val = false;
-char comma_sig[9];
-std::map<std::string, long> local_variables{};
-std::optional<std::string> current_def = std::nullopt;
+// state of the line being emitted, lines may be emitted on several threads
+thread_local bool pval = false;
+thread_local bool skip_val = false;
+thread_local char comma_sig[9];
+thread_local std::map<std::string, long> local_variables{};
+thread_local std::optional<std::string> current_def = std::nullopt;
 std::map<std::string, std::array<char, 9>> defns{};
 std::map<std::string, std::pair<long, long>> var_dims{};
 std::map<long, std::string> string_map;
 std::vector<std::pair<double, std::string>> data_items{};
 std::set<std::string_view> promoting_funcs = {"ABS", "ATN", "COS", "EXP", "INT", "LOG", "SGN", "SIN", "SQR", "TAN"};
-env_t env;
+thread_local env_t env;
 long string_ix = 0;
 std::map<std::string, long> string_buf{};
 std::map<std::string_view, eval_ret> known_funcs = {
@@ -29,11 +34,22 @@ std::map<std::string_view, eval_ret> known_funcs = {
 };
 long option_base = 0;
 long tmp_labels = 0;
-long line_no;
+thread_local long line_labels = 0;
+thread_local long line_copy = 0;
+thread_local long line_no;
 
-std::deque<std::tuple<exp_t *, std::string, std::string, long, long>> for_stack{};
+std::deque<std::pair<exp_t *, long>> for_stack{};
 std::vector<std::pair<long, long>> for_blocks{};
 
+// labels allocated while emitting a line are numbered per line, so the output does not depend on the
+// order in which lines are emitted
+std::string line_label() {
+    if (line_copy) {
+        return ".T" + std::to_string(line_no) + "_" + std::to_string(line_copy) + "_" + std::to_string(line_labels++);
+    }
+    return ".T" + std::to_string(line_no) + "_" + std::to_string(line_labels++);
+}
+
 std::optional<std::pair<long, long>> line_in_for(long l) {
     for (auto &p: for_blocks) {
         auto [s, e] = p;
@@ -130,6 +146,163 @@ void eval_args(struct exp_t *exp) {
     comma_sig[1] = 0;
 }
 
+// the checks and analysis hooks of eval_val in the same order, without types or temporaries. Errors that need the
+// type of an operand (DEREF of a non-pointer, too many call arguments) are left to emission.
+void eval_scan(struct exp_t *exp, bool as_reference) {
+    if (!as_reference) licm_visit(exp);
+    if (!exp) {
+        throw std::runtime_error("syntax error");
+    } else if (exp->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(exp->data);
+        switch (v->type) {
+            case val_t::L:
+            case val_t::F:
+                ASSERT(!as_reference);
+                eval_ret_from_suffix(v->suffix);
+                return;
+            case val_t::N:
+                if (local_variables.contains(v->ns)) {
+                    eval_ret_from_suffix(v->suffix);
+                    return;
+                } else if (defns.contains(v->ns)) {
+                    if (current_def && *current_def == v->ns) {
+                        throw std::runtime_error("undefined function " + *current_def);
+                    }
+                    if (strlen(defns.at(v->ns).data()) != 0) {
+                        throw std::runtime_error("invalid number of arguments for function " + std::string(v->ns));
+                    }
+                    eval_ret_from_suffix(v->suffix);
+                    return;
+                } else if (known_funcs.contains(v->ns)) {
+                    return;
+                } else if (promoting_funcs.contains(v->ns)) {
+                    throw std::runtime_error("syntax error");
+                } else if (!is_var_name(v->ns)) {
+                    if (!features.external) throw std::runtime_error("undefined function " + current_def.value_or(""));
+                    eval_ret_from_suffix(v->suffix);
+                    return;
+                }
+                if (var_dims.contains(v->ns)) {
+                    auto p = var_dims.at(v->ns);
+                    ASSERT(!p.first && !p.second);
+                }
+                if (!var_dims.contains(v->ns)) var_dims[v->ns] = std::make_pair(0, 0);
+                regalloc_use(v->ns, as_reference);
+                if (as_reference) {
+                    infer_ref(v->ns);
+                    licm_write(v->ns);
+                }
+                eval_ret_from_var(v->ns);
+                return;
+            case val_t::S:
+                ASSERT(!as_reference);
+                if (!string_buf.contains(std::string(v->ns))) {
+                    for (char *c = v->ns; *c != 0; ++c) {
+                        if (islower(*c)) {
+                            throw std::runtime_error("invalid characters found");
+                        }
+                    }
+                    string_map[string_ix] = v->ns;
+                    string_buf[v->ns] = string_ix++;
+                }
+                return;
+        }
+        return;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op == ':') {
+        if (!o->left) {
+            eval_scan(o->right, as_reference);
+            return;
+        }
+        auto v = is_name(o->left);
+        if (!v) throw std::runtime_error("syntax error");
+        if (is_var_name(*v)) {
+            std::string vn = std::string(*v);
+            auto *op = o->right->type == exp_t::OP ? reinterpret_cast<op_t *>(o->right->data) : nullptr;
+            bool two = op && op->op == ',';
+            if (two) ASSERT(!is_comma(op->left) && !is_comma(op->right));
+            if (var_dims.contains(vn)) {
+                auto p = var_dims.at(vn);
+                if (p.first == 0 || (p.second != 0) != two) {
+                    throw std::runtime_error("type mismatch for variable " + vn + "\n info: it was previously used or DIM as a "
+                                             + (two ? "one" : "two") + "-dimension array");
+                }
+            } else {
+                if (isdigit(vn[1])) {
+                    throw std::runtime_error("numeric variable used as array " + vn);
+                }
+                var_dims[vn] = std::make_pair(10, two ? 10 : 0);
+            }
+            licm_array(exp);
+            if (two) {
+                eval_scan(op->left, false);
+                eval_scan(op->right, false);
+            } else {
+                eval_scan(o->right, false);
+            }
+            eval_ret_from_suffix(vn.back());
+            return;
+        }
+        if (v->starts_with("DEREF")) {
+            eval_scan(o->right, false);
+            if (as_reference) eval_ret_from_suffix(v->back());
+            return;
+        }
+        ASSERT(!as_reference);
+        if (*v == "PTR") {
+            eval_scan(o->right, true);
+            return;
+        }
+        // the arguments like eval_args
+        auto *a = o->right;
+        while (a && a->type == exp_t::OP && reinterpret_cast<op_t *>(a->data)->op == ',') {
+            auto *c = reinterpret_cast<op_t *>(a->data);
+            eval_scan(c->left, false);
+            a = c->right;
+        }
+        if (a) eval_scan(a, false);
+        if ((env == PRINT && *v == "TAB") || v->starts_with("CAST")) return;
+        if (current_def && *current_def == *v) {
+            throw std::runtime_error("undefined function " + *current_def);
+        }
+        if (v->size() == 3 && (*v)[0] == 'F' && (*v)[1] == 'N') {
+            if (!defns.contains(std::string(*v)) && !features.external) {
+                throw std::runtime_error("undefined function " + std::string(*v));
+            }
+        }
+        if (!known_funcs.contains(*v)) eval_ret_from_suffix(v->back());
+        return;
+    }
+    ASSERT(!as_reference);
+    if (o->op == '+' && !o->left) {
+        eval_scan(o->right, false);
+    } else if ((o->op == '<' && o->left) || (o->op == '=' && o->left && o->right) || (o->op == '>' && o->left && o->right)
+               || (o->op == '-' && o->left) || ((o->op == '+' || o->op == '*' || o->op == '/' || o->op == '^')
+                                                && o->left && o->right)) {
+        // the right operand is evaluated first, see asm_eval_cmp_exp and asm_eval_math
+        auto [l, r] = std::pair{o->left, o->right};
+        if (o->op == '<' && o->right && o->right->type == exp_t::OP) {
+            auto *o1 = reinterpret_cast<op_t *>(o->right->data);
+            if (o1->op == '>' && !o1->left && o1->right) r = o1->right;
+        } else if (o->op == '=' && o->left->type == exp_t::OP) {
+            auto *o1 = reinterpret_cast<op_t *>(o->left->data);
+            if ((o1->op == '>' || o1->op == '<') && !o1->right && o1->left) l = o1->left;
+        }
+        eval_scan(r, false);
+        eval_scan(l, false);
+    } else if (o->op == '-') {
+        eval_scan(o->right, false);
+    } else {
+        throw std::runtime_error("syntax error");
+    }
+}
+
+eval_ret eval_ret_from_var(std::string_view name) {
+    if (infer_int(name)) return NUMBERL;
+    return eval_ret_from_suffix(name.back());
+}
+
 eval_ret eval_ret_from_suffix(char c) {
     if (features.type == 0) {
         if (c == '$') return STRING;
@@ -156,6 +329,24 @@ eval_ret eval_ret_from_suffix(char c) {
     }
 }
 
+long eval_ret_size(eval_ret r) {
+    switch (r) {
+        case NUMBERC:
+            return 1;
+        case NUMBERS:
+            return 2;
+        case NUMBERI:
+        case NUMBERF:
+            return 4;
+        case NUMBERL:
+        case NUMBERD:
+        case STRING:
+        case NUMBERP:
+            return 8;
+    }
+    return 8;
+}
+
 eval_ret eval_ret_from_comma(char c) {
     switch (c) {
         case 'c':
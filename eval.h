@@ -28,6 +28,10 @@ enum eval_ret {
 
 eval_ret eval_ret_from_suffix(char c);
 eval_ret eval_ret_from_comma(char c);
+// type of a scalar variable, NUMBERL for variables found by --infer-int
+eval_ret eval_ret_from_var(std::string_view name);
+// storage size of a variable or array element
+long eval_ret_size(eval_ret r);
 
 enum env_t {
     PRINT, OTHER
@@ -41,29 +45,35 @@ enum eval_cmp_op {
     GT
 };
 
-extern env_t env;
-extern bool pval;
-extern bool skip_val;
+extern thread_local env_t env;
+extern thread_local bool pval;
+extern thread_local bool skip_val;
 extern std::map<std::string, std::pair<long, long>> var_dims;
 extern std::map<long, std::string> string_map;
 extern std::vector<std::pair<double, std::string>> data_items;
-extern std::map<std::string, long> local_variables;
-extern std::optional<std::string> current_def;
+extern thread_local std::map<std::string, long> local_variables;
+extern thread_local std::optional<std::string> current_def;
 extern std::map<std::string, std::array<char, 9>> defns;
-extern env_t env;
 extern long string_ix;
 extern std::map<std::string, long> string_buf;
 extern std::map<std::string_view, eval_ret> known_funcs;
 extern std::set<std::string_view> promoting_funcs;
 extern long option_base;
 extern long tmp_labels;
-extern long line_no;
-extern std::deque<std::tuple<exp_t *, std::string, std::string, long, long>> for_stack;
+extern thread_local long line_labels;
+// copy of the current line emitted by an unrolled loop (0 for the line itself), it does not define .L labels again
+extern thread_local long line_copy;
+extern thread_local long line_no;
+// control variable and line of the open FOR loops, innermost first
+extern std::deque<std::pair<exp_t *, long>> for_stack;
 extern std::vector<std::pair<long, long>> for_blocks;
 
 
 void smolmath_log_od(struct exp_t *root);
 void eval_args(struct exp_t *exp);
+// walks an expression for the checks and analyses of the parser, the code is emitted by eval_val
+void eval_scan(struct exp_t *exp, bool as_reference);
 std::optional<std::pair<long, long>> line_in_for(long l);
+std::string line_label();
 
 #endif //SMOLBASIC55_EVAL_H
@@ -5,6 +5,7 @@
 
 struct features_t features = {
         .external = 0,
+        .fastmath = 0,
         .fulldef = 0,
         .inline_asm = 0,
         .noend = 0,
@@ -6,6 +6,7 @@
 
 struct features_t {
     int external;
+    int fastmath;
     int fulldef;
     int inline_asm;
     int noend;
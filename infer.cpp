@@ -0,0 +1,209 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "infer.h"
+#include "eval.h"
+#include "options.h"
+#include "util.h"
+
+struct def_t {
+    long line;
+    struct exp_t *exp;
+    // FOR only
+    struct exp_t *limit;
+    struct exp_t *step;
+    bool is_for;
+};
+
+struct range_t {
+    double lo;
+    double hi;
+
+    bool operator==(const range_t &) const = default;
+};
+
+// 2^53, every integer below is exact as a double. A bound that reaches it may be a rounded larger one
+static constexpr double max_int = 9007199254740992.0;
+// a variable whose range keeps growing is not an integer of bounded size
+static constexpr int max_growth = 16;
+
+static std::map<std::string, std::vector<def_t>, std::less<>> defs{};
+static std::set<std::string, std::less<>> refs{};
+static std::vector<std::pair<long, long>> jumps{};
+static std::set<long> gosubs{};
+static bool barrier = false;
+static bool collect = true;
+static std::map<std::string, range_t, std::less<>> ranges{};
+thread_local bool infer_literals = false;
+
+infer_literals_t::infer_literals_t(bool on) : outer(infer_literals) {
+    infer_literals = on;
+}
+
+infer_literals_t::~infer_literals_t() {
+    infer_literals = outer;
+}
+
+static bool candidate(std::string_view var) {
+    return is_var_name(var) && !is_suffix(var.back()) && eval_ret_from_suffix(var.back()) == NUMBERD;
+}
+
+void infer_let(std::string_view var, struct exp_t *exp) {
+    if (!options.infer_int || !collect || !candidate(var)) return;
+    defs[std::string(var)].push_back({line_no, exp, nullptr, nullptr, false});
+}
+
+void infer_for(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step) {
+    auto vn = is_simple_var(var);
+    if (!options.infer_int || !collect || !vn || !candidate(*vn)) return;
+    defs[std::string(*vn)].push_back({line_no, init, limit, step, true});
+}
+
+void infer_ref(std::string_view var) {
+    if (!options.infer_int || !collect) return;
+    refs.emplace(var);
+}
+
+void infer_jump(long to) {
+    if (!options.infer_int || !collect) return;
+    jumps.emplace_back(line_no, to);
+}
+
+void infer_gosub() {
+    if (!options.infer_int || !collect) return;
+    gosubs.insert(line_no);
+}
+
+void infer_barrier() {
+    if (!options.infer_int || !collect) return;
+    barrier = true;
+}
+
+static std::optional<range_t> range(struct exp_t *exp);
+
+static std::optional<range_t> bounded(range_t r) {
+    if (r.lo <= -max_int || r.hi >= max_int) return std::nullopt;
+    return r;
+}
+
+static std::optional<range_t> range_op(struct op_t *o) {
+    if (o->op == ':' && !o->left) return range(o->right);
+    if (!o->right) return std::nullopt;
+    auto r = range(o->right);
+    if (!r) return std::nullopt;
+    if (!o->left) {
+        if (o->op == '+') return r;
+        if (o->op == '-') return range_t{-r->hi, -r->lo};
+        return std::nullopt;
+    }
+    auto l = range(o->left);
+    if (!l) return std::nullopt;
+    switch (o->op) {
+        case '+':
+            return bounded({l->lo + r->lo, l->hi + r->hi});
+        case '-':
+            return bounded({l->lo - r->hi, l->hi - r->lo});
+        case '*': {
+            double p[] = {l->lo * r->lo, l->lo * r->hi, l->hi * r->lo, l->hi * r->hi};
+            return bounded({*std::min_element(p, p + 4), *std::max_element(p, p + 4)});
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+static std::optional<range_t> range(struct exp_t *exp) {
+    if (!exp) return std::nullopt;
+    if (exp->type == exp_t::OP) return range_op(reinterpret_cast<op_t *>(exp->data));
+    auto *v = reinterpret_cast<val_t *>(exp->data);
+    switch (v->type) {
+        case val_t::L:
+            if (eval_ret_from_suffix(v->suffix) != NUMBERD) return std::nullopt;
+            return bounded({(double) v->l, (double) v->l});
+        case val_t::N: {
+            if (local_variables.contains(v->ns)) return std::nullopt;
+            auto it = ranges.find(std::string_view(v->ns));
+            if (it == ranges.end()) return std::nullopt;
+            return it->second;
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+// values a FOR loop gives its control variable. If no LET assigns the variable, the body can only be entered
+// through the FOR line and calls no subroutine (that could run another FOR of the variable), the variable
+// passed the limit test before every step.
+static std::optional<range_t> range_for(const def_t &d, const range_t &var, bool sealed) {
+    auto a = range(d.exp);
+    auto b = range(d.limit);
+    auto s = d.step ? range(d.step) : std::optional<range_t>{{1, 1}};
+    if (!a || !b || !s) return std::nullopt;
+    if (sealed) {
+        auto block = std::find_if(for_blocks.cbegin(), for_blocks.cend(), [&d](auto &p) {
+            return p.first == d.line;
+        });
+        sealed = block != for_blocks.cend() && std::none_of(jumps.cbegin(), jumps.cend(), [block](auto &j) {
+            return (j.first < block->first || j.first > block->second)
+                   && j.second > block->first && j.second <= block->second;
+        }) && gosubs.lower_bound(block->first) == gosubs.upper_bound(block->second);
+    }
+    range_t before = sealed ? range_t{std::min(a->lo, b->lo), std::max(a->hi, b->hi)} : var;
+    return bounded({std::min(a->lo, before.lo + s->lo), std::max(a->hi, before.hi + s->hi)});
+}
+
+void infer_run() {
+    collect = false;
+    if (!options.infer_int || barrier) return;
+    for (auto &[v, d]: defs) {
+        if (!refs.contains(v)) ranges[v] = {0, 0};
+    }
+    std::map<std::string, int, std::less<>> growth;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = ranges.begin(); it != ranges.end();) {
+            auto &ds = defs.at(it->first);
+            bool lets = std::any_of(ds.cbegin(), ds.cend(), [](auto &d) { return !d.is_for; });
+            std::optional<range_t> r = it->second;
+            for (auto &d: ds) {
+                auto n = d.is_for ? range_for(d, it->second, !lets) : range(d.exp);
+                if (!n) {
+                    r = std::nullopt;
+                    break;
+                }
+                r = {std::min(r->lo, n->lo), std::max(r->hi, n->hi)};
+            }
+            if (r && *r == it->second) {
+                ++it;
+                continue;
+            }
+            changed = true;
+            if (!r || ++growth[it->first] > max_growth) {
+                it = ranges.erase(it);
+            } else {
+                it->second = *r;
+                ++it;
+            }
+        }
+    }
+}
+
+bool infer_int(std::string_view var) {
+    return ranges.contains(var);
+}
+
+bool infer_safe(struct exp_t *exp) {
+    return !ranges.empty() && range(exp).has_value();
+}
+
+bool infer_safe_op(struct op_t *o) {
+    return !ranges.empty() && range_op(o).has_value();
+}
+
+bool infer_exact(struct exp_t *exp) {
+    return range(exp).has_value();
+}
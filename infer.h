@@ -0,0 +1,39 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_INFER_H
+#define SMOLBASIC55_INFER_H
+
+#include <string_view>
+
+// --infer-int: untyped scalar variables that are only ever assigned integers of at most 53 bits are stored and
+// computed as NUMBERL. Doubles hold these values exactly, so the program prints the same.
+
+// definitions are collected while the lines are scanned
+void infer_let(std::string_view var, struct exp_t *exp);
+void infer_for(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step);
+void infer_ref(std::string_view var);
+void infer_jump(long to);
+void infer_gosub();
+// the program writes variables behind the back of the compiler (inline assembly)
+void infer_barrier();
+
+void infer_run();
+bool infer_int(std::string_view var);
+// the expression only involves integer constants and inferred variables, and stays within 53 bits
+bool infer_safe(struct exp_t *exp);
+bool infer_safe_op(struct op_t *o);
+// the expression is an integer of at most 53 bits (without --infer-int only for constants)
+bool infer_exact(struct exp_t *exp);
+
+// integer constants evaluate to NUMBERL while an infer_literals_t is alive
+extern thread_local bool infer_literals;
+
+class infer_literals_t {
+    bool outer;
+public:
+    explicit infer_literals_t(bool on);
+    ~infer_literals_t();
+};
+
+#endif //SMOLBASIC55_INFER_H
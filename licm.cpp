@@ -0,0 +1,410 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include "licm.h"
+#include "slots.h"
+#include "infer.h"
+#include "util.h"
+
+struct block_t {
+    long first;
+    long last;
+    // variables assigned by the lines of the block
+    std::set<std::string, std::less<>> writes;
+    // the body is only entered through the FOR line and calls no subroutine
+    bool sealed;
+};
+
+struct licm_for_t {
+    struct exp_t *var;
+    struct exp_t *init;
+    struct exp_t *step;
+};
+
+struct walk_entry_t {
+    long first;
+    long last;
+    licm_walk_t walk;
+};
+
+struct hoist_entry_t {
+    long first;
+    long last;
+    licm_hoist_t hoist;
+};
+
+// builtins without side effects that are defined for every argument
+static const std::set<std::string_view> pure_funcs = {"ABS", "ATN", "COS", "INT", "SGN", "SIN", "TAN"};
+
+static bool collect = true;
+static std::vector<std::pair<long, struct exp_t *>> visits{};
+static std::set<struct exp_t *> visited{};
+static std::map<long, std::set<std::string, std::less<>>> writes{};
+static std::vector<std::pair<long, long>> jumps{};
+// lines that may not continue with the next one
+static std::set<long> branches{};
+static std::set<long> gosubs{};
+static std::set<long> barriers{};
+static std::map<struct exp_t *, hoist_entry_t> hoisted{};
+static std::map<long, std::vector<licm_hoist_t>> preheaders{};
+static std::vector<std::pair<long, struct exp_t *>> arrays{};
+static std::map<long, licm_for_t> fors{};
+static std::map<struct exp_t *, walk_entry_t> walking{};
+static std::map<long, std::vector<licm_walk_t>> walks{};
+static std::vector<block_t> blocks{};
+
+void licm_visit(struct exp_t *exp) {
+    if (!collect || !exp || visited.contains(exp)) return;
+    visited.insert(exp);
+    visits.emplace_back(line_no, exp);
+}
+
+void licm_array(struct exp_t *exp) {
+    if (!collect) return;
+    arrays.emplace_back(line_no, exp);
+}
+
+void licm_for(struct exp_t *var, struct exp_t *init, struct exp_t *step) {
+    if (!collect) return;
+    fors[line_no] = {var, init, step};
+}
+
+void licm_write(std::string_view var) {
+    if (!collect) return;
+    writes[line_no].emplace(var);
+}
+
+void licm_jump(long to) {
+    if (!collect) return;
+    jumps.emplace_back(line_no, to);
+    branches.insert(line_no);
+}
+
+void licm_leave() {
+    if (!collect) return;
+    branches.insert(line_no);
+}
+
+void licm_gosub() {
+    if (!collect) return;
+    gosubs.insert(line_no);
+}
+
+// the line cannot be part of a loop that hoists (DEF, inline assembly)
+void licm_barrier() {
+    if (!collect) return;
+    barriers.insert(line_no);
+}
+
+// untyped constants and variables not assigned in the loop, combined by +, - and * or a pure builtin.
+// Division, powers and most functions can fail, hoisting them could report an error the loop never reaches.
+// The others can still overflow and raise FP flags that the next checked operation reports, see reached.
+static bool invariant(struct exp_t *exp, const block_t &b) {
+    if (!exp) return false;
+    if (exp->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(exp->data);
+        switch (v->type) {
+            case val_t::L:
+            case val_t::F:
+                return eval_ret_from_suffix(v->suffix) == NUMBERD;
+            case val_t::N:
+                return is_var_name(v->ns) && !is_suffix(std::string_view(v->ns).back())
+                       && !b.writes.contains(v->ns);
+            default:
+                return false;
+        }
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    switch (o->op) {
+        case '+':
+        case '-':
+            return (!o->left || invariant(o->left, b)) && invariant(o->right, b);
+        case '*':
+            return o->left && invariant(o->left, b) && invariant(o->right, b);
+        case ':': {
+            if (!o->left) return invariant(o->right, b);
+            auto n = is_name(o->left);
+            return n && pure_funcs.contains(*n) && !is_comma(o->right) && invariant(o->right, b);
+        }
+        default:
+            return false;
+    }
+}
+
+// every iteration of the block runs line l: no line of the body before it may jump or leave, and it is not
+// inside a loop nested in the block. The FOR line computes the hoisted expressions once the limit test passed,
+// so they only raise the FP flags that the first iteration raises as well.
+static bool reached(long l, const block_t &b) {
+    if (branches.upper_bound(b.first) != branches.lower_bound(l)) return false;
+    return std::none_of(blocks.cbegin(), blocks.cend(), [l, &b](auto &c) {
+        return c.first > b.first && c.first < l && c.last >= l;
+    });
+}
+
+// reading a slot only pays off for an operation, not for a constant or a variable
+static bool worth(struct exp_t *exp) {
+    if (exp->type != exp_t::OP) return false;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op == ':' && !o->left) return o->right && worth(o->right);
+    return true;
+}
+
+static bool same(struct exp_t *a, struct exp_t *b) {
+    if (!a || !b) return a == b;
+    if (a->type != b->type) return false;
+    if (a->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(a->data);
+        auto *w = reinterpret_cast<val_t *>(b->data);
+        if (v->type != w->type || v->suffix != w->suffix) return false;
+        switch (v->type) {
+            case val_t::L:
+                return v->l == w->l;
+            case val_t::F:
+                return v->f == w->f;
+            default:
+                return strcmp(v->ns, w->ns) == 0;
+        }
+    }
+    auto *o = reinterpret_cast<op_t *>(a->data);
+    auto *p = reinterpret_cast<op_t *>(b->data);
+    return o->op == p->op && same(o->left, p->left) && same(o->right, p->right);
+}
+
+static void cover(struct exp_t *exp, std::set<struct exp_t *> &covered) {
+    if (!exp || exp->type != exp_t::OP) return;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    for (auto *c: {o->left, o->right}) {
+        if (!c) continue;
+        covered.insert(c);
+        cover(c, covered);
+    }
+}
+
+// an untyped integer constant, possibly negated
+static std::optional<long> constant(struct exp_t *exp) {
+    if (!exp) return std::nullopt;
+    if (exp->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(exp->data);
+        if (v->type != val_t::L || eval_ret_from_suffix(v->suffix) != NUMBERD) return std::nullopt;
+        return v->l;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->left) return std::nullopt;
+    if (o->op == ':') return constant(o->right);
+    auto c = constant(o->right);
+    if (!c) return std::nullopt;
+    if (o->op == '-') return -*c;
+    if (o->op == '+') return c;
+    return std::nullopt;
+}
+
+static bool is_var(struct exp_t *exp, std::string_view var) {
+    if (exp->type != exp_t::V) return false;
+    auto *v = reinterpret_cast<val_t *>(exp->data);
+    return v->type == val_t::N && var == v->ns;
+}
+
+// the index is the control variable plus a constant
+static std::optional<long> moving(struct exp_t *exp, std::string_view var) {
+    if (is_var(exp, var)) return 0;
+    if (exp->type != exp_t::OP) return std::nullopt;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (!o->left) return o->op == ':' ? moving(o->right, var) : std::nullopt;
+    if (o->op == '+') {
+        if (is_var(o->left, var)) return constant(o->right);
+        if (is_var(o->right, var)) return constant(o->left);
+    }
+    if (o->op == '-' && is_var(o->left, var)) {
+        if (auto c = constant(o->right)) return -*c;
+    }
+    return std::nullopt;
+}
+
+// only the FOR line assigns the control variable of a sealed block
+static bool counted(const block_t &b) {
+    if (!b.sealed || !fors.contains(b.first)) return false;
+    auto vn = *is_simple_var(fors.at(b.first).var);
+    for (auto it = writes.upper_bound(b.first); it != writes.end() && it->first <= b.last; ++it) {
+        if (it->second.contains(vn)) return false;
+    }
+    return true;
+}
+
+// the block steps an untyped control variable by a constant from an integer, nothing else assigns it.
+// It then only holds integers, which are exact indices.
+static std::optional<long> walk_step(const block_t &b) {
+    if (!counted(b)) return std::nullopt;
+    auto &f = fors.at(b.first);
+    auto vn = is_simple_var(f.var);
+    if (!vn || is_suffix(vn->back()) || !infer_exact(f.init)) return std::nullopt;
+    return f.step ? constant(f.step) : 1;
+}
+
+static std::optional<licm_walk_t> walk(struct exp_t *exp, const block_t &b, long step) {
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    auto vn = std::string(*is_name(o->left));
+    auto var = fors.at(b.first).var;
+    auto cv = *is_simple_var(var);
+    auto size = eval_ret_size(eval_ret_from_suffix(vn.back()));
+    auto mx = var_dims.at(vn).second;
+    if (!is_comma(o->right)) {
+        auto offset = moving(o->right, cv);
+        if (!offset) return std::nullopt;
+        return licm_walk_t{exp, var, nullptr, false, *offset, step * size, 0};
+    }
+    auto *c = reinterpret_cast<op_t *>(o->right->data);
+    if (auto offset = moving(c->left, cv); offset && invariant(c->right, b)) {
+        return licm_walk_t{exp, var, c->right, true, *offset, step * size * (mx + 1 - option_base), 0};
+    }
+    if (auto offset = moving(c->right, cv); offset && invariant(c->left, b)) {
+        return licm_walk_t{exp, var, c->left, false, *offset, step * size, 0};
+    }
+    return std::nullopt;
+}
+
+void licm_run() {
+    collect = false;
+    for (auto [first, last]: for_blocks) {
+        block_t b{first, last, {}, true};
+        for (auto it = writes.lower_bound(first); it != writes.end() && it->first <= last; ++it) {
+            b.writes.insert(it->second.cbegin(), it->second.cend());
+        }
+        b.sealed = gosubs.lower_bound(first) == gosubs.upper_bound(last)
+                   && barriers.lower_bound(first) == barriers.upper_bound(last)
+                   && std::none_of(jumps.cbegin(), jumps.cend(), [f = first, l = last](auto &j) {
+            return (j.first < f || j.first > l) && j.second > f && j.second <= l;
+        });
+        blocks.push_back(std::move(b));
+    }
+    // every expression goes to the outermost loop it does not change in
+    std::vector<std::pair<struct exp_t *, const block_t *>> targets;
+    for (auto &[l, e]: visits) {
+        if (!worth(e)) continue;
+        std::vector<const block_t *> around;
+        for (auto &b: blocks) {
+            if (b.first < l && b.last >= l) around.push_back(&b);
+        }
+        std::sort(around.begin(), around.end(), [](auto *a, auto *b) {
+            return a->last - a->first < b->last - b->first;
+        });
+        const block_t *t = nullptr;
+        for (auto *b: around) {
+            if (!invariant(e, *b) || !reached(l, *b)) break;
+            if (b->sealed) t = b;
+        }
+        if (t) targets.emplace_back(e, t);
+    }
+    // an array access walks with the innermost loop that moves one of its indices
+    for (auto &[l, e]: arrays) {
+        std::vector<const block_t *> around;
+        for (auto &b: blocks) {
+            if (b.first < l && b.last >= l) around.push_back(&b);
+        }
+        std::sort(around.begin(), around.end(), [](auto *a, auto *b) {
+            return a->last - a->first < b->last - b->first;
+        });
+        for (auto *b: around) {
+            auto step = walk_step(*b);
+            if (!step) continue;
+            auto w = walk(e, *b, *step);
+            if (!w || (w->fixed && !reached(l, *b))) continue;
+            auto &ws = walks[b->first];
+            auto it = std::find_if(ws.cbegin(), ws.cend(), [e](auto &x) { return same(x.exp, e); });
+            if (it != ws.cend()) {
+                w = *it;
+            } else {
+                w->slot = add_loop_vars(b->first);
+                // the FOR line computes both ends of the walk
+                line_no = b->first;
+                if (w->fixed) eval_scan(w->fixed, false);
+                eval_scan(w->var, false);
+                ws.push_back(*w);
+            }
+            walking.emplace(e, walk_entry_t{b->first, b->last, *w});
+            break;
+        }
+    }
+    std::set<struct exp_t *> covered;
+    for (auto &[e, b]: targets) {
+        cover(e, covered);
+    }
+    std::map<long, long> half_slots;
+    for (auto &[e, b]: targets) {
+        if (covered.contains(e)) continue;
+        // the same expression at several places of the loop shares one slot
+        auto &pre = preheaders[b->first];
+        auto it = std::find_if(pre.cbegin(), pre.cend(), [e](auto &h) { return same(h.exp, e); });
+        if (it != pre.cend()) {
+            hoisted.emplace(e, hoist_entry_t{b->first, b->last, *it});
+            continue;
+        }
+        long slot;
+        if (half_slots.contains(b->first)) {
+            slot = half_slots.at(b->first);
+            half_slots.erase(b->first);
+        } else {
+            slot = add_loop_vars(b->first);
+            half_slots[b->first] = slot + 8;
+        }
+        licm_hoist_t h{e, infer_safe(e) ? NUMBERL : NUMBERD, slot};
+        // the FOR line evaluates the expression
+        line_no = b->first;
+        eval_scan(e, false);
+        pre.push_back(h);
+        hoisted.emplace(e, hoist_entry_t{b->first, b->last, h});
+    }
+}
+
+const std::vector<licm_hoist_t> &licm_preheader(long l) {
+    static const std::vector<licm_hoist_t> none{};
+    auto it = preheaders.find(l);
+    return it == preheaders.end() ? none : it->second;
+}
+
+const std::vector<licm_walk_t> &licm_walks(long l) {
+    static const std::vector<licm_walk_t> none{};
+    auto it = walks.find(l);
+    return it == walks.end() ? none : it->second;
+}
+
+std::optional<licm_walk_t> licm_walking(struct exp_t *exp) {
+    auto it = walking.find(exp);
+    if (it == walking.end() || line_no <= it->second.first || line_no > it->second.last) return std::nullopt;
+    return it->second.walk;
+}
+
+static const block_t *block(long l) {
+    auto it = std::find_if(blocks.cbegin(), blocks.cend(), [l](auto &b) { return b.first == l; });
+    return it == blocks.cend() ? nullptr : &*it;
+}
+
+bool licm_sealed(long l) {
+    auto b = block(l);
+    return b && counted(*b);
+}
+
+std::optional<long> licm_step(long l) {
+    auto b = block(l);
+    return b ? walk_step(*b) : std::nullopt;
+}
+
+bool licm_invariant(struct exp_t *exp, long l) {
+    auto b = block(l);
+    return b && invariant(exp, *b);
+}
+
+std::optional<long> licm_index(struct exp_t *exp, long l) {
+    auto b = block(l);
+    if (!b || !fors.contains(l)) return std::nullopt;
+    return moving(exp, *is_simple_var(fors.at(l).var));
+}
+
+std::optional<licm_hoist_t> licm_hoisted(struct exp_t *exp) {
+    auto it = hoisted.find(exp);
+    if (it == hoisted.end() || line_no <= it->second.first || line_no > it->second.last) return std::nullopt;
+    return it->second.hoist;
+}
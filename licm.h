@@ -0,0 +1,68 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_LICM_H
+#define SMOLBASIC55_LICM_H
+
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "eval.h"
+
+// an expression of a FOR body that does not change while the loop runs. It is computed once by the FOR line
+// (after the limit test of the first iteration) into a loop variable slot, the body reads the slot.
+struct licm_hoist_t {
+    struct exp_t *exp;
+    eval_ret type;
+    // loop variable slot of the FOR line, like its limit and step (see loop_slot)
+    long slot;
+};
+
+// an array element whose index moves with the control variable of a loop. The FOR line checks that every element
+// the loop can reach is inside the array and points at the first one, NEXT moves the pointer.
+struct licm_walk_t {
+    struct exp_t *exp;
+    struct exp_t *var;
+    // the other index of a two-dimensional array, nullptr for one dimension
+    struct exp_t *fixed;
+    // the moving index is the first of two
+    bool first;
+    // moving index minus the control variable
+    long offset;
+    // bytes the pointer moves by every step
+    long stride;
+    // element pointer, followed by the element number (negative if the loop leaves the array)
+    long slot;
+};
+
+// the expressions and assignments of every line are collected while the lines are scanned
+void licm_visit(struct exp_t *exp);
+void licm_array(struct exp_t *exp);
+void licm_for(struct exp_t *var, struct exp_t *init, struct exp_t *step);
+void licm_write(std::string_view var);
+void licm_jump(long to);
+void licm_leave();
+void licm_gosub();
+void licm_barrier();
+
+// choose the hoisted expressions and size their evaluation
+void licm_run();
+// expressions computed by the FOR line l
+const std::vector<licm_hoist_t> &licm_preheader(long l);
+// the loop of the FOR line l is only entered through the FOR line, calls no subroutine and only the FOR line
+// assigns its control variable
+bool licm_sealed(long l);
+// the constant step of the FOR line l if its control variable only holds integers (see licm_walk_t)
+std::optional<long> licm_step(long l);
+// the expression does not change while the loop of FOR line l runs
+bool licm_invariant(struct exp_t *exp, long l);
+// the array index is the control variable of FOR line l plus the returned constant
+std::optional<long> licm_index(struct exp_t *exp, long l);
+// array walks of the FOR line l
+const std::vector<licm_walk_t> &licm_walks(long l);
+// the walk of an array access in a loop around the current line
+std::optional<licm_walk_t> licm_walking(struct exp_t *exp);
+// slot of an expression hoisted out of a loop around the current line
+std::optional<licm_hoist_t> licm_hoisted(struct exp_t *exp);
+
+#endif //SMOLBASIC55_LICM_H
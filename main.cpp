@@ -3,8 +3,11 @@
 
 #include <string>
 #include <iostream>
-#include <functional>
+#include <array>
+#include <algorithm>
+#include <span>
 #include <fstream>
+#include <sstream>
 #include <cassert>
 #include <map>
 #include <cstring>
@@ -15,11 +18,25 @@
 #include <set>
 #include <stack>
 #include <cmath>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <filesystem>
 #include "eval.h"
 #include "smolmath.h"
 #include "features.h"
 #include "asm.h"
 #include "util.h"
+#include "options.h"
+#include "obj.h"
+#include "stats.h"
+#include "regalloc.h"
+#include "infer.h"
+#include "licm.h"
+#include "simd.h"
+#include "unroll.h"
+#include "pgo.h"
+#include "slots.h"
 
 std::multimap<long, std::string> inline_asm{};
 
@@ -53,11 +70,55 @@ char *word(char **line) {
 }
 
 std::ifstream fd{};
-std::ofstream od{};
-std::map<long, std::function<void(long)>> lines{};
+thread_local std::ostream od{nullptr};
+static std::stringbuf od_text{};
+// what a line does, see emit_statement for the operands of each kind
+enum statement_kind_t {
+    STMT_NOP,
+    STMT_END,
+    STMT_CALL,
+    STMT_LET,
+    STMT_LET_ARRAY,
+    STMT_PRINT,
+    STMT_IF,
+    STMT_FOR,
+    STMT_NEXT,
+    STMT_READ,
+    STMT_INPUT,
+    STMT_ON_GOTO,
+    STMT_DEF,
+    STMT_GOTO,
+    STMT_GOSUB,
+    STMT_RETURN,
+    STMT_RESTORE,
+    STMT_RANDOMIZE,
+};
+
+// the statement of a line. The expressions point into the smolmath arena, lists are ranges (first, count) of the
+// item tables below.
+struct statement_t {
+    long line;
+    statement_kind_t kind;
+    std::array<struct exp_t *, 4> exp;
+    std::array<long, 3> arg;
+};
+
+// statements by line number, lines are parsed in ascending order
+std::vector<statement_t> lines{};
+// PRINT items, READ and INPUT variables, ON GOTO lines and DEF arguments of every statement
+std::vector<std::variant<char, exp_t *>> print_items{};
+std::vector<exp_t *> var_items{};
+std::vector<long> line_items{};
+std::vector<std::string> def_args{};
+// lines that change the function tables while being emitted (DEF)
+std::set<long> serial_lines{};
 bool end_found = false;
 bool error = false;
 long max_line_no = 0;
+// line of each BASIC line in the source file, for --debug
+std::map<long, long> source_lines{};
+long source_line = 0;
+std::string source_file;
 
 std::optional<stack_layout_t> outer_stack{};
 int option_declared = 0;
@@ -82,55 +143,440 @@ static long slurp_number(char **line) {
 }
 
 
+static std::vector<statement_t>::const_iterator statement_at(long l) {
+    return std::lower_bound(lines.cbegin(), lines.cend(), l, [](const statement_t &s, long l) {
+        return s.line < l;
+    });
+}
+
+static bool line_exists(long l) {
+    auto it = statement_at(l);
+    return it != lines.cend() && it->line == l;
+}
+
+template<typename T>
+static std::span<const T> items_of(const std::vector<T> &table, const statement_t &s) {
+    return std::span<const T>(table).subspan(s.arg[0], s.arg[1]);
+}
+
+static void add_statement(statement_kind_t kind, std::array<struct exp_t *, 4> exp = {}, std::array<long, 3> arg = {}) {
+    lines.push_back({line_no, kind, exp, arg});
+}
+
+static void check_jump(long d, long l) {
+    if (!line_exists(d)) {
+        throw std::runtime_error("non-existing line number (" + std::to_string(d) + ")");
+    }
+    if (auto o = line_in_for(d)) {
+        if (!(o->first <= l && o->second >= l)) {
+            throw std::runtime_error("jump into FOR block");
+        }
+    }
+}
+
+// the line never ran in the profile and can be moved: it has a label, is not the last line, is not a DEF and
+// neither is the line after it, and no INLINE assembly falls through
+static bool cold_line(std::vector<statement_t>::const_iterator it) {
+    if (!pgo_cold(it->line) || !inline_asm.empty() || serial_lines.contains(it->line)) return false;
+    auto next = std::next(it);
+    return next != lines.cend() && !serial_lines.contains(next->line);
+}
+
+static void emit_statement(const statement_t &s);
+
+// the target of the last jump parsed
+long dest;
+
+static void emit_line(std::vector<statement_t>::const_iterator it) {
+    auto l = it->line;
+    line_no = l;
+    line_labels = 0;
+    regalloc_current = regalloc_region(l);
+    reset_tmp_count();
+    if (options.debug) asm_debug_line(source_lines.at(l));
+    // cold lines go to .text.unlikely, the lines around them jump to keep the order of the program
+    bool cold = cold_line(it);
+    if (cold) {
+        if (it == lines.cbegin() || !cold_line(std::prev(it))) asm_jump_label(".L" + std::to_string(l));
+        asm_section(true);
+    }
+    emit_statement(*it);
+    if (cold) {
+        auto next = std::next(it);
+        if (!cold_line(next)) asm_jump_label(".L" + std::to_string(next->line));
+        asm_section(false);
+    }
+}
+
+// one more iteration of an unrolled loop: the body lines and the step of NEXT
+static void emit_copy(const unroll_t &u, long copy, long for_line, struct exp_t *var, long step_var) {
+    auto l = line_no;
+    auto labels = line_labels;
+    auto region = regalloc_current;
+    auto tmp = get_tmp_count();
+    line_copy = copy;
+    for (auto b: u.body) {
+        line_no = b;
+        line_labels = 0;
+        regalloc_current = regalloc_region(b);
+        reset_tmp_count();
+        emit_statement(*statement_at(b));
+    }
+    line_copy = 0;
+    line_no = l;
+    line_labels = labels;
+    regalloc_current = region;
+    reset_tmp_count(tmp);
+    asm_for_step(var, step_var);
+    for (auto &w: licm_walks(for_line)) asm_walk_step(w);
+}
+
+static void emit_inline_asm(long l) {
+    auto [b, e] = inline_asm.equal_range(l);
+    while (b != e) {
+        od << b->second << std::endl;
+        ++b;
+    }
+}
+
+static void emit_for(const statement_t &s) {
+    auto [v, i, t, st] = s.exp;
+    auto [lv0, lv1, label] = s.arg;
+    if (regalloc_current && regalloc_current->first == line_no) asm_regs_load();
+    asm_for_init(v, i, t, st, lv0, lv1);
+    // the hoisted expressions only run if the loop does
+    if (!licm_preheader(line_no).empty() || !licm_walks(line_no).empty()) {
+        asm_for_cond(v, lv0, lv1, ".T" + std::to_string(label + 1));
+    }
+    // the invariant expressions of the body use their own temporaries
+    auto tmp = get_tmp_count();
+    for (auto &h: licm_preheader(line_no)) {
+        reset_tmp_count();
+        asm_hoist(h.exp, h.type, h.slot);
+    }
+    if (auto sl = simd_loop(line_no)) {
+        reset_tmp_count();
+        asm_simd(*sl, v, lv0);
+    }
+    for (auto &w: licm_walks(line_no)) {
+        reset_tmp_count();
+        asm_walk_init(w, lv0);
+    }
+    if (auto u = unroll_loop(line_no)) {
+        for (long k = 1; k <= u->peel; ++k) emit_copy(*u, k, line_no, v, lv1);
+    }
+    reset_tmp_count(tmp);
+    asm_set_label(".T" + std::to_string(label));
+    asm_for_cond(v, lv0, lv1, ".T" + std::to_string(label + 1));
+}
+
+static void emit_next(const statement_t &s) {
+    auto *v = s.exp[0];
+    auto f = s.arg[0];
+    // the limit, step and labels of the loop are kept by its FOR line
+    auto &[lv0, lv1, label] = statement_at(f)->arg;
+    asm_for_step(v, lv1);
+    for (auto &w: licm_walks(f)) asm_walk_step(w);
+    if (auto u = unroll_loop(f)) {
+        for (long i = 1; i < u->factor; ++i) emit_copy(*u, u->peel + i, f, v, lv1);
+    }
+    // every iteration runs the condition of the FOR line again
+    if (options.profile) asm_profile_count(f);
+    asm_jump_label(".T" + std::to_string(label));
+    asm_set_label(".T" + std::to_string(label + 1));
+    if (regalloc_current && regalloc_current->last == line_no) asm_regs_store();
+}
+
+static void emit_def(const statement_t &s) {
+    auto name = std::string(*is_name(s.exp[0]));
+    auto arg_names = items_of(def_args, s);
+    auto end = ".T" + std::to_string(s.arg[2]);
+    asm_jump_label(end);
+    asm_function_start(name);
+
+    outer_stack = pushStack();
+
+    for (auto &f: arg_names) {
+        ASSERT(!local_variables.contains(f));
+        switch (eval_ret_from_suffix(f.back())) {
+            case NUMBERC:
+                local_variables[f] = add_tmp(CHAR);
+                break;
+            case NUMBERS:
+                local_variables[f] = add_tmp(SHORT);
+                break;
+            case NUMBERI:
+                local_variables[f] = add_tmp(INT);
+                break;
+            case NUMBERL:
+                local_variables[f] = add_tmp(LONG);
+                break;
+            case NUMBERF:
+                local_variables[f] = add_tmp(FLOAT);
+                break;
+            case NUMBERD:
+                local_variables[f] = add_tmp(DOUBLE);
+                break;
+            case STRING:
+                local_variables[f] = add_tmp(PTR);
+                break;
+            case NUMBERP:
+                local_variables[f] = add_tmp(PTR);
+                break;
+        }
+    }
+
+    // the body is emitted once into a buffer, the prologue that sizes the frame for its temporaries follows it
+    current_def = name;
+    auto *out = od.rdbuf();
+    std::stringbuf body;
+    od.rdbuf(&body);
+    try {
+        asm_promote(eval_val(s.exp[1], false));
+    } catch (...) {
+        od.rdbuf(out);
+        throw;
+    }
+    od.rdbuf(out);
+
+    proc_sub_start();
+    proc_sub_store_args(arg_names);
+    od << body.view();
+    proc_end();
+
+    popStack(*outer_stack);
+    outer_stack = std::nullopt;
+    local_variables.clear();
+    asm_function_end(name);
+
+    asm_set_label(".L" + std::to_string(line_no));
+    asm_set_label(end);
+    current_def = std::nullopt;
+}
+
+// operands: exp holds the expressions of the statement in source order (LET: variable, value; FOR: variable,
+// start, limit, step; NEXT and ON GOTO: variable; DEF: name, body), arg the jump target (IF, GOTO, GOSUB), the loop
+// variable slots and condition label (FOR), the FOR line (NEXT) or the range of the items and the end label (DEF)
+static void emit_statement(const statement_t &s) {
+    // a DEF jumps over its function first
+    if (s.kind == STMT_DEF) {
+        emit_def(s);
+        return;
+    }
+    asm_set_label(".L" + std::to_string(line_no));
+    switch (s.kind) {
+        case STMT_NOP:
+        case STMT_DEF:
+            break;
+        case STMT_END:
+            proc_main_end(0);
+            break;
+        case STMT_CALL:
+            eval_val(s.exp[0], false);
+            break;
+        case STMT_LET:
+            env = OTHER;
+            asm_assign_simple(s.exp[1], *is_simple_var(s.exp[0]));
+            break;
+        case STMT_LET_ARRAY: {
+            env = OTHER;
+            auto r = eval_val(s.exp[1], false);
+            auto l = asm_save(r, false);
+            asm_assign_complex(s.exp[0], r, l);
+            break;
+        }
+        case STMT_PRINT:
+            asm_print(items_of(print_items, s));
+            break;
+        case STMT_IF:
+            if (!line_exists(s.arg[0])) {
+                throw std::runtime_error("non-existing line number (" + std::to_string(dest) + ")");
+            }
+            ASSERT(NUMBERL == eval_val(s.exp[0], false));
+            asm_if_jump(s.arg[0]);
+            break;
+        case STMT_FOR:
+            emit_for(s);
+            break;
+        case STMT_NEXT:
+            emit_next(s);
+            break;
+        case STMT_READ:
+            asm_read(items_of(var_items, s));
+            break;
+        case STMT_INPUT:
+            asm_input(items_of(var_items, s), ".L" + std::to_string(line_no));
+            break;
+        case STMT_ON_GOTO: {
+            auto targets = items_of(line_items, s);
+            if (!std::all_of(targets.begin(), targets.end(), line_exists)) {
+                throw std::runtime_error("non-existing line number");
+            }
+            asm_on_goto(s.exp[0], targets);
+            break;
+        }
+        case STMT_GOTO:
+            check_jump(s.arg[0], s.line);
+            if (regalloc_leaves(s.arg[0])) asm_regs_store();
+            asm_jump_label(".L" + std::to_string(s.arg[0]));
+            break;
+        case STMT_GOSUB:
+            check_jump(s.arg[0], s.line);
+            // the subroutine works on the variables in memory
+            if (regalloc_current) asm_regs_store();
+            asm_gosub(s.arg[0]);
+            if (regalloc_current) asm_regs_load();
+            break;
+        case STMT_RETURN:
+            if (regalloc_current) asm_regs_store();
+            asm_return();
+            break;
+        case STMT_RESTORE:
+            asm_call("RESTORE");
+            break;
+        case STMT_RANDOMIZE:
+            if (options.seeded) asm_rnd_seed(options.seed);
+            else asm_call("RANDOMIZE");
+            break;
+    }
+}
+
+// every line is emitted into its own buffer by options.jobs threads, the buffers are written in line order.
+// DEF lines are emitted first on this thread, the other lines only read the tables they fill.
+static void emit_lines_parallel(long ml) {
+    auto &todo = lines;
+    std::vector<std::string> text(todo.size());
+    std::vector<std::exception_ptr> errors(todo.size());
+    std::vector<long> max_tmp(options.jobs);
+    auto layout = pushStack();
+    popStack(layout);
+
+    auto *out = od.rdbuf();
+    auto emit = [&](size_t i) {
+        std::stringbuf buf;
+        od.rdbuf(&buf);
+        try {
+            emit_line(todo.cbegin() + (long) i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+        text[i] = buf.str();
+    };
+    for (size_t i = 0; i < todo.size(); ++i) {
+        if (serial_lines.contains(todo[i].line)) emit(i);
+    }
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (int k = 0; k < options.jobs; ++k) {
+        workers.emplace_back([&, k]() {
+            pval = true;
+            popStack(layout);
+            for (size_t i; (i = next++) < todo.size();) {
+                if (!serial_lines.contains(todo[i].line)) emit(i);
+            }
+            max_tmp[k] = get_max_tmp_count();
+        });
+    }
+    for (auto &w: workers) {
+        w.join();
+    }
+    od.rdbuf(out);
+    // the frame of main holds the temporaries of every worker
+    layout = pushStack();
+    for (auto m: max_tmp) layout.max_tmp_count = std::max(layout.max_tmp_count, m);
+    popStack(layout);
+
+    for (size_t i = 0; i < todo.size(); ++i) {
+        if (errors[i]) {
+            line_no = todo[i].line;
+            std::rethrow_exception(errors[i]);
+        }
+        od << text[i];
+        if (todo[i].line != ml) emit_inline_asm(todo[i].line);
+    }
+}
+
 void process() {
     if (!for_stack.empty()) {
-        line_no = std::get<4>(for_stack.front());
+        line_no = for_stack.front().second;
         throw std::runtime_error("FOR without NEXT");
     }
     if (error) {
         return;
     }
-    pval = true;
-    proc_main_start();
-    long ml = 0;
-    for (auto &[l, f]: lines) {
-        if (l > ml) ml = l;
+    stats_timer_t timer(PHASE_EMIT);
+    infer_run();
+    licm_run();
+    slots_run();
+    std::vector<long> numbers;
+    numbers.reserve(lines.size());
+    for (auto &st: lines) {
+        numbers.push_back(st.line);
     }
-    for (auto &[l, f]: lines) {
-        line_no = l;
-        reset_tmp_count();
-        f(l);
-        if (l != ml) {
-            auto [b, e] = inline_asm.equal_range(l);
-            while (b != e) {
-                od << b->second << std::endl;
-                ++b;
+    simd_run(numbers);
+    unroll_run(numbers);
+    regalloc_run(asm_regs_available());
+    pval = true;
+    // the body of main is emitted once, its prologue follows when the temporaries are counted. The loop variable
+    // slots sit below the temporaries, so no address in the body depends on the size of the frame.
+    pushStack(loop_slots_size());
+    std::stringbuf body;
+    auto *out = od.rdbuf(&body);
+    try {
+        if (options.profile) asm_profile_start();
+        if (options.seeded) asm_rnd_seed(options.seed);
+        long ml = lines.empty() ? 0 : lines.back().line;
+        if (options.jobs > 1) {
+            emit_lines_parallel(ml);
+        } else {
+            for (auto it = lines.cbegin(); it != lines.cend(); ++it) {
+                emit_line(it);
+                if (it->line != ml) emit_inline_asm(it->line);
             }
         }
-    }
-    proc_main_end(0);
+        proc_main_end(0);
 
-    auto [b, e] = inline_asm.equal_range(ml);
-    while (b != e) {
-        od << b->second << std::endl;
-        ++b;
+        emit_inline_asm(ml);
+    } catch (...) {
+        od.rdbuf(out);
+        throw;
     }
+    od.rdbuf(out);
+    stats.max_tmp_count = get_max_tmp_count();
+    if (options.debug) asm_debug_file(source_file);
+    proc_main_start();
+    od << body.view();
+    proc_main_close();
 
-    asm_data(var_dims, string_map, data_items);
+    {
+        stats_timer_t data_timer(PHASE_DATA);
+        if (options.profile) {
+            asm_profile_data(numbers, options.profile_file);
+        }
+        asm_data(var_dims, string_map, data_items);
+    }
+    stats.lines = (long) lines.size();
+    stats.tmp_labels = tmp_labels;
+    stats.strings = (long) string_map.size();
+    stats.data_items = (long) data_items.size();
 }
 
 #define VAR_TYPE_STR "$~%|&@!"
 #define PREC_STR "::^^/*+->><<="
 
-void parse_line();
+// callback for smolmath_parse, the statement's scan is timed on its own.
+// The handlers check every tree with eval_scan, which feeds LICM, type inference, register allocation and the SIMD,
+// unroll and slot passes. Only process() runs eval_val, once per tree, and sizes the frame of main afterwards.
+template<void (*f)(struct exp_t *)>
+void scanned(struct exp_t *exp) {
+    stats_timer_t timer(PHASE_SCAN);
+    if (exp) ++stats.expressions;
+    f(exp);
+}
 
 void make_call(struct exp_t *exp) {
-    eval_val(exp, false);
-    lines[line_no] = [exp](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        eval_val(exp, false);
-    };
-    parse_line();
+    eval_scan(exp, false);
+    add_statement(STMT_CALL, {exp});
 }
 
 void make_let(struct exp_t *exp) {
@@ -138,6 +584,7 @@ void make_let(struct exp_t *exp) {
     ASSERT(exp->type == exp_t::OP);
     auto *o = reinterpret_cast<op_t *>(exp->data);
     ASSERT(o->op == '=' && o->left && o->right);
+    unroll_line(exp);
     auto vn = is_simple_var(o->left);
     if (vn) {
         std::string vnn = std::string(*vn);
@@ -149,48 +596,42 @@ void make_let(struct exp_t *exp) {
             }
         }
         var_dims[vnn] = std::make_pair(0, 0);
-        eval_val(o->right, false);
-        lines[line_no] = [o, vn = *vn](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-            env = OTHER;
-            asm_assign_simple(o->right, vn);
-        };
+        regalloc_use(vnn, false);
+        infer_let(vnn, o->right);
+        licm_write(vnn);
+        eval_scan(o->right, false);
+        add_statement(STMT_LET, {o->left, o->right});
     } else {
-        add_tmp(DOUBLE);
-        eval_val(o->right, false);
-        eval_val(o->left, true);
-        lines[line_no] = [o](long lno) {
-            asm_set_label(".L" + std::to_string(line_no));
-            env = OTHER;
-            auto r = eval_val(o->right, false);
-            auto l = asm_save(r, false);
-            asm_assign_complex(o->left, r, l);
-        };
+        simd_let(o->left, o->right);
+        eval_scan(o->right, false);
+        eval_scan(o->left, true);
+        add_statement(STMT_LET_ARRAY, {o->left, o->right});
     }
-    parse_line();
 }
 
 void make_print(struct exp_t *exp) {
     std::vector<std::variant<char, exp_t *>> items{};
+    unroll_line(exp);
     if (exp) {
         if (exp->type == exp_t::V) {
+            eval_scan(exp, false);
             items.emplace_back(exp);
         } else {
             while (exp) {
                 ASSERT(exp->type == exp_t::OP);
                 auto *o = (struct op_t *) exp->data;
                 if (o->op != ',' && o->op != ';') {
-                    if (exp) eval_val(exp, false);
+                    if (exp) eval_scan(exp, false);
                     items.emplace_back(exp);
                     break;
                 }
-                if (o->left) eval_val(o->left, false);
+                if (o->left) eval_scan(o->left, false);
                 items.emplace_back(o->left);
                 items.emplace_back(o->op);
                 struct op_t *op = nullptr;
                 if (o->right) op = (struct op_t *) o->right->data;
                 if (op && (o->right->type == exp_t::V)) {
-                    if (o->right) eval_val(o->right, false);
+                    if (o->right) eval_scan(o->right, false);
                     items.emplace_back(o->right);
                     break;
                 } else {
@@ -202,28 +643,16 @@ void make_print(struct exp_t *exp) {
             }
         }
     }
-    lines[line_no] = [items = std::move(items)](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        asm_print(items);
-    };
-    parse_line();
+    add_statement(STMT_PRINT, {}, {(long) print_items.size(), (long) items.size()});
+    print_items.insert(print_items.end(), items.begin(), items.end());
 }
 
-std::set<long> line_numbers{};
-
-long dest;
-
 void make_if(struct exp_t *exp) {
-    eval_val(exp, false);
-    lines[line_no] = [exp, d = dest](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        if (!line_numbers.contains(d)) {
-            throw std::runtime_error("non-existing line number (" + std::to_string(dest) + ")");
-        }
-        ASSERT(NUMBERL == eval_val(exp, false));
-        asm_if_jump(d);
-    };
-    parse_line();
+    eval_scan(exp, false);
+    regalloc_jump(dest);
+    infer_jump(dest);
+    licm_jump(dest);
+    add_statement(STMT_IF, {exp}, {dest});
 }
 
 char *to;
@@ -232,21 +661,21 @@ struct exp_t *init;
 struct exp_t *incr;
 
 void make_for3(struct exp_t *step) {
-    auto start = std::string(".T") + std::to_string(tmp_labels++);
-    auto end = std::string(".T") + std::to_string(tmp_labels++);
-    add_tmp(LONG);
-    eval_val(var, false);
-    eval_val(init, false);
-    asm_eval_cmp_exp(var, incr, GT);
-    if (step) eval_val(step, false);
-    auto lv0 = add_loop_vars();
+    // .T<label> is the condition of the loop, .T<label + 1> follows it
+    auto label = tmp_labels;
+    tmp_labels += 2;
+    eval_scan(var, false);
+    eval_scan(init, false);
+    // the condition of the loop compares the limit with the variable
+    eval_scan(incr, false);
+    eval_scan(var, false);
+    if (step) eval_scan(step, false);
+    auto lv0 = add_loop_vars(line_no);
     auto lv1 = lv0 + 8;
-    lines[line_no] = [lv0, lv1, start, end, v = var, i = init, t = incr, st = step](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        asm_for_init(v, i, t, st, lv0, lv1);
-        asm_set_label(start);
-        asm_for_cond(v, lv0, lv1, end);
-    };
+    infer_for(var, init, incr, step);
+    licm_for(var, init, step);
+    unroll_for(var, init, incr, step);
+    add_statement(STMT_FOR, {var, init, incr, step}, {lv0, lv1, label});
     // smolmath_log(var); fprintf(stderr, "\n");
     // smolmath_log(incr); fprintf(stderr, "\n");
     // smolmath_log(step); fprintf(stderr, "\n");
@@ -254,26 +683,26 @@ void make_for3(struct exp_t *step) {
         ASSERT(var->type == exp_t::V);
         auto *v = reinterpret_cast<val_t *>(var->data);
         ASSERT(v->type == val_t::N);
+        licm_write(v->ns);
         std::for_each(for_stack.cbegin(), for_stack.cend(), [v](auto &t) {
-            struct exp_t *e = std::get<0>(t);
+            struct exp_t *e = t.first;
             ASSERT(e);
             ASSERT(e->type == exp_t::V);
             auto *v0 = reinterpret_cast<val_t *>(e->data);
             ASSERT(v0->type == val_t::N);
             if (strcmp(v0->ns, v->ns) == 0) {
                 throw std::runtime_error(
-                        "FOR uses the same variable as outer FOR at line " + std::to_string(std::get<4>(t)));
+                        "FOR uses the same variable as outer FOR at line " + std::to_string(t.second));
             }
         });
     }
-    for_stack.emplace_front(var, start, end, lv1, line_no);
-    parse_line();
+    for_stack.emplace_front(var, line_no);
 }
 
 void make_for2(struct exp_t *exp) {
     incr = exp;
     if (to) {
-        if (smolmath_parse(to, PREC_STR, '-', VAR_TYPE_STR, make_for3)) {
+        if (smolmath_parse(to, PREC_STR, '-', VAR_TYPE_STR, scanned<make_for3>)) {
             throw std::runtime_error("syntax error");
         }
     } else make_for3(nullptr);
@@ -293,7 +722,7 @@ void make_for1(struct exp_t *exp) {
         *to = 0;
         to += 4;
     }
-    if (smolmath_parse(t, PREC_STR, '-', VAR_TYPE_STR, make_for2)) {
+    if (smolmath_parse(t, PREC_STR, '-', VAR_TYPE_STR, scanned<make_for2>)) {
         throw std::runtime_error("syntax error");
     }
 }
@@ -390,31 +819,30 @@ void make_data(char *line) {
             }
         }
     }
-    lines[line_no] = [](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-    };
-    parse_line();
+    add_statement(STMT_NOP);
 }
 
 void make_read(struct exp_t *exp) {
     std::vector<exp_t *> items{};
+    unroll_line(exp);
     if (exp->type == exp_t::V) {
+        eval_scan(exp, true);
         items.emplace_back(exp);
     } else {
         while (exp) {
             ASSERT(exp->type == exp_t::OP);
             auto *o = (struct op_t *) exp->data;
             if (o->op != ',' && o->op != ';') {
-                if (exp) eval_val(exp, true);
+                if (exp) eval_scan(exp, true);
                 items.emplace_back(exp);
                 break;
             }
-            if (o->left) eval_val(o->left, true);
+            if (o->left) eval_scan(o->left, true);
             items.emplace_back(o->left);
             struct op_t *op = nullptr;
             if (o->right) op = (struct op_t *) o->right->data;
             if (op && (o->right->type == exp_t::V)) {
-                if (o->right) eval_val(o->right, true);
+                if (o->right) eval_scan(o->right, true);
                 items.emplace_back(o->right);
                 break;
             } else {
@@ -426,32 +854,30 @@ void make_read(struct exp_t *exp) {
         }
     }
     ASSERT(!items.empty());
-    lines[line_no] = [items](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        asm_read(items);
-    };
-    parse_line();
+    add_statement(STMT_READ, {}, {(long) var_items.size(), (long) items.size()});
+    var_items.insert(var_items.end(), items.begin(), items.end());
 }
 
 void make_input(struct exp_t *exp) {
     std::vector<exp_t *> items{};
     if (exp->type == exp_t::V) {
+        eval_scan(exp, true);
         items.emplace_back(exp);
     } else {
         while (exp) {
             ASSERT(exp->type == exp_t::OP);
             auto *o = (struct op_t *) exp->data;
             if (o->op != ',' && o->op != ';') {
-                if (exp) eval_val(exp, true);
+                if (exp) eval_scan(exp, true);
                 items.emplace_back(exp);
                 break;
             }
-            if (o->left) eval_val(o->left, true);
+            if (o->left) eval_scan(o->left, true);
             items.emplace_back(o->left);
             struct op_t *op = nullptr;
             if (o->right) op = (struct op_t *) o->right->data;
             if (op && (o->right->type == exp_t::V)) {
-                if (o->right) eval_val(o->right, true);
+                if (o->right) eval_scan(o->right, true);
                 items.emplace_back(o->right);
                 break;
             } else {
@@ -463,18 +889,12 @@ void make_input(struct exp_t *exp) {
         }
     }
     ASSERT(!items.empty());
-    for (auto &i: items) {
-        add_tmp(DOUBLE);
-    }
-    lines[line_no] = [items](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        asm_input(items, ".L" + std::to_string(line_no));
-    };
-    parse_line();
+    add_statement(STMT_INPUT, {}, {(long) var_items.size(), (long) items.size()});
+    var_items.insert(var_items.end(), items.begin(), items.end());
 }
 
 void make_on_goto2(struct exp_t *exp) {
-    eval_val(var, false);
+    eval_scan(var, false);
     std::vector<long> items{};
     if (exp->type == exp_t::V) {
         items.emplace_back(to_long(exp));
@@ -483,16 +903,16 @@ void make_on_goto2(struct exp_t *exp) {
             ASSERT(exp->type == exp_t::OP);
             auto *o = (struct op_t *) exp->data;
             if (o->op != ',' && o->op != ';') {
-                if (exp) eval_val(exp, false);
+                if (exp) eval_scan(exp, false);
                 items.emplace_back(to_long(exp));
                 break;
             }
-            if (o->left) eval_val(o->left, false);
+            if (o->left) eval_scan(o->left, false);
             items.emplace_back(to_long(o->left));
             struct op_t *op = nullptr;
             if (o->right) op = (struct op_t *) o->right->data;
             if (op && (o->right->type == exp_t::V)) {
-                if (o->right) eval_val(o->right, false);
+                if (o->right) eval_scan(o->right, false);
                 items.emplace_back(to_long(o->right));
                 break;
             } else {
@@ -509,26 +929,23 @@ void make_on_goto2(struct exp_t *exp) {
     })) {
         throw std::runtime_error("non-existing line number");
     }
-    lines[line_no] = [items, v = var](long l) {
-        asm_set_label(".L" + std::to_string(line_no));
-        if (!std::all_of(items.cbegin(), items.cend(), [](long l) {
-            return line_numbers.contains(l);
-        })) {
-            throw std::runtime_error("non-existing line number");
-        }
-        asm_on_goto(v, items);
-    };
-    parse_line();
+    for (auto d: items) {
+        regalloc_jump(d);
+        licm_jump(d);
+    }
+    add_statement(STMT_ON_GOTO, {var}, {(long) line_items.size(), (long) items.size()});
+    line_items.insert(line_items.end(), items.begin(), items.end());
 }
 
 void make_on_goto1(struct exp_t *exp) {
     var = exp;
-    if (smolmath_parse(to, PREC_STR, '-', VAR_TYPE_STR, make_on_goto2)) {
+    if (smolmath_parse(to, PREC_STR, '-', VAR_TYPE_STR, scanned<make_on_goto2>)) {
         throw std::runtime_error("syntax error");
     }
 }
 
-void make_def_single(std::string_view name, exp_t *args, exp_t *line) {
+void make_def_single(exp_t *fn, exp_t *args, exp_t *line) {
+    auto name = *is_name(fn);
     std::vector<std::string> arg_names{};
     if (args) {
         if (args->type == exp_t::V) {
@@ -568,64 +985,8 @@ void make_def_single(std::string_view name, exp_t *args, exp_t *line) {
     if (arg_names.size() > 1 && !features.fulldef) {
         throw std::runtime_error("syntax error");
     }
-    auto end = std::string(".T") + std::to_string(tmp_labels++);
-    lines[line_no] = [arg_names, line, end, name = std::string(name)](long) {
-        asm_jump_label(end);
-        asm_set_label(name);
-
-        outer_stack = pushStack();
-
-        for (auto &f: arg_names) {
-            ASSERT(!local_variables.contains(f));
-            switch (eval_ret_from_suffix(f.back())) {
-                case NUMBERC:
-                    local_variables[f] = add_tmp(CHAR);
-                    break;
-                case NUMBERS:
-                    local_variables[f] = add_tmp(SHORT);
-                    break;
-                case NUMBERI:
-                    local_variables[f] = add_tmp(INT);
-                    break;
-                case NUMBERL:
-                    local_variables[f] = add_tmp(LONG);
-                    break;
-                case NUMBERF:
-                    local_variables[f] = add_tmp(FLOAT);
-                    break;
-                case NUMBERD:
-                    local_variables[f] = add_tmp(DOUBLE);
-                    break;
-                case STRING:
-                    local_variables[f] = add_tmp(PTR);
-                    break;
-                case NUMBERP:
-                    local_variables[f] = add_tmp(PTR);
-                    break;
-            }
-        }
-
-        auto tmp_s = get_tmp_count();
-
-        pval = false;
-        current_def = name;
-        eval_val(line, false);
-        pval = true;
-
-        proc_sub_start();
-        proc_sub_store_args(arg_names);
-        reset_tmp_count(tmp_s);
-        asm_promote(eval_val(line, false));
-        proc_end();
-
-        popStack(*outer_stack);
-        outer_stack = std::nullopt;
-        local_variables.clear();
-
-        asm_set_label(".L" + std::to_string(line_no));
-        asm_set_label(end);
-        current_def = std::nullopt;
-    };
+    add_statement(STMT_DEF, {fn, line}, {(long) def_args.size(), (long) arg_names.size(), tmp_labels++});
+    def_args.insert(def_args.end(), arg_names.begin(), arg_names.end());
     assert(arg_names.size() < 9);
     std::array<char, 9> sig{0};
     for (auto i = 0; i < arg_names.size(); ++i) {
@@ -657,6 +1018,7 @@ void make_def_single(std::string_view name, exp_t *args, exp_t *line) {
         }
     }
     defns[std::string(name)] = sig;
+    serial_lines.insert(line_no);
 }
 
 void make_def(struct exp_t *exp) {
@@ -673,7 +1035,7 @@ void make_def(struct exp_t *exp) {
             throw std::runtime_error("function redeclared");
         }
         if (o->op == '=') { // single-line
-            make_def_single(*name, nullptr, o->right);
+            make_def_single(sig, nullptr, o->right);
         } else {
             ASSERT(o->op == ':');
             throw std::runtime_error("UNIMPLEMENTED");
@@ -688,22 +1050,22 @@ void make_def(struct exp_t *exp) {
         }
         ASSERT(!outer_stack);
         if (o->op == '=') { // single-line
-            make_def_single(*name, sigop->right, o->right);
+            make_def_single(sigop->left, sigop->right, o->right);
         } else {
             ASSERT(o->op == ':');
             throw std::runtime_error("UNIMPLEMENTED");
         }
     }
-    parse_line();
 }
 
 std::map<std::string_view, int *> feature_strings = {
-        {"EXTERN",  &features.external},
-        {"FULLDEF", &features.fulldef},
-        {"INLINE",  &features.inline_asm},
-        {"NOEND",   &features.noend},
-        {"PTR",     &features.ptr},
-        {"TYPE",    &features.type}
+        {"EXTERN",   &features.external},
+        {"FASTMATH", &features.fastmath},
+        {"FULLDEF",  &features.fulldef},
+        {"INLINE",   &features.inline_asm},
+        {"NOEND",    &features.noend},
+        {"PTR",      &features.ptr},
+        {"TYPE",     &features.type}
 };
 
 void process_flag(std::string_view f) {
@@ -746,29 +1108,76 @@ void process_flag(std::string_view f) {
     }
 }
 
-void parse_line() {
-    reset_tmp_count();
-    if (fd.eof()) {
-        final:
-        if (!end_found && !features.noend) {
-            error = true;
-            std::cerr << std::to_string(line_no) << ": error: program must have an END statement" << std::endl;
-            return;
+void process_option(std::string_view f) {
+    if (f == "--obj") {
+        options.obj = 1;
+    } else if (f == "--run") {
+        options.run = 1;
+    } else if (f == "--interp") {
+        options.interp = 1;
+    } else if (f == "--stats") {
+        options.stats = 1;
+    } else if (f == "--stats=json") {
+        options.stats = 2;
+    } else if (f == "--debug") {
+        options.debug = 1;
+    } else if (f == "--infer-int") {
+        options.infer_int = 1;
+    } else if (f == "--profile") {
+        options.profile = 1;
+    } else if (f.starts_with("--profile=")) {
+        options.profile = 1;
+        options.profile_file = f.substr(10).data();
+    } else if (f == "--profile-use") {
+        options.profile_use = 1;
+    } else if (f.starts_with("--profile-use=")) {
+        options.profile_use = 1;
+        options.profile_use_file = f.substr(14).data();
+    } else if (f.starts_with("--jobs=")) {
+        auto n = f.substr(7);
+        if (std::from_chars(n.data(), n.data() + n.size(), options.jobs).ec != std::errc{} || options.jobs < 1) {
+            std::cerr << "invalid option: " << f << std::endl;
+            exit(1);
         }
-        process();
-        return;
+    } else if (f.starts_with("--seed=")) {
+        auto n = f.substr(7);
+        if (std::from_chars(n.data(), n.data() + n.size(), options.seed).ec != std::errc{}) {
+            std::cerr << "invalid option: " << f << std::endl;
+            exit(1);
+        }
+        options.seeded = 1;
+    } else if (f.starts_with("--march=")) {
+        auto m = asm_march(f.substr(8));
+        if (!m) {
+            std::cerr << "invalid option: " << f << std::endl;
+            exit(1);
+        }
+        options.march = *m;
+    } else {
+        std::cerr << "unknown option: " << f << std::endl;
+        exit(1);
     }
+}
+
+// parses the next line of the program and scans its statement, false at the end of the file
+bool parse_line() {
+    stats_timer_t timer(PHASE_PARSE);
+    if (fd.eof()) return false;
     std::string l;
-    std::getline(fd, l);
-    char *line = l.data();
-    if (fd.eof() && l.empty()) {
-        goto final;
+    {
+        stats_timer_t read_timer(PHASE_READ);
+        std::getline(fd, l);
+        ++source_line;
     }
+    char *line = l.data();
+    if (fd.eof() && l.empty()) return false;
     if (!isdigit(*line) && features.inline_asm) {
         inline_asm0:
         inline_asm.emplace(line_no, std::string(line));
-        parse_line();
-        return;
+        regalloc_barrier();
+        infer_barrier();
+        licm_barrier();
+        return true;
     }
     if (isspace(*line)) {
         if (features.inline_asm) goto inline_asm0;
@@ -794,13 +1203,13 @@ void parse_line() {
         if (features.inline_asm) goto inline_asm0;
         throw std::runtime_error("invalid line number");
     }
-    line_numbers.insert(line_no);
     if (line_no < max_line_no) {
         throw std::runtime_error("invalid line order");
     } else if (line_no == max_line_no) {
         throw std::runtime_error("duplicated line number");
     }
     max_line_no = line_no;
+    source_lines[line_no] = source_line;
     if (end_found) {
         std::cerr << std::to_string(line_no) << ": error: line after an END statement" << std::endl;
         error = true;
@@ -815,43 +1224,42 @@ void parse_line() {
         throw std::runtime_error("no space after keyword " + std::string(w));
     }
     if (w == "PRINT") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_print)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_print>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "LET") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_let)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_let>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "STOP") {
         trim_left(&line);
         ASSERT(!*line);
-        lines[line_no] = [](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            proc_main_end(0);
-        };
-        parse_line();
+        licm_leave();
+        add_statement(STMT_END);
     } else if (w == "END") {
         end_found = true;
         trim_left(&line);
         ASSERT(!*line);
-        lines[line_no] = [](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            proc_main_end(0);
-        };
-        parse_line();
+        licm_leave();
+        add_statement(STMT_END);
     } else if (w == "REM") {
-        lines[line_no] = [](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-        };
-        parse_line();
+        unroll_line(nullptr);
+        add_statement(STMT_NOP);
     } else if (w == "INPUT") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_input)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_input>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "DIM") {
         while (true) {
             auto s = std::string(word(&line));
+            if (word_oc && is_suffix(word_oc)) {
+                // typed array (A%(N)), word() stops at the suffix
+                s += word_oc;
+                word_oc = *line;
+                if (*line == '(') ++line;
+            }
             ASSERT(is_var_name(s));
+            eval_ret_from_suffix(s.back());
             if (var_dims.contains(s)) {
                 throw std::runtime_error("redimensioned variable " + s);
             }
@@ -896,27 +1304,14 @@ void parse_line() {
             }
         }
 
-        lines[line_no] = [](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-        };
-        parse_line();
+        add_statement(STMT_NOP);
     } else if (w == "GOTO") {
         s_goto:
         auto s = std::string_view(word(&line));
         std::from_chars(s.begin(), s.end(), dest);
-        lines[line_no] = [d = dest](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            if (!line_numbers.contains(d)) {
-                throw std::runtime_error("non-existing line number (" + std::to_string(d) + ")");
-            }
-            if (auto o = line_in_for(d)) {
-                if (!(o->first <= l && o->second >= l)) {
-                    throw std::runtime_error("jump into FOR block");
-                }
-            }
-            asm_jump_label(".L" + std::to_string(d));
-        };
-        parse_line();
+        regalloc_jump(dest);
+        licm_jump(dest);
+        add_statement(STMT_GOTO, {}, {dest});
     } else if (w == "GOSUB") {
         s_gosub:
         auto s = std::string_view(word(&line));
@@ -924,25 +1319,13 @@ void parse_line() {
         if (ec.ec == std::errc::invalid_argument || ec.ptr != s.end()) {
             throw std::runtime_error("syntax error");
         }
-        lines[line_no] = [d = dest](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            if (!line_numbers.contains(d)) {
-                throw std::runtime_error("non-existing line number (" + std::to_string(d) + ")");
-            }
-            if (auto o = line_in_for(d)) {
-                if (!(o->first <= l && o->second >= l)) {
-                    throw std::runtime_error("jump into FOR block");
-                }
-            }
-            asm_gosub(d);
-        };
-        parse_line();
+        regalloc_jump(dest);
+        infer_gosub();
+        licm_gosub();
+        add_statement(STMT_GOSUB, {}, {dest});
     } else if (w == "RETURN") {
-        lines[line_no] = [](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            asm_return();
-        };
-        parse_line();
+        licm_leave();
+        add_statement(STMT_RETURN);
     } else if (w == "GO") {
         auto s = std::string_view(word(&line));
         if (s == "TO") goto s_goto;
@@ -961,7 +1344,7 @@ void parse_line() {
             throw std::runtime_error("INVALID IF STATEMENT, got: " + std::string(line));
         }
         *e = 0;
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_if)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_if>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "ON") {
@@ -973,34 +1356,28 @@ void parse_line() {
         if (strncmp(end, "TO", 2) == 0) {
             end += 2;
             to = end;
-            if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_on_goto1)) {
+            if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_on_goto1>)) {
                 throw std::runtime_error("syntax error");
             }
         } else goto err;
     } else if (w == "READ") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_read)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_read>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "DEF") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_def)) {
+        regalloc_barrier();
+        licm_barrier();
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_def>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "RESTORE") {
         trim_left(&line);
         ASSERT(*line == 0);
-        lines[line_no] = [](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-            asm_call("RESTORE");
-        };
-        parse_line();
+        add_statement(STMT_RESTORE);
     } else if (w == "RANDOMIZE") {
         trim_left(&line);
         ASSERT(*line == 0);
-        lines[line_no] = [](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-            asm_call("RANDOMIZE");
-        };
-        parse_line();
+        add_statement(STMT_RANDOMIZE);
     } else if (w == "DATA") {
         make_data(line);
     } else if (w == "OPTION") {
@@ -1033,15 +1410,12 @@ void parse_line() {
                 process_flag(wrd);
             }
         }
-        lines[line_no] = [](long) {
-            asm_set_label(".L" + std::to_string(line_no));
-        };
-        parse_line();
+        add_statement(STMT_NOP);
     } else if (w == "FOR") {
         to = strstr(line, "TO");
         *to = 0;
         to += 2;
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_for1)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_for1>)) {
             throw std::runtime_error("syntax error");
         }
     } else if (w == "NEXT") {
@@ -1051,49 +1425,106 @@ void parse_line() {
         if (for_stack.empty()) {
             throw std::runtime_error("NEXT without FOR");
         }
-        auto e = std::get<0>(for_stack.front());
+        auto e = for_stack.front().first;
         ASSERT(e && e->type == exp_t::V);
         auto *v = reinterpret_cast<val_t *>(e->data);
         ASSERT(v->type == val_t::N);
         if (strcmp(ww, v->ns) != 0) {
             throw std::runtime_error("NEXT without FOR");
         }
-        eval_val(e, false);
-        auto el = for_stack.front();
-        lines[line_no] = [el](long l) {
-            asm_set_label(".L" + std::to_string(line_no));
-            asm_for_step(std::get<0>(el), std::get<3>(el));
-            asm_jump_label(std::get<1>(el));
-            asm_set_label(std::get<2>(el));
-        };
-        for_blocks.emplace_back(std::get<4>(el), line_no);
+        eval_scan(e, false);
+        add_statement(STMT_NEXT, {e}, {for_stack.front().second});
+        for_blocks.emplace_back(for_stack.front().second, line_no);
         for_stack.pop_front();
-        parse_line();
     } else if (features.external && w == "CALL") {
-        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, make_call)) {
+        if (smolmath_parse(line, PREC_STR, '-', VAR_TYPE_STR, scanned<make_call>)) {
             throw std::runtime_error("syntax error");
         }
     } else {
         err:
         throw std::runtime_error("syntax error");
     }
+    return true;
+}
+
+// the lines are parsed one after the other, their trees stay in the smolmath arena until the code is generated
+void parse() {
+    while (parse_line()) {}
+    if (!end_found && !features.noend) {
+        error = true;
+        std::cerr << std::to_string(line_no) << ": error: program must have an END statement" << std::endl;
+        return;
+    }
+    process();
 }
 
 int main(int argc, char **argv) {
-    if (argc < 3) return 1;
     int i;
-    for (i = 1; i < argc - 2; ++i) {
+    for (i = 1; i < argc && (argv[i][0] == '+' || argv[i][0] == '-'); ++i) {
         std::string_view f(argv[i]);
-        process_flag(f);
+        if (f.starts_with("--")) process_option(f);
+        else process_flag(f);
+    }
+    if (argc - i != (options.run || options.interp ? 1 : 2)) return 1;
+    fd.open(argv[i]);
+    source_file = std::filesystem::absolute(argv[i]).string();
+    std::string profile_file = std::string(argv[i]) + ".prof";
+    if (options.profile && !options.profile_file) options.profile_file = profile_file.c_str();
+    if (options.profile_use) {
+        if (!options.profile_use_file) options.profile_use_file = profile_file.c_str();
+        if (!pgo_load(options.profile_use_file)) {
+            std::cerr << "error: invalid profile " << options.profile_use_file << std::endl;
+            return 1;
+        }
     }
-    fd.open(argv[argc - 2]);
-    od.open(argv[argc - 1]);
+    // the assembly is kept in memory and written at once, a file stream would be flushed by every std::endl
+    od.rdbuf(&od_text);
     try {
-        parse_line();
+        parse();
     } catch (const std::runtime_error &e) {
         std::cerr << line_no << ": error: " << e.what() << std::endl;
         error = true;
     }
+    smolmath_free();
     if (error) return 1;
+    stats.asm_bytes = od.tellp();
+    if (options.run || options.interp) {
+        int r;
+        try {
+            if (options.interp) {
+                if (options.stats) stats_report(std::cerr, options.stats == 2);
+                r = obj_interpret(od_text.str());
+            } else {
+                obj_t o;
+                {
+                    stats_timer_t timer(PHASE_OUTPUT);
+                    o = obj_assemble(od_text.str());
+                }
+                if (options.stats) stats_report(std::cerr, options.stats == 2);
+                r = obj_run(o);
+            }
+        } catch (const std::runtime_error &e) {
+            std::cerr << argv[i] << ": error: " << e.what() << std::endl;
+            return 1;
+        }
+        return r;
+    }
+    {
+        stats_timer_t timer(PHASE_OUTPUT);
+        if (options.obj) {
+            try {
+                auto o = obj_assemble(od_text.str());
+                std::ofstream out(argv[i + 1], std::ios::binary);
+                obj_write_elf(o, out);
+            } catch (const std::runtime_error &e) {
+                std::cerr << argv[i + 1] << ": error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else {
+            std::ofstream out(argv[i + 1]);
+            out << od_text.view();
+        }
+    }
+    if (options.stats) stats_report(std::cerr, options.stats == 2);
     return 0;
 }
@@ -0,0 +1,54 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_OBJ_H
+#define SMOLBASIC55_OBJ_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum obj_reloc_type_t {
+    RELOC_PC32,
+    RELOC_PLT32,
+    RELOC_ABS32,
+    RELOC_ABS64,
+};
+
+struct obj_reloc_t {
+    long offset;
+    obj_reloc_type_t type;
+    // relocations against local symbols are rewritten to their section (like gas does)
+    long section;
+    std::string symbol;
+    long addend;
+};
+
+struct obj_section_t {
+    std::string name;
+    unsigned type;
+    unsigned long flags;
+    long align = 1;
+    std::vector<unsigned char> bytes;
+    std::vector<obj_reloc_t> relocs;
+};
+
+struct obj_symbol_t {
+    long section = -1;
+    long value = 0;
+    bool global = false;
+    bool absolute = false;
+};
+
+struct obj_t {
+    std::vector<obj_section_t> sections;
+    std::map<std::string, obj_symbol_t> symbols;
+};
+
+obj_t obj_assemble(const std::string &text);
+void obj_write_elf(const obj_t &obj, std::ostream &out);
+int obj_run(const obj_t &obj);
+int obj_interpret(const std::string &text);
+
+#endif //SMOLBASIC55_OBJ_H
@@ -0,0 +1,1083 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+#include <fenv.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sstream>
+#include <stdexcept>
+#include "amd64.h"
+#include "data.h"
+#include "obj.h"
+
+// Assembler for the subset of AT&T syntax emitted by asm_amd64.cpp.
+// Branches always use rel32 and symbolic displacements always use disp32, so instruction sizes never
+// depend on label values and a single pass with fixups is sufficient.
+
+struct fixup_t {
+    long section;
+    long offset;
+    long end;
+    obj_reloc_type_t type;
+    std::string sym;
+    long addend;
+};
+
+static obj_t *obj;
+static long cur_section;
+static std::vector<fixup_t> fixups;
+static std::map<std::string, reg_t> registers;
+
+static void init_registers() {
+    if (!registers.empty()) return;
+    const char *r64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi"};
+    const char *r32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+    const char *r16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+    const char *r8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+    for (int i = 0; i < 8; ++i) {
+        registers[r64[i]] = {i, 8, false};
+        registers[r32[i]] = {i, 4, false};
+        registers[r16[i]] = {i, 2, false};
+        registers[r8[i]] = {i, 1, i >= 4};
+    }
+    for (int i = 8; i < 16; ++i) {
+        std::string n = "r" + std::to_string(i);
+        registers[n] = {i, 8, false};
+        registers[n + "d"] = {i, 4, false};
+        registers[n + "w"] = {i, 2, false};
+        registers[n + "b"] = {i, 1, false};
+    }
+    for (int i = 0; i < 16; ++i) {
+        registers["xmm" + std::to_string(i)] = {i, 16, false};
+    }
+}
+
+static std::string strip(const std::string &s) {
+    size_t i = 0;
+    while (i < s.size() && isspace(s[i])) ++i;
+    size_t j = s.size();
+    while (j > i && isspace(s[j - 1])) --j;
+    return s.substr(i, j - i);
+}
+
+bool amd64_parse_number(const std::string &s, long &v) {
+    if (s.empty()) return false;
+    const char *b = s.c_str();
+    char *e;
+    errno = 0;
+    if (s[0] == '-') {
+        v = strtol(b, &e, 0);
+    } else {
+        v = (long) strtoul(b, &e, 0);
+    }
+    return *e == 0 && errno == 0;
+}
+
+// number, symbol or symbol+number
+void amd64_parse_expr(std::string s, std::string &sym, long &value) {
+    s = strip(s);
+    std::string t;
+    for (auto c: s) if (!isspace(c)) t += c;
+    sym.clear();
+    value = 0;
+    if (amd64_parse_number(t, value)) return;
+    auto p = t.find_last_of("+-");
+    if (p != std::string::npos && p != 0 && amd64_parse_number(t.substr(p), value)) {
+        sym = t.substr(0, p);
+    } else {
+        sym = t;
+    }
+    if (sym.empty()) throw std::runtime_error("bad expression: " + s);
+}
+
+static reg_t parse_register(std::string s) {
+    s = strip(s);
+    if (s.empty() || s[0] != '%' || !registers.contains(s.substr(1))) {
+        throw std::runtime_error("bad register: " + s);
+    }
+    return registers[s.substr(1)];
+}
+
+static operand_t parse_operand(std::string s) {
+    operand_t op{};
+    s = strip(s);
+    if (!s.empty() && s[0] == '*') {
+        op.indirect = true;
+        s = strip(s.substr(1));
+    }
+    if (s.empty()) throw std::runtime_error("missing operand");
+    if (s[0] == '%') {
+        op.kind = OP_REG;
+        op.reg = parse_register(s);
+    } else if (s[0] == '$') {
+        op.kind = OP_IMM;
+        amd64_parse_expr(s.substr(1), op.sym, op.value);
+    } else if (s.back() == ')') {
+        op.kind = OP_MEM;
+        auto p = s.find('(');
+        if (p == std::string::npos) throw std::runtime_error("bad memory operand: " + s);
+        if (p != 0) amd64_parse_expr(s.substr(0, p), op.sym, op.value);
+        std::string inner = s.substr(p + 1, s.size() - p - 2);
+        std::vector<std::string> parts;
+        std::stringstream ss(inner);
+        std::string part;
+        while (std::getline(ss, part, ',')) parts.push_back(strip(part));
+        if (parts.empty() || parts.size() > 3) throw std::runtime_error("bad memory operand: " + s);
+        if (parts[0] == "%rip") {
+            if (parts.size() != 1) throw std::runtime_error("bad memory operand: " + s);
+            op.rip = true;
+        } else {
+            if (!parts[0].empty()) {
+                auto r = parse_register(parts[0]);
+                if (r.size != 8) throw std::runtime_error("bad memory operand: " + s);
+                op.base = r.num;
+            }
+            if (parts.size() > 1) {
+                auto r = parse_register(parts[1]);
+                if (r.size != 8 || r.num == 4) throw std::runtime_error("bad memory operand: " + s);
+                op.index = r.num;
+            }
+            if (parts.size() > 2) {
+                long sc;
+                if (!amd64_parse_number(parts[2], sc) || (sc != 1 && sc != 2 && sc != 4 && sc != 8)) {
+                    throw std::runtime_error("bad memory operand: " + s);
+                }
+                op.scale = (int) sc;
+            }
+            if (!op.sym.empty()) throw std::runtime_error("unsupported symbolic displacement: " + s);
+        }
+    } else {
+        op.kind = OP_LABEL;
+        amd64_parse_expr(s, op.sym, op.value);
+    }
+    return op;
+}
+
+std::vector<std::string> amd64_split_operands(const std::string &s) {
+    std::vector<std::string> r;
+    int depth = 0;
+    std::string cur;
+    for (auto c: s) {
+        if (c == '(') ++depth;
+        if (c == ')') --depth;
+        if (c == ',' && depth == 0) {
+            r.push_back(strip(cur));
+            cur.clear();
+        } else {
+            cur += c;
+        }
+    }
+    if (!strip(cur).empty() || !r.empty()) r.push_back(strip(cur));
+    return r;
+}
+
+static std::vector<unsigned char> &bytes() {
+    return obj->sections[cur_section].bytes;
+}
+
+static void put(unsigned long v, int n) {
+    for (int i = 0; i < n; ++i) {
+        bytes().push_back(v & 0xff);
+        v >>= 8;
+    }
+}
+
+static bool fits8(long v) {
+    return v >= -128 && v <= 127;
+}
+
+static bool fits32(long v) {
+    return v >= INT_MIN && v <= INT_MAX;
+}
+
+// modrm [sib] [disp] [imm] of an instruction whose opcode was emitted
+static void modrm(int reg, const operand_t &rm, int imm_size, long imm) {
+    long disp_at = -1;
+    if (rm.kind == OP_REG) {
+        bytes().push_back(0xc0 | ((reg & 7) << 3) | (rm.reg.num & 7));
+    } else if (rm.kind == OP_MEM && rm.rip) {
+        bytes().push_back(((reg & 7) << 3) | 5);
+        disp_at = (long) bytes().size();
+        put(0, 4);
+    } else if (rm.kind == OP_MEM) {
+        long d = rm.value;
+        int base = rm.base;
+        int mod;
+        if (base < 0) {
+            mod = 0;
+        } else if (d == 0 && (base & 7) != 5) {
+            mod = 0;
+        } else if (fits8(d)) {
+            mod = 1;
+        } else {
+            mod = 2;
+        }
+        if (!fits32(d)) throw std::runtime_error("displacement out of range");
+        if (rm.index >= 0 || base < 0 || (base & 7) == 4) {
+            bytes().push_back((mod << 6) | ((reg & 7) << 3) | 4);
+            int ss = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+            int idx = rm.index >= 0 ? (rm.index & 7) : 4;
+            bytes().push_back((ss << 6) | (idx << 3) | (base < 0 ? 5 : (base & 7)));
+        } else {
+            bytes().push_back((mod << 6) | ((reg & 7) << 3) | (base & 7));
+        }
+        if (base < 0) put(d, 4);
+        else if (mod == 1) put(d, 1);
+        else if (mod == 2) put(d, 4);
+    } else {
+        throw std::runtime_error("bad operand");
+    }
+    if (imm_size) put(imm, imm_size);
+    if (disp_at >= 0) {
+        if (rm.sym.empty()) throw std::runtime_error("unsupported absolute rip displacement");
+        fixups.push_back({cur_section, disp_at, (long) bytes().size(), RELOC_PC32, rm.sym, rm.value});
+    }
+}
+
+// emit [prefix] [REX] opcode modrm [sib] [disp] [imm]
+static void emit(int prefix, bool w, const std::vector<unsigned char> &opcode, int reg, const operand_t &rm,
+                 int imm_size = 0, long imm = 0, bool rex8 = false) {
+    if (prefix) bytes().push_back(prefix);
+    unsigned char rex = 0x40;
+    if (w) rex |= 8;
+    if (reg & 8) rex |= 4;
+    if (rm.kind == OP_REG) {
+        if (rm.reg.num & 8) rex |= 1;
+        if (rm.reg.rex8) rex8 = true;
+    } else if (!rm.rip) {
+        if (rm.base >= 0 && (rm.base & 8)) rex |= 1;
+        if (rm.index >= 0 && (rm.index & 8)) rex |= 2;
+    }
+    if (rex != 0x40 || rex8) bytes().push_back(rex);
+    for (auto o: opcode) bytes().push_back(o);
+    modrm(reg, rm, imm_size, imm);
+}
+
+// emit VEX opcode modrm [sib] [disp] [imm]; map 1 = 0f, 2 = 0f38, 3 = 0f3a; pp 0 = none, 1 = 66, 2 = f3, 3 = f2.
+// vvvv is the second source register (0 if unused), the 3-byte form is always used.
+static void emit_vex(int pp, int map, bool w, int vvvv, unsigned char opcode, int reg, const operand_t &rm,
+                     int imm_size = 0, long imm = 0) {
+    bool b = rm.kind == OP_REG ? (rm.reg.num & 8) : (!rm.rip && rm.base >= 0 && (rm.base & 8));
+    bool x = rm.kind == OP_MEM && !rm.rip && rm.index >= 0 && (rm.index & 8);
+    bytes().push_back(0xc4);
+    bytes().push_back(((reg & 8) ? 0 : 0x80) | (x ? 0 : 0x40) | (b ? 0 : 0x20) | map);
+    bytes().push_back((w ? 0x80 : 0) | ((~vvvv & 15) << 3) | pp);
+    bytes().push_back(opcode);
+    modrm(reg, rm, imm_size, imm);
+}
+
+static void emit_rel32(const std::vector<unsigned char> &opcode, const operand_t &target, obj_reloc_type_t type) {
+    for (auto o: opcode) bytes().push_back(o);
+    long at = (long) bytes().size();
+    put(0, 4);
+    fixups.push_back({cur_section, at, (long) bytes().size(), type, target.sym, target.value});
+}
+
+static int op_size(const operand_t &a, const operand_t &b, char suffix) {
+    if (a.kind == OP_REG) return a.reg.size;
+    if (b.kind == OP_REG) return b.reg.size;
+    switch (suffix) {
+        case 'b':
+            return 1;
+        case 'w':
+            return 2;
+        case 'l':
+            return 4;
+        case 'q':
+            return 8;
+        default:
+            throw std::runtime_error("ambiguous operand size");
+    }
+}
+
+static const std::map<std::string, int> alu_ops = {
+        {"add", 0},
+        {"or",  1},
+        {"and", 4},
+        {"sub", 5},
+        {"xor", 6},
+        {"cmp", 7},
+};
+
+static const std::map<std::string, int> shift_ops = {
+        {"shl", 4},
+        {"sal", 4},
+        {"shr", 5},
+        {"sar", 7},
+};
+
+const std::map<std::string, int> amd64_condition_codes = {
+        {"o",  0x0},
+        {"no", 0x1},
+        {"b",  0x2},
+        {"c",  0x2},
+        {"nae", 0x2},
+        {"ae", 0x3},
+        {"nb", 0x3},
+        {"nc", 0x3},
+        {"e",  0x4},
+        {"z",  0x4},
+        {"ne", 0x5},
+        {"nz", 0x5},
+        {"be", 0x6},
+        {"na", 0x6},
+        {"a",  0x7},
+        {"nbe", 0x7},
+        {"s",  0x8},
+        {"ns", 0x9},
+        {"p",  0xa},
+        {"np", 0xb},
+        {"l",  0xc},
+        {"ge", 0xd},
+        {"le", 0xe},
+        {"g",  0xf},
+};
+
+struct sse_op_t {
+    int prefix;
+    std::vector<unsigned char> opcode;
+};
+
+// xmm, xmm/m forms
+static const std::map<std::string, sse_op_t> sse_ops = {
+        {"addsd",    {0xf2, {0x0f, 0x58}}},
+        {"subsd",    {0xf2, {0x0f, 0x5c}}},
+        {"mulsd",    {0xf2, {0x0f, 0x59}}},
+        {"divsd",    {0xf2, {0x0f, 0x5e}}},
+        {"sqrtsd",   {0xf2, {0x0f, 0x51}}},
+        {"minsd",    {0xf2, {0x0f, 0x5d}}},
+        {"maxsd",    {0xf2, {0x0f, 0x5f}}},
+        {"addss",    {0xf3, {0x0f, 0x58}}},
+        {"subss",    {0xf3, {0x0f, 0x5c}}},
+        {"mulss",    {0xf3, {0x0f, 0x59}}},
+        {"divss",    {0xf3, {0x0f, 0x5e}}},
+        {"cvtss2sd", {0xf3, {0x0f, 0x5a}}},
+        {"cvtsd2ss", {0xf2, {0x0f, 0x5a}}},
+        {"comisd",   {0x66, {0x0f, 0x2f}}},
+        {"ucomisd",  {0x66, {0x0f, 0x2e}}},
+        {"comiss",   {0,    {0x0f, 0x2f}}},
+        {"ucomiss",  {0,    {0x0f, 0x2e}}},
+        {"andpd",    {0x66, {0x0f, 0x54}}},
+        {"andnpd",   {0x66, {0x0f, 0x55}}},
+        {"orpd",     {0x66, {0x0f, 0x56}}},
+        {"xorpd",    {0x66, {0x0f, 0x57}}},
+        {"addpd",    {0x66, {0x0f, 0x58}}},
+        {"subpd",    {0x66, {0x0f, 0x5c}}},
+        {"mulpd",    {0x66, {0x0f, 0x59}}},
+        {"divpd",    {0x66, {0x0f, 0x5e}}},
+        {"unpcklpd", {0x66, {0x0f, 0x14}}},
+        {"unpckhpd", {0x66, {0x0f, 0x15}}},
+};
+
+static void encode_mov(const std::string &m, const std::vector<operand_t> &ops) {
+    auto &s = ops[0];
+    auto &d = ops[1];
+    bool sx = s.kind == OP_REG && s.reg.size == 16;
+    bool dx = d.kind == OP_REG && d.reg.size == 16;
+    if (sx || dx) {
+        if (m == "movq") {
+            if (sx && dx) emit(0xf3, false, {0x0f, 0x7e}, d.reg.num, s);
+            else if (dx && s.kind == OP_MEM) emit(0xf3, false, {0x0f, 0x7e}, d.reg.num, s);
+            else if (sx && d.kind == OP_MEM) emit(0x66, false, {0x0f, 0xd6}, s.reg.num, d);
+            else if (dx && s.kind == OP_REG && s.reg.size == 8) emit(0x66, true, {0x0f, 0x6e}, d.reg.num, s);
+            else if (sx && d.kind == OP_REG && d.reg.size == 8) emit(0x66, true, {0x0f, 0x7e}, s.reg.num, d);
+            else throw std::runtime_error("bad movq");
+        } else if (m == "movd") {
+            if (dx && !sx && (s.kind == OP_MEM || s.reg.size == 4)) emit(0x66, false, {0x0f, 0x6e}, d.reg.num, s);
+            else if (sx && !dx && (d.kind == OP_MEM || d.reg.size == 4)) emit(0x66, false, {0x0f, 0x7e}, s.reg.num, d);
+            else throw std::runtime_error("bad movd");
+        } else if (m == "movsd" || m == "movss") {
+            int p = m == "movsd" ? 0xf2 : 0xf3;
+            if (dx) emit(p, false, {0x0f, 0x10}, d.reg.num, s);
+            else emit(p, false, {0x0f, 0x11}, s.reg.num, d);
+        } else if (m == "movapd" || m == "movupd") {
+            unsigned char o = m == "movapd" ? 0x28 : 0x10;
+            if (dx) emit(0x66, false, {0x0f, o}, d.reg.num, s);
+            else emit(0x66, false, {0x0f, (unsigned char) (o + 1)}, s.reg.num, d);
+        } else {
+            throw std::runtime_error("bad operands for " + m);
+        }
+        return;
+    }
+    // integer moves; a movd without xmm operand is treated as a 32-bit mov
+    char suffix = m == "movd" ? 'l' : (m.size() == 4 ? m[3] : 0);
+    int size = op_size(s, d, suffix);
+    int prefix = size == 2 ? 0x66 : 0;
+    bool w = size == 8;
+    unsigned char byte = size == 1 ? 0 : 1;
+    if (s.kind == OP_IMM) {
+        if (!s.sym.empty()) throw std::runtime_error("unsupported symbolic immediate");
+        if (d.kind == OP_REG) {
+            if (size == 8 && fits32(s.value)) {
+                emit(0, true, {0xc7}, 0, d, 4, s.value);
+            } else {
+                if (prefix) bytes().push_back(prefix);
+                unsigned char rex = 0x40 | (w ? 8 : 0) | ((d.reg.num & 8) ? 1 : 0);
+                if (rex != 0x40 || d.reg.rex8) bytes().push_back(rex);
+                bytes().push_back((size == 1 ? 0xb0 : 0xb8) + (d.reg.num & 7));
+                put(s.value, size);
+            }
+        } else {
+            emit(prefix, w, {(unsigned char) (0xc6 | byte)}, 0, d, size == 8 ? 4 : size, s.value);
+        }
+    } else if (s.kind == OP_REG && (d.kind == OP_REG || d.kind == OP_MEM)) {
+        emit(prefix, w, {(unsigned char) (0x88 | byte)}, s.reg.num, d, 0, 0, s.reg.rex8);
+    } else if (s.kind == OP_MEM && d.kind == OP_REG) {
+        emit(prefix, w, {(unsigned char) (0x8a | byte)}, d.reg.num, s, 0, 0, d.reg.rex8);
+    } else {
+        throw std::runtime_error("bad operands for " + m);
+    }
+}
+
+static void encode_insn(std::string m, const std::vector<operand_t> &ops) {
+    auto expect = [&](size_t n) {
+        if (ops.size() != n) throw std::runtime_error("wrong number of operands for " + m);
+    };
+    auto reg_of = [&](const operand_t &o) {
+        if (o.kind != OP_REG) throw std::runtime_error("register expected for " + m);
+        return o.reg;
+    };
+    if (m == "ret" || m == "retq") {
+        expect(0);
+        bytes().push_back(0xc3);
+        return;
+    }
+    if (m == "nop") {
+        expect(0);
+        bytes().push_back(0x90);
+        return;
+    }
+    if (m == "call" || m == "callq" || m == "jmp" || m == "jmpq") {
+        expect(1);
+        bool call = m[0] == 'c';
+        if (ops[0].indirect) {
+            emit(0, false, {0xff}, call ? 2 : 4, ops[0]);
+        } else if (ops[0].kind == OP_LABEL) {
+            emit_rel32({(unsigned char) (call ? 0xe8 : 0xe9)}, ops[0], RELOC_PLT32);
+        } else {
+            throw std::runtime_error("bad operand for " + m);
+        }
+        return;
+    }
+    if (m[0] == 'j' && amd64_condition_codes.contains(m.substr(1))) {
+        expect(1);
+        if (ops[0].kind != OP_LABEL) throw std::runtime_error("bad operand for " + m);
+        emit_rel32({0x0f, (unsigned char) (0x80 | amd64_condition_codes.at(m.substr(1)))}, ops[0], RELOC_PC32);
+        return;
+    }
+    if (m.starts_with("set") && amd64_condition_codes.contains(m.substr(3))) {
+        expect(1);
+        if (ops[0].kind == OP_REG && ops[0].reg.size != 1) throw std::runtime_error("bad operand for " + m);
+        emit(0, false, {0x0f, (unsigned char) (0x90 | amd64_condition_codes.at(m.substr(3)))}, 0, ops[0]);
+        return;
+    }
+    if (m == "push" || m == "pushq" || m == "pop" || m == "popq") {
+        expect(1);
+        auto r = reg_of(ops[0]);
+        if (r.size != 8) throw std::runtime_error("bad operand for " + m);
+        if (r.num & 8) bytes().push_back(0x41);
+        bytes().push_back((m[1] == 'u' ? 0x50 : 0x58) + (r.num & 7));
+        return;
+    }
+    if (m == "mov" || m == "movq" || m == "movl" || m == "movw" || m == "movb" || m == "movd" || m == "movsd" ||
+        m == "movss" || m == "movapd" || m == "movupd") {
+        expect(2);
+        encode_mov(m, ops);
+        return;
+    }
+    if (m == "movsx" || m == "movsbq" || m == "movswq" || m == "movsxd" || m == "movslq") {
+        expect(2);
+        auto d = reg_of(ops[1]);
+        int ss = ops[0].kind == OP_REG ? ops[0].reg.size : (m == "movsbq" ? 1 : m == "movswq" ? 2 : 4);
+        if (ss == 4) emit(0, d.size == 8, {0x63}, d.num, ops[0]);
+        else emit(d.size == 2 ? 0x66 : 0, d.size == 8, {0x0f, (unsigned char) (ss == 1 ? 0xbe : 0xbf)}, d.num,
+                  ops[0], 0, 0, ops[0].kind == OP_REG && ops[0].reg.rex8);
+        return;
+    }
+    if (m == "lea" || m == "leaq") {
+        expect(2);
+        auto d = reg_of(ops[1]);
+        if (ops[0].kind != OP_MEM) throw std::runtime_error("bad operand for " + m);
+        emit(0, d.size == 8, {0x8d}, d.num, ops[0]);
+        return;
+    }
+    if (m == "imul" || m == "imulq") {
+        expect(2);
+        auto d = reg_of(ops[1]);
+        emit(0, d.size == 8, {0x0f, 0xaf}, d.num, ops[0]);
+        return;
+    }
+    if (m == "cqo" || m == "cqto") {
+        expect(0);
+        put(0x9948, 2);
+        return;
+    }
+    if (m == "cvtsi2sd" || m == "cvtsi2sdq" || m == "cvtsi2sdl" || m == "cvtsi2ss" || m == "cvtsi2ssq" ||
+        m == "cvtsi2ssl") {
+        expect(2);
+        auto d = reg_of(ops[1]);
+        bool w = ops[0].kind == OP_REG ? ops[0].reg.size == 8 : m.back() == 'q';
+        emit(m[7] == 'd' ? 0xf2 : 0xf3, w, {0x0f, 0x2a}, d.num, ops[0]);
+        return;
+    }
+    if (m == "cvtsd2si" || m == "cvttsd2si" || m == "cvtss2si" || m == "cvttss2si") {
+        expect(2);
+        auto d = reg_of(ops[1]);
+        bool t = m[3] == 't';
+        bool dbl = m[t ? 5 : 4] == 'd';
+        emit(dbl ? 0xf2 : 0xf3, d.size == 8, {0x0f, (unsigned char) (t ? 0x2c : 0x2d)}, d.num, ops[0]);
+        return;
+    }
+    // SSE4.1 and BMI2 of --march=x86-64-v2 and above
+    if (m == "roundsd") {
+        expect(3);
+        if (ops[0].kind != OP_IMM || !ops[0].sym.empty()) throw std::runtime_error("bad operand for " + m);
+        emit(0x66, false, {0x0f, 0x3a, 0x0b}, reg_of(ops[2]).num, ops[1], 1, ops[0].value);
+        return;
+    }
+    if (m == "rorx" || m == "rorxq") {
+        expect(3);
+        if (ops[0].kind != OP_IMM || !ops[0].sym.empty()) throw std::runtime_error("bad operand for " + m);
+        auto d = reg_of(ops[2]);
+        emit_vex(3, 3, d.size == 8, 0, 0xf0, d.num, ops[1], 1, ops[0].value);
+        return;
+    }
+    if (sse_ops.contains(m)) {
+        expect(2);
+        auto &o = sse_ops.at(m);
+        emit(o.prefix, false, o.opcode, reg_of(ops[1]).num, ops[0]);
+        return;
+    }
+    // integer instructions with optional size suffix
+    std::string base = m;
+    char suffix = 0;
+    auto known = [&](const std::string &b) {
+        return alu_ops.contains(b) || shift_ops.contains(b) || b == "neg" || b == "not" || b == "test" ||
+               b == "inc" || b == "dec";
+    };
+    if (!known(base) && base.size() > 1 && strchr("bwlq", base.back())) {
+        suffix = base.back();
+        base.pop_back();
+    }
+    if (!known(base)) throw std::runtime_error("unsupported instruction: " + m);
+    if (base == "neg" || base == "not" || base == "inc" || base == "dec") {
+        expect(1);
+        int size = op_size(ops[0], ops[0], suffix);
+        int ext = base == "neg" ? 3 : base == "not" ? 2 : base == "inc" ? 0 : 1;
+        unsigned char op = (base == "inc" || base == "dec") ? 0xfe : 0xf6;
+        emit(size == 2 ? 0x66 : 0, size == 8, {(unsigned char) (op | (size == 1 ? 0 : 1))}, ext, ops[0]);
+        return;
+    }
+    expect(2);
+    auto &s = ops[0];
+    auto &d = ops[1];
+    int size = op_size(s, d, suffix);
+    int prefix = size == 2 ? 0x66 : 0;
+    bool w = size == 8;
+    unsigned char byte = size == 1 ? 0 : 1;
+    if (shift_ops.contains(base)) {
+        if (s.kind != OP_IMM || !s.sym.empty()) throw std::runtime_error("bad operand for " + m);
+        int sz = op_size(d, d, suffix);
+        emit(sz == 2 ? 0x66 : 0, sz == 8, {(unsigned char) (0xc0 | (sz == 1 ? 0 : 1))}, shift_ops.at(base), d, 1,
+             s.value);
+        return;
+    }
+    if (base == "test") {
+        if (s.kind == OP_REG) emit(prefix, w, {(unsigned char) (0x84 | byte)}, s.reg.num, d);
+        else if (s.kind == OP_IMM) emit(prefix, w, {(unsigned char) (0xf6 | byte)}, 0, d, size == 8 ? 4 : size, s.value);
+        else throw std::runtime_error("bad operands for " + m);
+        return;
+    }
+    int ext = alu_ops.at(base);
+    if (s.kind == OP_IMM) {
+        if (!s.sym.empty()) throw std::runtime_error("unsupported symbolic immediate");
+        if (size == 1) emit(0, false, {0x80}, ext, d, 1, s.value);
+        else if (fits8(s.value)) emit(prefix, w, {0x83}, ext, d, 1, s.value);
+        else emit(prefix, w, {0x81}, ext, d, size == 2 ? 2 : 4, s.value);
+    } else if (s.kind == OP_REG) {
+        emit(prefix, w, {(unsigned char) ((ext << 3) | byte)}, s.reg.num, d, 0, 0, s.reg.rex8);
+    } else if (s.kind == OP_MEM && d.kind == OP_REG) {
+        emit(prefix, w, {(unsigned char) ((ext << 3) | 2 | byte)}, d.reg.num, s, 0, 0, d.reg.rex8);
+    } else {
+        throw std::runtime_error("bad operands for " + m);
+    }
+}
+
+static long section_index(const std::string &name) {
+    for (size_t i = 0; i < obj->sections.size(); ++i) {
+        if (obj->sections[i].name == name) return i;
+    }
+    obj_section_t s{};
+    s.name = name;
+    s.type = SHT_PROGBITS;
+    if (name.starts_with(".text")) s.flags = SHF_ALLOC | SHF_EXECINSTR;
+    else if (name.starts_with(".data")) s.flags = SHF_ALLOC | SHF_WRITE;
+    else if (name.starts_with(".rodata")) s.flags = SHF_ALLOC;
+    else if (name.starts_with(".bss")) {
+        throw std::runtime_error("unsupported section: " + name);
+    } else s.flags = 0;
+    obj->sections.push_back(s);
+    return (long) obj->sections.size() - 1;
+}
+
+static void define_label(const std::string &name) {
+    auto &sym = obj->symbols[name];
+    if (sym.section >= 0 || sym.absolute) throw std::runtime_error("symbol redefined: " + name);
+    sym.section = cur_section;
+    sym.value = (long) bytes().size();
+}
+
+static void encode_data(int size, const std::string &args) {
+    for (auto &a: amd64_split_operands(args)) {
+        std::string sym;
+        long v;
+        amd64_parse_expr(a, sym, v);
+        if (!sym.empty()) {
+            if (size != 8 && size != 4) throw std::runtime_error("unsupported data relocation");
+            fixups.push_back({cur_section, (long) bytes().size(), 0, size == 8 ? RELOC_ABS64 : RELOC_ABS32, sym, v});
+            v = 0;
+        }
+        put(v, size);
+    }
+}
+
+static void encode_directive(const std::string &d, const std::string &args) {
+    if (d == ".section" || d == ".text" || d == ".data") {
+        std::string name = d == ".section" ? strip(amd64_split_operands(args).front()) : d;
+        cur_section = section_index(name);
+    } else if (d == ".global" || d == ".globl") {
+        obj->symbols[strip(args)].global = true;
+    } else if (d == ".balign" || d == ".p2align") {
+        long a;
+        if (!amd64_parse_number(strip(amd64_split_operands(args).front()), a)) throw std::runtime_error("bad alignment");
+        if (d == ".p2align") a = 1l << a;
+        auto &s = obj->sections[cur_section];
+        if (a > s.align) s.align = a;
+        unsigned char pad = (s.flags & SHF_EXECINSTR) ? 0x90 : 0;
+        while (s.bytes.size() % a) s.bytes.push_back(pad);
+    } else if (d == ".fill") {
+        auto a = amd64_split_operands(args);
+        long n, sz = 1, v = 0;
+        if (a.empty() || !amd64_parse_number(a[0], n) || (a.size() > 1 && !amd64_parse_number(a[1], sz)) ||
+            (a.size() > 2 && !amd64_parse_number(a[2], v)) || sz < 0 || sz > 8) {
+            throw std::runtime_error("bad .fill");
+        }
+        for (long i = 0; i < n; ++i) put(v, (int) sz);
+    } else if (d == ".zero" || d == ".skip" || d == ".space") {
+        long n;
+        if (!amd64_parse_number(strip(args), n)) throw std::runtime_error("bad " + d);
+        bytes().insert(bytes().end(), n, 0);
+    } else if (d == ".byte") {
+        encode_data(1, args);
+    } else if (d == ".short" || d == ".word" || d == ".2byte") {
+        encode_data(2, args);
+    } else if (d == ".long" || d == ".int" || d == ".4byte") {
+        encode_data(4, args);
+    } else if (d == ".quad" || d == ".8byte") {
+        encode_data(8, args);
+    } else if (d == ".set" || d == ".equ") {
+        auto a = amd64_split_operands(args);
+        long v;
+        if (a.size() != 2 || !amd64_parse_number(a[1], v)) throw std::runtime_error("bad " + d);
+        auto &sym = obj->symbols[a[0]];
+        if (sym.section >= 0) throw std::runtime_error("symbol redefined: " + a[0]);
+        sym.absolute = true;
+        sym.value = v;
+    } else if (d == ".file" || d == ".loc" || d == ".type" || d == ".size" || d.starts_with(".cfi_")) {
+        // debug information is only written by an external assembler
+    } else {
+        throw std::runtime_error("unsupported directive: " + d);
+    }
+}
+
+static void parse_line(amd64_line_t &l, std::string line) {
+    line = strip(line);
+    if (line.empty() || line.starts_with("//") || line[0] == '#') return;
+    auto colon = line.find(':');
+    if (colon != std::string::npos) {
+        auto name = line.substr(0, colon);
+        bool label = !name.empty();
+        for (auto c: name) if (!isalnum(c) && c != '_' && c != '.' && c != '$') label = false;
+        if (label) {
+            l.labels.push_back(name);
+            parse_line(l, line.substr(colon + 1));
+            return;
+        }
+    }
+    size_t i = 0;
+    while (i < line.size() && !isspace(line[i])) ++i;
+    l.mnemonic = line.substr(0, i);
+    l.args = line.substr(i);
+    if (l.mnemonic[0] == '.') return;
+    for (auto &o: amd64_split_operands(l.args)) l.ops.push_back(parse_operand(o));
+}
+
+static std::runtime_error line_error(const amd64_line_t &l, const std::runtime_error &e) {
+    return std::runtime_error("assembly line " + std::to_string(l.line) + ": " + e.what() + " (" + l.text + ")");
+}
+
+std::vector<amd64_line_t> amd64_parse(const std::string &text) {
+    init_registers();
+    std::vector<amd64_line_t> r;
+    std::stringstream ss(text);
+    std::string line;
+    long n = 0;
+    while (std::getline(ss, line)) {
+        amd64_line_t l{};
+        l.line = ++n;
+        l.text = strip(line);
+        try {
+            parse_line(l, line);
+        } catch (const std::runtime_error &e) {
+            throw line_error(l, e);
+        }
+        if (!l.labels.empty() || !l.mnemonic.empty()) r.push_back(std::move(l));
+    }
+    return r;
+}
+
+static void resolve_fixups() {
+    for (auto &f: fixups) {
+        auto &sec = obj->sections[f.section];
+        auto it = obj->symbols.find(f.sym);
+        bool defined = it != obj->symbols.end() && (it->second.section >= 0 || it->second.absolute);
+        if (f.type == RELOC_PC32 || f.type == RELOC_PLT32) {
+            long v;
+            if (defined && it->second.section == f.section) {
+                v = it->second.value + f.addend - f.end;
+                if (!fits32(v)) throw std::runtime_error("branch out of range");
+                for (int i = 0; i < 4; ++i) sec.bytes[f.offset + i] = (v >> (8 * i)) & 0xff;
+                continue;
+            }
+            if (defined && it->second.absolute) throw std::runtime_error("unsupported pc-relative absolute: " + f.sym);
+            v = f.addend - (f.end - f.offset);
+            if (defined && !it->second.global) {
+                sec.relocs.push_back({f.offset, RELOC_PC32, it->second.section, "", v + it->second.value});
+            } else {
+                sec.relocs.push_back({f.offset, defined ? RELOC_PC32 : f.type, -1, f.sym, v});
+            }
+        } else {
+            if (defined && it->second.absolute) {
+                long v = it->second.value + f.addend;
+                for (int i = 0; i < (f.type == RELOC_ABS64 ? 8 : 4); ++i) sec.bytes[f.offset + i] = (v >> (8 * i)) & 0xff;
+            } else if (defined && !it->second.global) {
+                sec.relocs.push_back({f.offset, f.type, it->second.section, "", f.addend + it->second.value});
+            } else {
+                sec.relocs.push_back({f.offset, f.type, -1, f.sym, f.addend});
+            }
+        }
+        if (!defined) obj->symbols[f.sym];
+    }
+}
+
+obj_t obj_assemble(const std::string &text) {
+    auto lines = amd64_parse(text);
+    obj_t o{};
+    obj = &o;
+    fixups.clear();
+    cur_section = section_index(".text");
+    for (auto &l: lines) {
+        try {
+            for (auto &label: l.labels) define_label(label);
+            if (l.mnemonic.empty()) continue;
+            if (l.mnemonic[0] == '.') encode_directive(l.mnemonic, l.args);
+            else encode_insn(l.mnemonic, l.ops);
+        } catch (const std::runtime_error &e) {
+            throw line_error(l, e);
+        }
+    }
+    resolve_fixups();
+    obj = nullptr;
+    return o;
+}
+
+static long add_string(std::string &table, const std::string &s) {
+    long r = (long) table.size();
+    table += s;
+    table += '\0';
+    return r;
+}
+
+void obj_write_elf(const obj_t &o, std::ostream &out) {
+    std::string strtab(1, '\0');
+    std::string shstrtab(1, '\0');
+    std::vector<Elf64_Sym> syms(1);
+    std::map<std::string, long> sym_index;
+
+    // section symbols, local symbols, then globals (ELF requires locals first)
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        Elf64_Sym s{};
+        s.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        s.st_shndx = i + 1;
+        syms.push_back(s);
+    }
+    for (auto &[name, sym]: o.symbols) {
+        if (sym.global || name.starts_with(".L")) continue;
+        if (sym.section < 0 && !sym.absolute) continue;
+        Elf64_Sym s{};
+        s.st_name = add_string(strtab, name);
+        s.st_info = ELF64_ST_INFO(STB_LOCAL, STT_NOTYPE);
+        s.st_shndx = sym.absolute ? SHN_ABS : sym.section + 1;
+        s.st_value = sym.value;
+        sym_index[name] = (long) syms.size();
+        syms.push_back(s);
+    }
+    long first_global = (long) syms.size();
+    for (auto &[name, sym]: o.symbols) {
+        bool undefined = sym.section < 0 && !sym.absolute;
+        if (!sym.global && !undefined) continue;
+        Elf64_Sym s{};
+        s.st_name = add_string(strtab, name);
+        s.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+        s.st_shndx = sym.absolute ? SHN_ABS : undefined ? SHN_UNDEF : sym.section + 1;
+        s.st_value = sym.value;
+        sym_index[name] = (long) syms.size();
+        syms.push_back(s);
+    }
+
+    struct out_section_t {
+        Elf64_Shdr hdr;
+        std::string data;
+    };
+    std::vector<out_section_t> secs(1);
+    for (auto &s: o.sections) {
+        out_section_t os{};
+        os.hdr.sh_name = add_string(shstrtab, s.name);
+        os.hdr.sh_type = s.type;
+        os.hdr.sh_flags = s.flags;
+        os.hdr.sh_addralign = s.align;
+        os.data.assign(s.bytes.begin(), s.bytes.end());
+        secs.push_back(os);
+    }
+    long symtab_index = (long) (secs.size() + std::count_if(o.sections.begin(), o.sections.end(), [](auto &s) {
+        return !s.relocs.empty();
+    }));
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        auto &s = o.sections[i];
+        if (s.relocs.empty()) continue;
+        out_section_t os{};
+        os.hdr.sh_name = add_string(shstrtab, ".rela" + s.name);
+        os.hdr.sh_type = SHT_RELA;
+        os.hdr.sh_flags = SHF_INFO_LINK;
+        os.hdr.sh_addralign = 8;
+        os.hdr.sh_entsize = sizeof(Elf64_Rela);
+        os.hdr.sh_link = symtab_index;
+        os.hdr.sh_info = i + 1;
+        for (auto &r: s.relocs) {
+            Elf64_Rela rela{};
+            unsigned type;
+            switch (r.type) {
+                case RELOC_PC32:
+                    type = R_X86_64_PC32;
+                    break;
+                case RELOC_PLT32:
+                    type = R_X86_64_PLT32;
+                    break;
+                case RELOC_ABS32:
+                    type = R_X86_64_32;
+                    break;
+                case RELOC_ABS64:
+                    type = R_X86_64_64;
+                    break;
+            }
+            long si = r.section >= 0 ? r.section + 1 : sym_index.at(r.symbol);
+            rela.r_offset = r.offset;
+            rela.r_info = ELF64_R_INFO(si, type);
+            rela.r_addend = r.addend;
+            os.data.append((const char *) &rela, sizeof(rela));
+        }
+        secs.push_back(os);
+    }
+    out_section_t symtab{};
+    symtab.hdr.sh_name = add_string(shstrtab, ".symtab");
+    symtab.hdr.sh_type = SHT_SYMTAB;
+    symtab.hdr.sh_addralign = 8;
+    symtab.hdr.sh_entsize = sizeof(Elf64_Sym);
+    symtab.hdr.sh_link = symtab_index + 1;
+    symtab.hdr.sh_info = first_global;
+    symtab.data.assign((const char *) syms.data(), syms.size() * sizeof(Elf64_Sym));
+    secs.push_back(symtab);
+    out_section_t str{};
+    str.hdr.sh_name = add_string(shstrtab, ".strtab");
+    str.hdr.sh_type = SHT_STRTAB;
+    str.hdr.sh_addralign = 1;
+    str.data = strtab;
+    secs.push_back(str);
+    out_section_t shstr{};
+    shstr.hdr.sh_name = add_string(shstrtab, ".shstrtab");
+    shstr.hdr.sh_type = SHT_STRTAB;
+    shstr.hdr.sh_addralign = 1;
+    shstr.data = shstrtab;
+    secs.push_back(shstr);
+
+    std::string file(sizeof(Elf64_Ehdr), '\0');
+    for (size_t i = 1; i < secs.size(); ++i) {
+        auto a = std::max<long>(1, (long) secs[i].hdr.sh_addralign);
+        while (file.size() % a) file += '\0';
+        secs[i].hdr.sh_offset = file.size();
+        secs[i].hdr.sh_size = secs[i].data.size();
+        file += secs[i].data;
+    }
+    while (file.size() % 8) file += '\0';
+    Elf64_Ehdr eh{};
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = file.size();
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = secs.size();
+    eh.e_shstrndx = secs.size() - 1;
+    memcpy(file.data(), &eh, sizeof(eh));
+    for (auto &s: secs) file.append((const char *) &s.hdr, sizeof(s.hdr));
+    out.write(file.data(), (long) file.size());
+}
+
+static long round_up(long v, long a) {
+    return (v + a - 1) / a * a;
+}
+
+// Runtime variables are read rip-relative (INPUT__reset), so with such references the mapping has to
+// be placed within rel32 range of the compiler image.
+static unsigned char *map_near(long size, const std::vector<unsigned long> &variables) {
+    if (variables.empty()) {
+        auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::runtime_error("cannot map memory for --run");
+        return (unsigned char *) p;
+    }
+    auto [lo, hi] = std::minmax_element(variables.begin(), variables.end());
+    const long step = 1l << 24;
+    for (long k = 1; k < 64; ++k) {
+        for (long hint: {round_up((long) *hi, step) + k * step, (long) *lo / step * step - k * step - size}) {
+            if (hint <= 0) continue;
+            auto p = mmap((void *) hint, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+            if (p == MAP_FAILED) continue;
+            // kernels without MAP_FIXED_NOREPLACE take the address as a hint only
+            if ((long) p == hint && fits32((long) *hi - hint) && fits32(hint + size - (long) *lo)) {
+                return (unsigned char *) p;
+            }
+            munmap(p, size);
+        }
+    }
+    throw std::runtime_error("cannot map memory near the runtime for --run");
+}
+
+// Load the object into executable memory and call main. Every section gets its own pages; calls to
+// symbols outside the object go through a jump stub because the runtime (linked into the compiler)
+// is usually not within rel32 range of the mapping.
+int obj_run(const obj_t &o) {
+    long page = sysconf(_SC_PAGESIZE);
+    std::vector<long> offsets(o.sections.size(), -1);
+    long size = 0;
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        if (!(o.sections[i].flags & SHF_ALLOC)) continue;
+        offsets[i] = size;
+        size = round_up(size + std::max<long>(1, (long) o.sections[i].bytes.size()), page);
+    }
+    std::map<std::string, long> stubs;
+    for (auto &s: o.sections) {
+        for (auto &r: s.relocs) {
+            if (r.section >= 0) continue;
+            auto &sym = o.symbols.at(r.symbol);
+            if (sym.section < 0 && !sym.absolute && !stubs.contains(r.symbol)) {
+                long n = (long) stubs.size();
+                stubs[r.symbol] = n;
+            }
+        }
+    }
+    long stub_offset = size;
+    size = round_up(size + std::max<long>(1, (long) stubs.size() * 16), page);
+
+    std::map<std::string, unsigned long> external;
+    std::vector<unsigned long> variables;
+    for (auto &[name, n]: stubs) {
+        void *addr = dlsym(RTLD_DEFAULT, name.c_str());
+        if (!addr) throw std::runtime_error("undefined reference to " + name);
+        external[name] = (unsigned long) addr;
+    }
+    for (auto &s: o.sections) {
+        for (auto &r: s.relocs) {
+            if (r.section < 0 && r.type == RELOC_PC32 && external.contains(r.symbol)) {
+                variables.push_back(external.at(r.symbol));
+            }
+        }
+    }
+
+    auto base = map_near(size, variables);
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        if (offsets[i] < 0) continue;
+        memcpy(base + offsets[i], o.sections[i].bytes.data(), o.sections[i].bytes.size());
+    }
+    for (auto &[name, n]: stubs) {
+        auto addr = external.at(name);
+        // jmp *0(%rip); .quad addr
+        unsigned char *stub = base + stub_offset + 16 * n;
+        const unsigned char jmp[] = {0xff, 0x25, 0, 0, 0, 0};
+        memcpy(stub, jmp, sizeof(jmp));
+        memcpy(stub + sizeof(jmp), &addr, sizeof(addr));
+    }
+    auto address = [&](const std::string &name, bool call) -> unsigned long {
+        auto &sym = o.symbols.at(name);
+        if (sym.absolute) return sym.value;
+        if (sym.section >= 0) return (unsigned long) (base + offsets[sym.section] + sym.value);
+        if (call) return (unsigned long) (base + stub_offset + 16 * stubs.at(name));
+        return external.at(name);
+    };
+
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        if (offsets[i] < 0) continue;
+        unsigned char *sec = base + offsets[i];
+        for (auto &r: o.sections[i].relocs) {
+            unsigned long s = r.section >= 0 ? (unsigned long) (base + offsets[r.section])
+                                             : address(r.symbol, r.type == RELOC_PLT32);
+            unsigned long v = s + r.addend;
+            switch (r.type) {
+                case RELOC_PC32:
+                case RELOC_PLT32: {
+                    long d = (long) (v - (unsigned long) (sec + r.offset));
+                    if (!fits32(d)) throw std::runtime_error("relocation out of range for --run");
+                    auto d32 = (int) d;
+                    memcpy(sec + r.offset, &d32, 4);
+                    break;
+                }
+                case RELOC_ABS32: {
+                    if (v > UINT_MAX) throw std::runtime_error("relocation out of range for --run");
+                    auto v32 = (unsigned) v;
+                    memcpy(sec + r.offset, &v32, 4);
+                    break;
+                }
+                case RELOC_ABS64:
+                    memcpy(sec + r.offset, &v, 8);
+                    break;
+            }
+        }
+    }
+    for (size_t i = 0; i < o.sections.size(); ++i) {
+        if (offsets[i] < 0 || !(o.sections[i].flags & SHF_EXECINSTR)) continue;
+        mprotect(base + offsets[i], round_up(std::max<long>(1, (long) o.sections[i].bytes.size()), page),
+                 PROT_READ | PROT_EXEC);
+    }
+    mprotect(base + stub_offset, size - stub_offset, PROT_READ | PROT_EXEC);
+
+    if (o.symbols.contains("DATA__begin")) {
+        DATA__jit_begin = (struct dt **) address("DATA__begin", false);
+        DATA__jit_end = (struct dt **) address("DATA__end", false);
+    }
+    if (!o.symbols.contains("main")) throw std::runtime_error("undefined reference to main");
+    auto entry = (int (*)()) address("main", false);
+    // the runtime reports raised FP exceptions, so do not leak the compiler's
+    fesetenv(FE_DFL_ENV);
+    return entry();
+}
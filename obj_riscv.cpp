@@ -0,0 +1,21 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <stdexcept>
+#include "obj.h"
+
+obj_t obj_assemble(const std::string &) {
+    throw std::runtime_error("object output is not supported on riscv64, use an assembler");
+}
+
+void obj_write_elf(const obj_t &, std::ostream &) {
+    throw std::runtime_error("object output is not supported on riscv64, use an assembler");
+}
+
+int obj_run(const obj_t &) {
+    throw std::runtime_error("--run is not supported on riscv64");
+}
+
+int obj_interpret(const std::string &) {
+    throw std::runtime_error("--interp is not supported on riscv64");
+}
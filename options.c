@@ -0,0 +1,21 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include "options.h"
+
+struct options_t options = {
+        .obj = 0,
+        .run = 0,
+        .interp = 0,
+        .jobs = 1,
+        .stats = 0,
+        .debug = 0,
+        .profile = 0,
+        .infer_int = 0,
+        .seeded = 0,
+        .seed = 0,
+        .profile_file = 0,
+        .profile_use = 0,
+        .profile_use_file = 0,
+        .march = 0
+};
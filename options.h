@@ -0,0 +1,41 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_OPTIONS_H
+#define SMOLBASIC55_OPTIONS_H
+
+// --march=: extensions the backend may use besides its baseline (SSE2 on amd64, RV64GC on riscv64)
+enum {
+    MARCH_SSE4_1 = 1,
+    MARCH_AVX2 = 2,
+    MARCH_FMA = 4,
+    MARCH_BMI2 = 8,
+    MARCH_AVX512 = 16,
+    MARCH_RVV = 32,
+    MARCH_ZBA = 64,
+    MARCH_ZBB = 128
+};
+
+struct options_t {
+    int obj;
+    int run;
+    int interp;
+    int jobs;
+    int stats;
+    int debug;
+    int profile;
+    int infer_int;
+    // --seed=N: RND starts from (and RANDOMIZE returns to) RND__seed(seed)
+    int seeded;
+    unsigned long seed;
+    const char *profile_file;
+    // --profile-use: lay out and unroll by the counts of an earlier --profile run
+    int profile_use;
+    const char *profile_use_file;
+    // MARCH_* of --march=
+    unsigned march;
+};
+
+extern struct options_t options;
+
+#endif //SMOLBASIC55_OPTIONS_H
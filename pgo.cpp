@@ -0,0 +1,41 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "pgo.h"
+
+static std::map<long, long> counts{};
+static long total = 0;
+
+bool pgo_load(const char *path) {
+    std::ifstream in(path);
+    if (!in) return true;
+    std::string l;
+    // LINE COUNT PERCENT, see profile.c
+    std::getline(in, l);
+    while (std::getline(in, l)) {
+        std::istringstream s(l);
+        long line, count;
+        if (!(s >> line >> count)) return false;
+        counts[line] = count;
+        total += count;
+    }
+    return true;
+}
+
+std::optional<long> pgo_count(long l) {
+    auto it = counts.find(l);
+    if (it == counts.end()) return std::nullopt;
+    return it->second;
+}
+
+bool pgo_cold(long l) {
+    return pgo_count(l) == 0;
+}
+
+bool pgo_hot(long l) {
+    auto c = pgo_count(l);
+    return c && *c * 100 >= total && *c > 0;
+}
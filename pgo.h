@@ -0,0 +1,21 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_PGO_H
+#define SMOLBASIC55_PGO_H
+
+#include <optional>
+
+// line counts of an earlier run compiled with --profile, read by --profile-use. How often an IF jumps follows from
+// the counts of the IF line and the line after it.
+
+// a missing file is no profile, false if the file is not a profile
+bool pgo_load(const char *path);
+// how often line l ran, nothing without a profile or for a line the profile does not know
+std::optional<long> pgo_count(long l);
+// line l never ran
+bool pgo_cold(long l);
+// line l took at least 1% of all line runs
+bool pgo_hot(long l);
+
+#endif //SMOLBASIC55_PGO_H
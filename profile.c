@@ -0,0 +1,48 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include<stdio.h>
+#include<stdlib.h>
+
+// counters written by code compiled with --profile, one per line
+static long *counts;
+static long n;
+static const long *line_numbers;
+static const char *file;
+
+static int PROFILE__cmp(const void *a, const void *b) {
+    long i = *(const long *) a, j = *(const long *) b;
+    if (counts[i] != counts[j]) return counts[i] < counts[j] ? 1 : -1;
+    return line_numbers[i] < line_numbers[j] ? -1 : line_numbers[i] > line_numbers[j];
+}
+
+static void PROFILE__write() {
+    long *order = malloc(n * sizeof(long));
+    long total = 0;
+    for (long i = 0; i < n; ++i) {
+        order[i] = i;
+        total += counts[i];
+    }
+    qsort(order, n, sizeof(long), PROFILE__cmp);
+    FILE *f = fopen(file, "w");
+    if (!f) {
+        fprintf(stderr, "error: cannot write profile %s\n", file);
+        free(order);
+        return;
+    }
+    fprintf(f, "%8s %14s %8s\n", "LINE", "COUNT", "PERCENT");
+    for (long i = 0; i < n; ++i) {
+        long k = order[i];
+        fprintf(f, "%8li %14li %7.2f%%\n", line_numbers[k], counts[k], total ? 100.0 * counts[k] / total : 0.0);
+    }
+    fclose(f);
+    free(order);
+}
+
+void PROFILE__start(long *begin, long *end, const long *lines, const char *path) {
+    counts = begin;
+    n = end - begin;
+    line_numbers = lines;
+    file = path;
+    atexit(PROFILE__write);
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include "regalloc.h"
+#include "eval.h"
+
+struct line_info_t {
+    std::map<std::string, long> uses;
+    std::set<std::string> refs;
+    std::vector<long> jumps;
+    bool barrier = false;
+};
+
+static std::map<long, line_info_t> infos{};
+static std::vector<regalloc_region_t> regions{};
+bool regalloc_collect = true;
+thread_local const regalloc_region_t *regalloc_current = nullptr;
+
+void regalloc_use(std::string_view var, bool as_reference) {
+    if (!regalloc_collect) return;
+    auto &i = infos[line_no];
+    if (as_reference) i.refs.emplace(var);
+    else ++i.uses[std::string(var)];
+}
+
+void regalloc_jump(long to) {
+    if (!regalloc_collect) return;
+    infos[line_no].jumps.push_back(to);
+}
+
+// the line cannot be part of a region (DEF, inline assembly)
+void regalloc_barrier() {
+    if (!regalloc_collect) return;
+    infos[line_no].barrier = true;
+}
+
+static long loop_depth(long l) {
+    return std::count_if(for_blocks.cbegin(), for_blocks.cend(), [l](auto &b) {
+        return b.first <= l && b.second >= l;
+    });
+}
+
+void regalloc_run(long regs) {
+    regalloc_collect = false;
+    for (auto &[first, last]: for_blocks) {
+        if (std::any_of(for_blocks.cbegin(), for_blocks.cend(), [f = first, l = last](auto &b) {
+            return b.first <= f && b.second >= l && (b.first != f || b.second != l);
+        })) {
+            continue;
+        }
+        // the registers are loaded by the FOR line, other ways into the block would see stale values
+        bool ok = true;
+        for (auto &[l, i]: infos) {
+            if (l >= first && l <= last) {
+                if (i.barrier) ok = false;
+            } else if (std::any_of(i.jumps.cbegin(), i.jumps.cend(), [f = first, l = last](long d) {
+                return d > f && d <= l;
+            })) {
+                ok = false;
+            }
+        }
+        if (!ok) continue;
+        std::map<std::string, long> weight;
+        std::set<std::string> refs;
+        for (auto it = infos.lower_bound(first); it != infos.end() && it->first <= last; ++it) {
+            // inner loops run more often
+            long scale = 1l << (4 * std::min(loop_depth(it->first) - 1, 6l));
+            for (auto &[v, n]: it->second.uses) {
+                weight[v] += n * scale;
+            }
+            refs.insert(it->second.refs.cbegin(), it->second.refs.cend());
+        }
+        std::vector<std::pair<long, std::string>> candidates;
+        for (auto &[v, w]: weight) {
+            auto r = eval_ret_from_suffix(v.back());
+            if (refs.contains(v) || (r != NUMBERD && r != NUMBERL) || w < 3) continue;
+            candidates.emplace_back(-w, v);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        regalloc_region_t region{first, last, {}};
+        for (auto &[w, v]: candidates) {
+            if ((long) region.vars.size() == regs) break;
+            region.vars.push_back(v);
+        }
+        if (!region.vars.empty()) regions.push_back(region);
+    }
+}
+
+bool regalloc_used() {
+    return !regions.empty();
+}
+
+const regalloc_region_t *regalloc_region(long line) {
+    for (auto &r: regions) {
+        if (r.first <= line && r.last >= line) return &r;
+    }
+    return nullptr;
+}
+
+std::optional<long> regalloc_reg(std::string_view var) {
+    if (!regalloc_current) return std::nullopt;
+    auto &v = regalloc_current->vars;
+    auto it = std::find(v.cbegin(), v.cend(), var);
+    if (it == v.cend()) return std::nullopt;
+    return it - v.cbegin();
+}
+
+bool regalloc_leaves(long d) {
+    return regalloc_current && (d <= regalloc_current->first || d > regalloc_current->last);
+}
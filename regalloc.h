@@ -0,0 +1,38 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_REGALLOC_H
+#define SMOLBASIC55_REGALLOC_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// an outermost FOR block whose most used scalar variables live in callee-saved registers while it runs.
+// vars[i] is kept in register i of the backend, the variables in memory are only current after asm_regs_store.
+struct regalloc_region_t {
+    long first;
+    long last;
+    std::vector<std::string> vars;
+};
+
+// uses are collected while the lines are scanned
+extern bool regalloc_collect;
+// region of the line being emitted
+extern thread_local const regalloc_region_t *regalloc_current;
+
+void regalloc_use(std::string_view var, bool as_reference);
+void regalloc_jump(long to);
+void regalloc_barrier();
+
+// choose the variables of every region, at most regs per region
+void regalloc_run(long regs);
+bool regalloc_used();
+const regalloc_region_t *regalloc_region(long line);
+// register of a variable in the current region
+std::optional<long> regalloc_reg(std::string_view var);
+// a jump from the current line to line d leaves the current region (or restarts it)
+bool regalloc_leaves(long d);
+
+#endif //SMOLBASIC55_REGALLOC_H
@@ -2,11 +2,16 @@
 set -e
 
 #cmake-build-debug/smolbasic55-riscv64 $FLAGS $1 $1.S
-#riscv64-linux-gnu-gcc $1.S data.c array.c input.c print.c control.c string.c math.c -o $1.bin -lm 2>&1
+#riscv64-linux-gnu-gcc $1.S data.c array.c input.c print.c control.c string.c math.c profile.c -o $1.bin -lm 2>&1
 #qemu-riscv64 -L /usr/riscv64-linux-gnu $1.bin
 #rm -f $1.S $1.bin
 
-cmake-build-debug/smolbasic55-amd64 $FLAGS $1 $1.S
-gcc -g $1.S data.c array.c input.c print.c control.c string.c math.c -o $1.bin -lm 2>&1
+# smoltest --march= runs every test once per level in MARCH
+if [[ -n "$MARCH" ]]; then FLAGS="$FLAGS --march=$MARCH"; fi
+if [[ " $FLAGS " == *" --run "* || " $FLAGS " == *" --interp "* ]]; then exec cmake-build-debug/smolbasic55-amd64 $FLAGS $1; fi
+OUT=$1.S
+if [[ " $FLAGS " == *" --obj "* ]]; then OUT=$1.o; fi
+cmake-build-debug/smolbasic55-amd64 $FLAGS $1 $OUT
+gcc -g $OUT data.c array.c input.c print.c control.c string.c math.c profile.c -o $1.bin -lm 2>&1
 $1.bin
-rm -f $1.S $1.bin
+rm -f $OUT $1.bin
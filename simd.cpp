@@ -0,0 +1,136 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include "simd.h"
+#include "licm.h"
+#include "options.h"
+#include "util.h"
+
+// vector registers of amd64 (SSE2) and free general registers for the array addresses
+static constexpr long max_registers = 16;
+static constexpr long max_arrays = 7;
+
+// functions math.c applies to a whole array (SIN__v, SIN__vfast, ...)
+static const std::set<std::string_view> batch_funcs = {"ATN", "COS", "EXP", "LOG", "SIN"};
+
+static bool collect = true;
+static std::map<long, std::pair<struct exp_t *, struct exp_t *>> lets{};
+static std::map<long, simd_loop_t> loops{};
+
+void simd_let(struct exp_t *target, struct exp_t *value) {
+    if (!collect) return;
+    lets[line_no] = {target, value};
+}
+
+// an untyped one-dimensional array at the control variable plus a constant
+static std::optional<std::pair<std::string, long>> element(struct exp_t *exp, long l) {
+    if (exp->type != exp_t::OP) return std::nullopt;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op != ':' || !o->left) return std::nullopt;
+    auto n = is_name(o->left);
+    if (!n || !is_var_name(*n) || is_suffix(n->back()) || is_comma(o->right)) return std::nullopt;
+    auto vn = std::string(*n);
+    if (!var_dims.contains(vn) || var_dims.at(vn).second != 0) return std::nullopt;
+    auto offset = licm_index(o->right, l);
+    if (!offset) return std::nullopt;
+    return std::make_pair(vn, *offset);
+}
+
+// registers needed to compute exp (left operand first), or nullopt if it cannot be computed in vectors
+static std::optional<long> accept(struct exp_t *exp, long l, simd_loop_t &s) {
+    if (licm_invariant(exp, l)) {
+        s.invariants.push_back(exp);
+        return 1;
+    }
+    if (auto e = element(exp, l)) {
+        // elements of the assigned array are only read where they are written
+        auto &t = s.elements.front();
+        if (e->first == t.first && e->second != t.second) return std::nullopt;
+        s.elements.push_back(*e);
+        if (std::find(s.arrays.cbegin(), s.arrays.cend(), e->first) == s.arrays.cend()) s.arrays.push_back(e->first);
+        return 1;
+    }
+    if (exp->type != exp_t::OP) return std::nullopt;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    switch (o->op) {
+        case ':':
+            if (o->left) return std::nullopt;
+            return accept(o->right, l, s);
+        case '+':
+        case '-':
+        case '*': {
+            if (!o->right || (!o->left && o->op == '*')) return std::nullopt;
+            auto r = accept(o->right, l, s);
+            if (!r) return std::nullopt;
+            if (!o->left) return std::max(*r, 2L);
+            auto left = accept(o->left, l, s);
+            if (!left) return std::nullopt;
+            return std::max(*left, *r + 1);
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+// the function and argument of a call of one of batch_funcs
+static std::optional<std::pair<std::string_view, struct exp_t *>> batched(struct exp_t *exp) {
+    if (exp->type != exp_t::OP) return std::nullopt;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->op != ':' || !o->right) return std::nullopt;
+    if (!o->left) return batched(o->right);
+    auto n = is_name(o->left);
+    if (!n || !batch_funcs.contains(*n) || is_comma(o->right)) return std::nullopt;
+    return std::make_pair(*batch_funcs.find(*n), o->right);
+}
+
+// RND, maybe in parentheses
+static bool is_rnd(struct exp_t *exp) {
+    if (exp->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(exp->data);
+        return v->type == val_t::N && strcmp(v->ns, "RND") == 0;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    return o->op == ':' && !o->left && o->right && is_rnd(o->right);
+}
+
+void simd_run(const std::vector<long> &lines) {
+    collect = false;
+    // the body lines are counted one by one
+    if (options.profile) return;
+    for (auto [first, last]: for_blocks) {
+        auto body = std::upper_bound(lines.cbegin(), lines.cend(), first);
+        if (body == lines.end() || *body >= last || *std::next(body) != last || !lets.contains(*body)) continue;
+        if (licm_step(first) != 1) continue;
+        auto [target, value] = lets.at(*body);
+        auto t = element(target, first);
+        if (!t) continue;
+        simd_loop_t s{target, value, {}, {}, {*t}, {t->first}, 0};
+        if (auto b = batched(value); b && !licm_invariant(value, first)) {
+            s.func = b->first;
+            s.value = b->second;
+        } else if (is_rnd(value)) {
+            s.func = "RND";
+            s.value = nullptr;
+        }
+        auto depth = s.value ? accept(s.value, first, s) : std::optional<long>(0);
+        if (!depth || *depth + (long) s.invariants.size() > max_registers
+            || (long) s.arrays.size() > max_arrays) {
+            continue;
+        }
+        s.depth = *depth;
+        // the FOR line computes the invariants before it checks the bounds
+        line_no = first;
+        for (auto *e: s.invariants) {
+            eval_scan(e, false);
+        }
+        loops.emplace(first, std::move(s));
+    }
+}
+
+const simd_loop_t *simd_loop(long l) {
+    auto it = loops.find(l);
+    return it == loops.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_SIMD_H
+#define SMOLBASIC55_SIMD_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "eval.h"
+
+// a FOR loop with step 1 whose body is a single LET of an array element, computed by +, - and * from elements at
+// the same distance from the control variable and from values that do not change in the loop. The FOR line runs
+// two iterations at a time while both are left, the loop itself runs the rest.
+// If the value is SIN, COS, EXP, LOG or ATN of such an expression, the pairs store the argument and one call into
+// math.c applies the function to all of them (the OPTION FLAGS feature FASTMATH picks the polynomial kernels).
+// If the value is RND, RND__fill of math.c fills all elements at once.
+struct simd_loop_t {
+    struct exp_t *target;
+    // the argument of func, nullptr for RND
+    struct exp_t *value;
+    // empty if the value is stored as it is
+    std::string_view func;
+    // subexpressions of the value computed once before the loop
+    std::vector<struct exp_t *> invariants;
+    // arrays read or written, and the distance of their elements from the control variable
+    std::vector<std::pair<std::string, long>> elements;
+    // arrays by first use
+    std::vector<std::string> arrays;
+    // registers for the value, without the invariants
+    long depth;
+};
+
+// LET lines are collected while the lines are scanned
+void simd_let(struct exp_t *target, struct exp_t *value);
+
+// choose the loops, lines are all line numbers of the program in ascending order
+void simd_run(const std::vector<long> &lines);
+// the loop of the FOR line l
+const simd_loop_t *simd_loop(long l);
+
+#endif //SMOLBASIC55_SIMD_H
@@ -0,0 +1,73 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "slots.h"
+#include "asm.h"
+#include "eval.h"
+#include "licm.h"
+
+// FOR line of every 16 bytes handed out by add_loop_vars
+static std::vector<long> owners{};
+// offset of every 16 bytes, set by slots_run
+static std::vector<long> offsets{};
+static long size = 0;
+
+long add_loop_vars(long l) {
+    owners.push_back(l);
+    return 16 * static_cast<long>(owners.size() - 1);
+}
+
+// two loops are only alive at the same time if one runs inside the other, or if one of them can be entered or
+// left other than through its FOR and NEXT lines
+static bool disjoint(const std::pair<long, long> &a, const std::pair<long, long> &b) {
+    return (a.second < b.first || b.second < a.first) && licm_sealed(a.first) && licm_sealed(b.first);
+}
+
+void slots_run() {
+    std::map<long, long> last;
+    for (auto [first, l]: for_blocks) {
+        last[first] = l;
+    }
+    std::map<long, std::vector<size_t>> loops;
+    for (size_t i = 0; i < owners.size(); ++i) {
+        loops[owners[i]].push_back(i);
+    }
+    offsets.assign(owners.size(), 0);
+    // the loops in line order, each at the lowest offset no live loop uses
+    struct placed_t {
+        std::pair<long, long> lines;
+        long begin;
+        long end;
+    };
+    std::vector<placed_t> placed;
+    for (auto &[first, units]: loops) {
+        std::pair<long, long> lines{first, last.contains(first) ? last.at(first) : first};
+        auto bytes = 16 * static_cast<long>(units.size());
+        long begin = 0;
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (auto &p: placed) {
+                if (p.begin < begin + bytes && begin < p.end && !disjoint(p.lines, lines)) {
+                    begin = p.end;
+                    moved = true;
+                }
+            }
+        }
+        for (size_t k = 0; k < units.size(); ++k) {
+            offsets[units[k]] = begin + 16 * static_cast<long>(k);
+        }
+        placed.push_back({lines, begin, begin + bytes});
+        size = std::max(size, begin + bytes);
+    }
+}
+
+long loop_slot(long slot) {
+    return offsets[slot / 16] + slot % 16;
+}
+
+long loop_slots_size() {
+    return size;
+}
@@ -0,0 +1,20 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_SLOTS_H
+#define SMOLBASIC55_SLOTS_H
+
+// the limit, step, hoisted expressions and array walks of a FOR loop live in 16-byte loop variable slots at the
+// bottom of main's frame, the temporaries of main follow them. Loops that can never run at the same time share their
+// slots.
+
+// 16 bytes for the loop of FOR line l, the returned offset is only valid for that loop (see loop_slot)
+long add_loop_vars(long l);
+// place the slots of all loops, after licm_run
+void slots_run();
+// stack offset of byte slot of the loop variables
+long loop_slot(long slot);
+// bytes of all loop variables
+long loop_slots_size();
+
+#endif //SMOLBASIC55_SLOTS_H
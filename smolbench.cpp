@@ -0,0 +1,343 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Runs the programs in bench/ with both backends and prints one tab separated line per program and
+ * backend: compile time, assemble/link time, run time (milliseconds, best of --runs), size of the
+ * executable, peak RSS of the run and a hash of the output. Save the output as a baseline and pass it
+ * to --compare= later.
+ *
+ * amd64-run and amd64-interp compile and run the program in the compiler process (--run, --interp), their
+ * run time includes compiling and there is no executable. The comment lines at the end compare the total
+ * time of the three amd64 ways to run a program.
+ *
+ * FLAGS is passed to the compiler like in run.sh, --march= only to the backend of the level. A program
+ * reads stdin from the shell command after "REM BENCH-INPUT:" on its first line.
+ */
+
+std::filesystem::path pwd;
+std::filesystem::path benchdir;
+std::filesystem::path builddir;
+std::filesystem::path workdir;
+
+struct backend_t {
+    std::string name;
+    std::string compiler;
+    std::vector<std::string> cc;
+    std::vector<std::string> exec;
+    // option that runs the program in the compiler process, empty for an executable
+    std::string mode;
+};
+
+const std::vector<backend_t> backends = {
+        {"amd64",        "smolbasic55-amd64",   {"gcc"},                   {}},
+        {"riscv64",      "smolbasic55-riscv64", {"riscv64-linux-gnu-gcc"}, {"qemu-riscv64", "-L", "/usr/riscv64-linux-gnu"}},
+        {"amd64-run",    "smolbasic55-amd64",   {},                        {}, "--run"},
+        {"amd64-interp", "smolbasic55-amd64",   {},                        {}, "--interp"},
+};
+
+const char *runtime[] = {"data.c", "array.c", "input.c", "print.c", "control.c", "string.c", "math.c", "profile.c"};
+
+struct result_t {
+    int status = -1;
+    double ms = 0;
+    long rss_kb = 0;
+};
+
+// runs comp with stdin and stdout redirected, the time is wall clock time until it exits
+result_t exec(const std::vector<std::string> &comp, int in, int out) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t f = fork();
+    switch (f) {
+        case 0: {
+            dup2(in, 0);
+            dup2(out, 1);
+            std::vector<const char *> d;
+            d.reserve(comp.size() + 1);
+            for (auto &c: comp) {
+                d.push_back(c.c_str());
+            }
+            d.push_back(nullptr);
+            execvp(d[0], const_cast<char *const *>(d.data()));
+            perror(d[0]);
+            exit(127);
+        }
+        case -1:
+            throw std::runtime_error(strerror(errno));
+        default:
+            break;
+    }
+    int wstatus;
+    struct rusage ru{};
+    if (wait4(f, &wstatus, 0, &ru) == -1) throw std::runtime_error(strerror(errno));
+    result_t r;
+    r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    r.rss_kb = ru.ru_maxrss;
+    r.status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    return r;
+}
+
+std::vector<std::string> split(const std::string &s) {
+    std::vector<std::string> r;
+    std::stringstream ss(s);
+    std::string w;
+    while (ss >> w) r.push_back(w);
+    return r;
+}
+
+std::string input_command(const std::filesystem::path &bas) {
+    std::ifstream f(bas);
+    std::string l;
+    std::getline(f, l);
+    auto p = l.find("REM BENCH-INPUT:");
+    if (p == std::string::npos) return "";
+    return l.substr(p + strlen("REM BENCH-INPUT:"));
+}
+
+// FNV-1a of the output, to notice when a change alters what a program prints
+std::string hash_file(const std::filesystem::path &p) {
+    std::ifstream f(p, std::ios::binary);
+    unsigned long h = 14695981039346656037ul;
+    char c;
+    while (f.get(c)) {
+        h = (h ^ (unsigned char) c) * 1099511628211ul;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016lx", h);
+    return buf;
+}
+
+bool build_runtime(const backend_t &b, std::vector<std::string> &objects) {
+    int null = open("/dev/null", O_RDWR);
+    for (auto &c: runtime) {
+        auto o = workdir / (b.name + "-" + std::filesystem::path(c).stem().string() + ".o");
+        auto cmd = b.cc;
+        cmd.insert(cmd.end(), {"-O2", "-c", (pwd / c).string(), "-o", o.string()});
+        if (exec(cmd, null, 2).status) {
+            close(null);
+            return false;
+        }
+        objects.push_back(o.string());
+    }
+    close(null);
+    return true;
+}
+
+struct row_t {
+    std::string program, backend;
+    double compile_ms, link_ms, run_ms;
+    long size, rss_kb;
+    std::string output;
+};
+
+bool bench(const backend_t &b, const std::filesystem::path &bas, const std::vector<std::string> &objects,
+           const std::vector<std::string> &flags, int runs, row_t &row) {
+    auto name = bas.stem().string();
+    auto s = workdir / (name + "-" + b.name + ".S");
+    auto bin = workdir / (name + "-" + b.name + ".bin");
+    auto out = workdir / (name + "-" + b.name + ".out");
+    int null = open("/dev/null", O_RDWR);
+    row = {name, b.name, 1e300, 1e300, 1e300, 0, 0, ""};
+
+    std::vector<std::string> comp = {(builddir / b.compiler).string()};
+    std::vector<std::string> link = b.cc;
+    for (auto &f: flags) {
+        // --march= only goes to the backend of the level, the assembler needs the RISC-V extensions too
+        if (f.starts_with("--march=")) {
+            if (f.starts_with("--march=rv") != (b.name == "riscv64")) continue;
+            if (b.name == "riscv64") link.push_back(f.substr(1));
+        }
+        comp.push_back(f);
+    }
+    std::vector<std::string> run = b.exec;
+    if (b.mode.empty()) {
+        comp.insert(comp.end(), {bas.string(), s.string()});
+        link.insert(link.end(), {s.string()});
+        link.insert(link.end(), objects.begin(), objects.end());
+        link.insert(link.end(), {"-o", bin.string(), "-lm"});
+        run.push_back(bin.string());
+    } else {
+        run = comp;
+        run.insert(run.end(), {b.mode, bas.string()});
+    }
+    auto input = input_command(bas);
+
+    bool ok = true;
+    for (int i = 0; i < runs && ok; ++i) {
+        result_t c{.status = 0}, l{.status = 0};
+        if (b.mode.empty()) {
+            c = exec(comp, null, null);
+            l = c.status ? c : exec(link, null, null);
+        }
+        if (c.status || l.status) {
+            fprintf(stderr, "%s (%s): %s failed\n", name.c_str(), b.name.c_str(), c.status ? "compile" : "link");
+            ok = false;
+            break;
+        }
+        int o = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int in = null;
+        pid_t gen = -1;
+        if (!input.empty()) {
+            int p[2];
+            if (pipe(p)) throw std::runtime_error(strerror(errno));
+            gen = fork();
+            if (gen == 0) {
+                close(p[0]);
+                dup2(p[1], 1);
+                execl("/bin/sh", "sh", "-c", input.c_str(), (char *) nullptr);
+                exit(127);
+            }
+            close(p[1]);
+            in = p[0];
+        }
+        auto r = exec(run, in, o);
+        if (gen > 0) {
+            close(in);
+            waitpid(gen, nullptr, 0);
+        }
+        close(o);
+        if (r.status) {
+            fprintf(stderr, "%s (%s): run exited with %i\n", name.c_str(), b.name.c_str(), r.status);
+            ok = false;
+            break;
+        }
+        row.compile_ms = std::min(row.compile_ms, c.ms);
+        row.link_ms = std::min(row.link_ms, l.ms);
+        row.run_ms = std::min(row.run_ms, r.ms);
+        row.rss_kb = r.rss_kb;
+    }
+    close(null);
+    if (!ok) return false;
+    row.size = b.mode.empty() ? (long) std::filesystem::file_size(bin) : 0;
+    row.output = hash_file(out);
+    return true;
+}
+
+std::map<std::pair<std::string, std::string>, row_t> read_baseline(const std::string &path) {
+    std::map<std::pair<std::string, std::string>, row_t> r;
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("cannot read " + path);
+    std::string l;
+    while (std::getline(f, l)) {
+        if (l.empty() || l[0] == '#') continue;
+        std::stringstream ss(l);
+        row_t row;
+        ss >> row.program >> row.backend >> row.compile_ms >> row.link_ms >> row.run_ms >> row.size >> row.rss_kb
+           >> row.output;
+        r[{row.program, row.backend}] = row;
+    }
+    return r;
+}
+
+void print_change(const char *what, double now, double base) {
+    printf("  %s %.1f (%+.1f%%)", what, now, base ? 100.0 * (now - base) / base : 0.0);
+}
+
+// total time from the source to the end of the run with an executable, --run and --interp
+void print_totals(const std::map<std::string, std::map<std::string, double>> &totals) {
+    const char *ways[] = {"amd64", "amd64-run", "amd64-interp"};
+    if (std::none_of(totals.begin(), totals.end(), [](auto &t) { return t.second.size() >= 2; })) return;
+    printf("# total_ms");
+    for (auto w: ways) printf("\t%s", w);
+    printf("\tfastest\n");
+    for (auto &[program, t]: totals) {
+        if (t.size() < 2) continue;
+        std::string fastest;
+        printf("# %s", program.c_str());
+        for (auto w: ways) {
+            if (t.contains(w)) printf("\t%.1f", t.at(w));
+            else printf("\t-");
+            if (t.contains(w) && (fastest.empty() || t.at(w) < t.at(fastest))) fastest = w;
+        }
+        printf("\t%s\n", fastest.c_str());
+    }
+}
+
+int main(int argc, char **argv) {
+    int runs = 3;
+    std::string only, compare;
+    std::vector<std::string> programs;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view a(argv[i]);
+        if (a.starts_with("--runs=")) runs = std::max(1, atoi(argv[i] + 7));
+        else if (a.starts_with("--backend=")) only = a.substr(10);
+        else if (a.starts_with("--compare=")) compare = a.substr(10);
+        else if (!a.starts_with("-")) programs.emplace_back(a);
+        else {
+            fprintf(stderr, "usage: smolbench [--runs=N] [--backend=amd64|riscv64|amd64-run|amd64-interp] "
+                            "[--compare=BASELINE] [PROGRAM...]\n");
+            return 1;
+        }
+    }
+
+    pwd = getenv("PWD") ? getenv("PWD") : "";
+    if (pwd.empty()) {
+        throw std::runtime_error("cannot locate bench directory");
+    }
+    benchdir = pwd / "bench";
+    builddir = pwd / "cmake-build-debug";
+    workdir = builddir / "bench";
+    std::filesystem::create_directories(workdir);
+    auto flags = split(getenv("FLAGS") ? getenv("FLAGS") : "");
+
+    std::vector<std::filesystem::path> files;
+    for (auto &f: std::filesystem::directory_iterator(benchdir)) {
+        if (f.path().extension() == ".BAS") files.push_back(f.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::map<std::pair<std::string, std::string>, row_t> baseline;
+    if (!compare.empty()) baseline = read_baseline(compare);
+    else printf("# program\tbackend\tcompile_ms\tlink_ms\trun_ms\tsize\trss_kb\toutput\n");
+
+    std::map<std::string, std::map<std::string, double>> totals;
+    for (auto &b: backends) {
+        if (!only.empty() && only != b.name) continue;
+        std::vector<std::string> objects;
+        // the compiler runs --run and --interp with its own copy of the runtime
+        if (b.mode.empty() && !build_runtime(b, objects)) {
+            fprintf(stderr, "%s: cannot build the runtime, skipped\n", b.name.c_str());
+            continue;
+        }
+        for (auto &f: files) {
+            if (!programs.empty() && std::find(programs.begin(), programs.end(), f.stem().string()) == programs.end()) {
+                continue;
+            }
+            row_t row;
+            if (!bench(b, f, objects, flags, runs, row)) continue;
+            if (b.name.starts_with("amd64")) totals[row.program][b.name] = row.compile_ms + row.link_ms + row.run_ms;
+            if (compare.empty()) {
+                printf("%s\t%s\t%.1f\t%.1f\t%.1f\t%li\t%li\t%s\n", row.program.c_str(), row.backend.c_str(),
+                       row.compile_ms, row.link_ms, row.run_ms, row.size, row.rss_kb, row.output.c_str());
+            } else if (!baseline.contains({row.program, row.backend})) {
+                printf("%-8s %-8s not in baseline\n", row.program.c_str(), row.backend.c_str());
+            } else {
+                auto &base = baseline.at({row.program, row.backend});
+                printf("%-8s %-8s", row.program.c_str(), row.backend.c_str());
+                print_change("compile", row.compile_ms, base.compile_ms);
+                print_change("link", row.link_ms, base.link_ms);
+                print_change("run", row.run_ms, base.run_ms);
+                print_change("size", (double) row.size, (double) base.size);
+                print_change("rss", (double) row.rss_kb, (double) base.rss_kb);
+                if (row.output != base.output) printf("  OUTPUT CHANGED");
+                printf("\n");
+            }
+            fflush(stdout);
+        }
+    }
+    print_totals(totals);
+}
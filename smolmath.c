@@ -4,7 +4,7 @@
 #include "smolmath.h"
 
 #include <ctype.h>
-#include <alloca.h>
+#include <stddef.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +20,48 @@ static char *trim(char *i) {
 
 static jmp_buf err_jmp;
 
+// The trees of every parsed line are kept in blocks that are only freed by smolmath_free, so they outlive the
+// callback of smolmath_parse.
+struct block_t {
+    struct block_t *next;
+    size_t used;
+    size_t size;
+    max_align_t data[];
+};
+
+static struct block_t *blocks = 0;
+
+static void *arena_alloc(size_t n) {
+    n = (n + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    if (!blocks || blocks->size - blocks->used < n) {
+        size_t size = n > 65536 ? n : 65536;
+        struct block_t *b = malloc(sizeof(struct block_t) + size);
+        if (!b) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        b->next = blocks;
+        b->used = 0;
+        b->size = size;
+        blocks = b;
+    }
+    void *p = (char *) blocks->data + blocks->used;
+    blocks->used += n;
+    return p;
+}
+
+void smolmath_free(void) {
+    while (blocks) {
+        struct block_t *b = blocks;
+        blocks = b->next;
+        free(b);
+    }
+}
+
+// bracket frames of the line being parsed, reused by every line
+static char *nesting_buf = 0;
+static size_t nesting_size = 0;
+
 void smolmath_log(struct exp_t *root) {
     if (!root) return;
     else if (root->type == V) {
@@ -192,11 +234,23 @@ int smolmath_parse(char *line, const char *precedence, char minus, const char *a
         char *ops = 0;
         char *ixs = 0;
         char *sbuf = 0;
-        if (nesting_level) nesting = alloca(nesting_level + nesting_level * sizeof(struct exp_t *));
-        if (val_count) vals = alloca(val_count * (sizeof(struct exp_t) + sizeof(struct val_t)));
-        if (op_count) ops = alloca(op_count * (sizeof(struct exp_t) + sizeof(struct op_t)));
-        if (ix_count) ixs = alloca(ix_count * (sizeof(struct exp_t) + sizeof(struct op_t)));
-        if (n_size) sbuf = alloca(n_size);
+        if (nesting_level) {
+            size_t n = nesting_level + nesting_level * sizeof(struct exp_t *);
+            if (n > nesting_size) {
+                free(nesting_buf);
+                nesting_buf = malloc(n);
+                if (!nesting_buf) {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+                nesting_size = n;
+            }
+            nesting = nesting_buf;
+        }
+        if (val_count) vals = arena_alloc(val_count * (sizeof(struct exp_t) + sizeof(struct val_t)));
+        if (op_count) ops = arena_alloc(op_count * (sizeof(struct exp_t) + sizeof(struct op_t)));
+        if (ix_count) ixs = arena_alloc(ix_count * (sizeof(struct exp_t) + sizeof(struct op_t)));
+        if (n_size) sbuf = arena_alloc(n_size);
         val_count = 0;
         op_count = 0;
         nesting_level = 0;
@@ -41,8 +41,12 @@ typedef void (*smolmath_cb)(struct exp_t *exp);
 
 void smolmath_log(struct exp_t *exp);
 
+// the tree passed to cb stays valid until smolmath_free
 int smolmath_parse(char *line, const char *precedence, char minus, const char *alnum, smolmath_cb cb);
 
+// frees the trees of every parsed line
+void smolmath_free(void);
+
 #ifdef __cplusplus
 };
 #endif
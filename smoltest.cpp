@@ -11,18 +11,24 @@
 #include <cstring>
 #include <fcntl.h>
 #include <cassert>
+#include <fstream>
+#include <chrono>
+#include <sched.h>
 
 /*
  * CONFIG SECTION
  * - ADJUST CODE BELOW
  */
 
-#define MAX_NUMBER_OF_PROCESSES 16
-
 std::filesystem::path pwd;
 std::filesystem::path srcdir;
 std::filesystem::path builddir;
 std::filesystem::path bas55;
+std::filesystem::path cache_file;
+// files every test result depends on
+std::vector<std::filesystem::path> common_inputs;
+// --march= levels every test runs with, "" is the default of the compiler
+std::vector<std::string> march_levels{""};
 
 pid_t exec(std::vector<std::string> comp);
 
@@ -37,12 +43,46 @@ void init() {
     srcdir = pwd / "tests";
     builddir = pwd / "cmake-build-debug" / "tests";
     bas55 = pwd / "run.sh";
+    cache_file = builddir / "smoltest.cache";
+    // every .test sources chkout.inc
+    common_inputs = {pwd / "cmake-build-debug" / "smolbasic55-amd64", bas55, srcdir / "chkout.inc"};
+    for (auto c: {"data.c", "array.c", "input.c", "print.c", "control.c", "string.c", "math.c", "profile.c"}) {
+        common_inputs.push_back(pwd / c);
+    }
+    std::filesystem::create_directories(builddir);
     setenv("srcdir", srcdir.c_str(), 1);
     setenv("builddir", builddir.c_str(), 1);
     setenv("bas55", bas55.c_str(), 1);
 }
 
-using RETVAL = std::vector<std::pair<std::function<pid_t(void)>, std::function<std::string()>>>;
+struct test_case_t {
+    std::function<pid_t(void)> exec;
+    std::function<std::string()> name;
+    // files the result depends on, besides common_inputs
+    std::vector<std::filesystem::path> inputs;
+};
+
+using RETVAL = std::vector<test_case_t>;
+
+// the program a test script runs, from its "nom=" line
+std::string test_program(const std::filesystem::path &p) {
+    std::ifstream f(p);
+    std::string l;
+    while (std::getline(f, l)) {
+        if (l.starts_with("nom=")) return l.substr(4);
+    }
+    return "";
+}
+
+// the script runs the RISC-V backend itself (run.sh only runs the AMD64 one)
+bool test_uses_riscv(const std::filesystem::path &p) {
+    std::ifstream f(p);
+    std::string l;
+    while (std::getline(f, l)) {
+        if (l.find("smolbasic55-riscv64") != std::string::npos) return true;
+    }
+    return false;
+}
 
 RETVAL enumerateTestCases() {
     RETVAL ret{};
@@ -50,7 +90,22 @@ RETVAL enumerateTestCases() {
         auto &p = f.path();
         if (p.has_extension()) {
             if (p.extension() == ".test") {
-                ret.emplace_back([p]() { return exec({"timeout", "10", p}); }, [p]() { return (--p.end())->string(); });
+                std::vector<std::filesystem::path> inputs{p};
+                auto nom = test_program(p);
+                for (auto e: {".BAS", ".ok", ".eok"}) {
+                    if (!nom.empty() && std::filesystem::exists(srcdir / (nom + e))) inputs.push_back(srcdir / (nom + e));
+                }
+                if (test_uses_riscv(p)) inputs.push_back(pwd / "cmake-build-debug" / "smolbasic55-riscv64");
+                for (auto &m: march_levels) {
+                    if (m.empty()) {
+                        ret.push_back({[p]() { return exec({"timeout", "10", p}); },
+                                       [p]() { return (--p.end())->string(); }, inputs});
+                    } else {
+                        // run.sh adds --march= to the flags of the test
+                        ret.push_back({[p, m]() { return exec({"env", "MARCH=" + m, "timeout", "10", p}); },
+                                       [p, m]() { return m + "/" + (--p.end())->string(); }, inputs});
+                    }
+                }
             }
         }
     }
@@ -98,6 +153,60 @@ pid_t exec(std::vector<std::string> comp) {
 }
 
 
+/*
+ * Results are cached in cache_file under a hash of everything a test depends on, unchanged tests are
+ * not run again. The stored durations schedule the longest tests first.
+ */
+
+struct cache_entry_t {
+    std::string key;
+    std::string status;
+    double ms = 0;
+};
+
+std::map<std::string, cache_entry_t> cache{};
+bool use_cache = true;
+
+void hash_file(unsigned long &h, const std::filesystem::path &p) {
+    std::ifstream f(p, std::ios::binary);
+    char buf[65536];
+    while (f.read(buf, sizeof(buf)) || f.gcount()) {
+        for (long i = 0; i < f.gcount(); ++i) {
+            h = (h ^ (unsigned char) buf[i]) * 1099511628211ul;
+        }
+    }
+    h = (h ^ 0xff) * 1099511628211ul;
+}
+
+std::string hex(unsigned long h) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016lx", h);
+    return buf;
+}
+
+void load_cache() {
+    std::ifstream f(cache_file);
+    std::string name;
+    cache_entry_t e;
+    while (f >> name >> e.key >> e.status >> e.ms) {
+        cache[name] = e;
+    }
+}
+
+void save_cache() {
+    std::ofstream f(cache_file);
+    for (auto &[name, e]: cache) {
+        f << name << " " << e.key << " " << e.status << " " << e.ms << std::endl;
+    }
+}
+
+long number_of_processes() {
+    if (getenv("SMOLTEST_JOBS")) return std::max(1, atoi(getenv("SMOLTEST_JOBS")));
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) return std::max(1, CPU_COUNT(&set));
+    return std::max(1l, sysconf(_SC_NPROCESSORS_ONLN));
+}
+
 #define REDBG "\x1b[41m"
 #define REDFG "\x1b[31m"
 #define GREEN "\x1b[32m"
@@ -117,19 +226,68 @@ void good(const char *msg) {
            " %s\n", msg);
 }
 
+void cached(const char *n, const char *msg) {
+    if (strcmp(n, "GOOD") == 0) {
+        printf(GREEN "GOOD" RST " %s (cached)\n", msg);
+    } else {
+        printf(REDBG "%4s" RST " %s (cached)\n", n, msg);
+    }
+}
+
 void screen_list(RETVAL &cases) {
     std::map<pid_t, std::function<std::string()>> processes{};
+    std::map<pid_t, std::chrono::steady_clock::time_point> started{};
+    std::map<std::string, std::string> keys{};
     std::map<std::string, std::string> statuses {};
-    auto case_iter = cases.begin();
-    auto case_end = cases.end();
+    long max_processes = number_of_processes();
+
+    unsigned long common = 14695981039346656037ul;
+    for (auto &p: common_inputs) {
+        hash_file(common, p);
+    }
+    // run.sh passes both to the compiler
+    for (auto v: {"FLAGS", "MARCH"}) {
+        for (auto c: std::string(getenv(v) ? getenv(v) : "")) {
+            common = (common ^ (unsigned char) c) * 1099511628211ul;
+        }
+        common = (common ^ 0xff) * 1099511628211ul;
+    }
+    RETVAL todo{};
+    for (auto &c: cases) {
+        unsigned long h = common;
+        for (auto &p: c.inputs) {
+            hash_file(h, p);
+        }
+        auto name = c.name();
+        keys[name] = hex(h);
+        if (use_cache && cache.contains(name) && cache.at(name).key == keys[name]) {
+            statuses[name] = cache.at(name).status;
+            cached(statuses[name].c_str(), name.c_str());
+        } else {
+            todo.push_back(c);
+        }
+    }
+    // longest first, tests without a stored duration count as longest
+    std::stable_sort(todo.begin(), todo.end(), [](auto &a, auto &b) {
+        auto d = [](const test_case_t &c) {
+            auto n = c.name();
+            return cache.contains(n) ? cache.at(n).ms : 1e300;
+        };
+        return d(a) > d(b);
+    });
+
+    auto case_iter = todo.begin();
+    auto case_end = todo.end();
     while (!processes.empty() || case_iter != case_end) {
         while(case_iter != case_end) {
-            if (child_processes_active >= MAX_NUMBER_OF_PROCESSES) break;
-            auto [ex, txt] = *case_iter;
+            if (child_processes_active >= max_processes) break;
+            auto &ex = case_iter->exec;
+            auto &txt = case_iter->name;
             try {
                 auto e = ex();
                 assert(!processes.contains(e));
                 processes[e] = txt;
+                started[e] = std::chrono::steady_clock::now();
             } catch (std::runtime_error &err) {
                 fail("FAIL", err.what());
             }
@@ -260,7 +418,11 @@ void screen_list(RETVAL &cases) {
         }
         child_processes_active = std::max(child_processes_active - 1, 0);
         processes.erase(w);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started.at(w)).count();
+        started.erase(w);
+        cache[s] = {keys.at(s), statuses.at(s), ms};
     }
+    save_cache();
 
     if(std::all_of(statuses.cbegin(), statuses.cend(), [](auto p) {
         return strcmp(p.second.c_str(), "GOOD") == 0;
@@ -288,8 +450,25 @@ void screen_grid(RETVAL &cases, long h, long w) {
 }
 
 int
-main() {
+main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            march_levels.clear();
+            std::string_view l(argv[i] + 8);
+            while (!l.empty()) {
+                auto c = l.find(',');
+                march_levels.emplace_back(l.substr(0, c));
+                l = c == l.npos ? "" : l.substr(c + 1);
+            }
+        } else {
+            fprintf(stderr, "usage: smoltest [--no-cache] [--march=LEVEL,...]\n");
+            exit(EXIT_FAILURE);
+        }
+    }
     init();
+    load_cache();
 
     auto cases = enumerateTestCases();
 
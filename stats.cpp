@@ -0,0 +1,86 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include "stats.h"
+#include "options.h"
+#include <ctime>
+#include <cstdio>
+
+stats_t stats{};
+
+static stats_phase_t current = PHASE_PARSE;
+static double wall_start;
+static double cpu_start;
+
+static double now(clockid_t clock) {
+    struct timespec ts{};
+    clock_gettime(clock, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// add the time since the last switch to the current phase
+static void stats_switch(stats_phase_t next) {
+    double w = now(CLOCK_MONOTONIC);
+    double c = now(CLOCK_PROCESS_CPUTIME_ID);
+    if (wall_start != 0) {
+        stats.wall[current] += w - wall_start;
+        stats.cpu[current] += c - cpu_start;
+    }
+    wall_start = w;
+    cpu_start = c;
+    current = next;
+}
+
+stats_timer_t::stats_timer_t(stats_phase_t phase) : outer(current), active(options.stats) {
+    if (active) stats_switch(phase);
+}
+
+stats_timer_t::~stats_timer_t() {
+    if (active) stats_switch(outer);
+}
+
+static const char *phase_names[PHASE_COUNT] = {"read", "parse", "scan", "emit", "data", "output"};
+
+void stats_report(std::ostream &out, bool json) {
+    double wall = 0, cpu = 0;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        wall += stats.wall[p];
+        cpu += stats.cpu[p];
+    }
+    const std::pair<const char *, long> counts[] = {
+            {"lines",         stats.lines},
+            {"expressions",   stats.expressions},
+            {"max_tmp_count", stats.max_tmp_count},
+            {"tmp_labels",    stats.tmp_labels},
+            {"strings",       stats.strings},
+            {"data_items",    stats.data_items},
+            {"asm_bytes",     stats.asm_bytes},
+    };
+    char buf[128];
+    if (json) {
+        out << "{\"phases\": {";
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            snprintf(buf, sizeof(buf), "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}", p ? ", " : "", phase_names[p],
+                     stats.wall[p], stats.cpu[p]);
+            out << buf;
+        }
+        snprintf(buf, sizeof(buf), "}, \"total\": {\"wall\": %.6f, \"cpu\": %.6f}", wall, cpu);
+        out << buf;
+        for (auto &[name, v]: counts) {
+            out << ", \"" << name << "\": " << v;
+        }
+        out << "}" << std::endl;
+    } else {
+        out << "phase        wall ms     cpu ms" << std::endl;
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            snprintf(buf, sizeof(buf), "%-8s %10.3f %10.3f", phase_names[p], stats.wall[p] * 1e3, stats.cpu[p] * 1e3);
+            out << buf << std::endl;
+        }
+        snprintf(buf, sizeof(buf), "%-8s %10.3f %10.3f", "total", wall * 1e3, cpu * 1e3);
+        out << buf << std::endl;
+        for (auto &[name, v]: counts) {
+            snprintf(buf, sizeof(buf), "%-13s %ld", name, v);
+            out << buf << std::endl;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_STATS_H
+#define SMOLBASIC55_STATS_H
+
+#include <ostream>
+
+enum stats_phase_t {
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_SCAN,
+    PHASE_EMIT,
+    PHASE_DATA,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+};
+
+struct stats_t {
+    double wall[PHASE_COUNT];
+    double cpu[PHASE_COUNT];
+    long lines;
+    long expressions;
+    long max_tmp_count;
+    long tmp_labels;
+    long strings;
+    long data_items;
+    long asm_bytes;
+};
+
+extern stats_t stats;
+
+// time spent while a timer is alive is counted for its phase only, the enclosing phase is paused.
+// timers only measure with --stats.
+class stats_timer_t {
+    stats_phase_t outer;
+    bool active;
+public:
+    explicit stats_timer_t(stats_phase_t phase);
+    ~stats_timer_t();
+};
+
+void stats_report(std::ostream &out, bool json);
+
+#endif //SMOLBASIC55_STATS_H
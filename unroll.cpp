@@ -0,0 +1,129 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <optional>
+#include "unroll.h"
+#include "asm.h"
+#include "licm.h"
+#include "options.h"
+#include "pgo.h"
+#include "simd.h"
+#include "util.h"
+
+// expression nodes the copies of a body may add, and the most iterations unrolled completely
+static constexpr long max_cost = 64;
+static constexpr long max_full = 8;
+// longer loops are not counted at compile time
+static constexpr long max_trips = 1 << 20;
+
+struct unroll_for_t {
+    struct exp_t *var;
+    struct exp_t *init;
+    struct exp_t *limit;
+    struct exp_t *step;
+};
+
+static bool collect = true;
+static std::map<long, long> straight{};
+static std::map<long, unroll_for_t> fors{};
+static std::map<long, unroll_t> loops{};
+
+static long cost(struct exp_t *exp) {
+    if (!exp) return 0;
+    if (exp->type == exp_t::V) return 1;
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    return 1 + cost(o->left) + cost(o->right);
+}
+
+void unroll_line(struct exp_t *exp) {
+    if (!collect) return;
+    straight[line_no] = 1 + cost(exp);
+}
+
+void unroll_for(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step) {
+    if (!collect) return;
+    fors[line_no] = {var, init, limit, step};
+}
+
+// an untyped numeric constant, the value the program computes for it
+static std::optional<double> literal(struct exp_t *exp) {
+    if (exp->type == exp_t::V) {
+        auto *v = reinterpret_cast<val_t *>(exp->data);
+        if (eval_ret_from_suffix(v->suffix) != NUMBERD) return std::nullopt;
+        if (v->type == val_t::L) return (double) v->l;
+        if (v->type == val_t::F) return v->f;
+        return std::nullopt;
+    }
+    auto *o = reinterpret_cast<op_t *>(exp->data);
+    if (o->left || !o->right) return std::nullopt;
+    auto r = literal(o->right);
+    if (!r) return std::nullopt;
+    switch (o->op) {
+        case ':':
+        case '+':
+            return r;
+        case '-':
+            return 0 - *r;
+        default:
+            return std::nullopt;
+    }
+}
+
+// iterations of the loop, counted like asm_for_cond and asm_for_step
+static std::optional<long> trips(const unroll_for_t &f) {
+    auto vn = is_simple_var(f.var);
+    if (!vn || is_suffix(vn->back())) return std::nullopt;
+    auto init = literal(f.init);
+    auto limit = literal(f.limit);
+    auto step = f.step ? literal(f.step) : std::optional<double>{1};
+    if (!init || !limit || !step) return std::nullopt;
+    double sign = std::signbit(*step) ? -1 : 1;
+    double v = *init;
+    for (long t = 0; t < max_trips; ++t) {
+        if ((v - *limit) * sign > 0) return t;
+        v += *step;
+    }
+    return std::nullopt;
+}
+
+void unroll_run(const std::vector<long> &lines) {
+    collect = false;
+    // every line counts its own runs
+    if (options.profile) return;
+    for (auto [first, last]: for_blocks) {
+        if (!fors.contains(first) || !licm_sealed(first) || simd_loop(first)) continue;
+        unroll_t u{{}, 0, 1};
+        long c = 0;
+        for (auto it = std::upper_bound(lines.cbegin(), lines.cend(), first); it != lines.cend() && *it < last; ++it) {
+            if (!straight.contains(*it)) {
+                c = -1;
+                break;
+            }
+            u.body.push_back(*it);
+            c += straight.at(*it);
+        }
+        auto t = trips(fors.at(first));
+        if (c < 0 || u.body.empty() || !t || *t == 0) continue;
+        // with a profile, loops that never ran stay small and hot loops may grow twice as much
+        if (pgo_cold(first)) continue;
+        auto cost = pgo_hot(first) ? 2 * max_cost : max_cost;
+        if (*t <= max_full && *t * c <= cost) {
+            u.peel = *t;
+        } else {
+            for (u.factor = asm_unroll_factor(); u.factor > 1; u.factor /= 2) {
+                u.peel = *t % u.factor;
+                if ((u.peel + u.factor - 1) * c <= cost) break;
+            }
+            if (u.factor < 2) continue;
+        }
+        loops.emplace(first, std::move(u));
+    }
+}
+
+const unroll_t *unroll_loop(long l) {
+    auto it = loops.find(l);
+    return it == loops.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,28 @@
+// Copyright (c) 2024      Fabian Stiewitz <fabian (at) stiewitz.pw>
+// Licensed under the EUPL-1.2
+
+#ifndef SMOLBASIC55_UNROLL_H
+#define SMOLBASIC55_UNROLL_H
+
+#include <vector>
+#include "eval.h"
+
+// a FOR loop with constant bounds whose body lines run straight through. The FOR line runs the first peel
+// iterations on its own, NEXT runs factor - 1 copies of the body after the step, so the loop tests its limit
+// once every factor iterations. A loop that is unrolled completely only has peel iterations.
+struct unroll_t {
+    std::vector<long> body;
+    long peel;
+    long factor;
+};
+
+// lines that fall through to the next one (LET, PRINT, READ, REM), with the statement
+void unroll_line(struct exp_t *exp);
+void unroll_for(struct exp_t *var, struct exp_t *init, struct exp_t *limit, struct exp_t *step);
+
+// choose the loops, lines are all line numbers of the program in ascending order
+void unroll_run(const std::vector<long> &lines);
+// the unrolled loop of the FOR line l
+const unroll_t *unroll_loop(long l);
+
+#endif //SMOLBASIC55_UNROLL_H
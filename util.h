@@ -10,6 +10,7 @@
 #include "smolmath.h"
 
 std::string tr(std::string_view in);
+bool is_suffix(char c);
 bool is_var_name(std::string_view n);
 std::optional<std::string_view> is_name(struct exp_t *e);
 bool is_comma(struct exp_t *v);